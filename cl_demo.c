@@ -38,9 +38,13 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "version.h"
 #include "demo_controls.h"
 #include "mvd_utils.h"
+#include "sbar.h"
 #ifndef CLIENTONLY
 #include "server.h"
 #endif
+#ifdef WITH_ZLIB
+#include <zlib.h>
+#endif
 
 /* FIXME Move these to a proper header file and included that */
 void Cam_Unlock(void);
@@ -1531,8 +1535,18 @@ vfsfile_t *playbackfile = NULL;			// The demo file used for playback.
 float demo_time_length = 0;				// The length of the demo.
 
 unsigned char pb_buf[1024*32];			// Playback buffer.
+int		pb_start = 0;					// Where the unread data in the playback buffer starts.
 int		pb_cnt = 0;						// How many bytes we've have in playback buffer.
 qbool	pb_eof = false;					// Have we reached the end of the playback buffer?
+double	pb_consumed = 0;				// Bytes of demo data parsed since playback started, for timedemo.
+
+//
+// Returns the unread data in the playback buffer, pb_cnt bytes long.
+//
+unsigned char *CL_Demo_PB_Data(void)
+{
+	return pb_buf + pb_start;
+}
 
 //
 // Inits the demo playback buffer.
@@ -1546,16 +1560,19 @@ void CL_Demo_PB_Init(void *buf, int buflen)
 		Sys_Error("CL_Demo_PB_Init: buflen out of bounds.");
 
 	// Copy the specified init data into the playback buffer.
-	memcpy(pb_buf, buf, buflen);
+	if (buflen > 0)
+		memcpy(pb_buf, buf, buflen);
 
 	// Reset any associated playback buffers.
+	pb_start = 0;
 	pb_cnt = buflen;
 	pb_eof = false;
 }
 
 //
 // This is memory reading(not from file or socket), we just copy data from pb_buf[] to caller buffer,
-// sure if we're not peeking we decrease pb_buf[] size (pb_cnt) and move along pb_buf[] itself.
+// sure if we're not peeking we decrease pb_buf[] size (pb_cnt) and move the start of the unread data along.
+// The data isn't moved back to the start of pb_buf[] here, pb_ensure() does that once per refill.
 //
 int CL_Demo_Read(void *buf, int size, qbool peek)
 {
@@ -1566,13 +1583,14 @@ int CL_Demo_Read(void *buf, int size, qbool peek)
 		Host_Error("pb_read: size < 0");
 
 	need = max(0, min(pb_cnt, size));
-	memcpy(buf, pb_buf, need);
+	memcpy(buf, pb_buf + pb_start, need);
 
 	if (!peek)
 	{
 		// We are not peeking, so move along buffer.
 		pb_cnt -= need;
-		memmove(pb_buf, pb_buf + need, pb_cnt);
+		pb_start = pb_cnt ? pb_start + need : 0;
+		pb_consumed += need;
 
 		// We get some data from playback file or qtv stream, dump it to file right now.
 		if (need > 0 && cls.mvdplayback && cls.mvdrecording)
@@ -1616,16 +1634,25 @@ qbool pb_ensure(void)
 	if (cl_shownet.value == 3)
 		Com_Printf(" %d", pb_cnt);
 
-	// Try to fill the entire buffer with demo data.
-	pb_cnt += pb_raw_read(pb_buf + pb_cnt, max(0, (int)sizeof(pb_buf) - pb_cnt));
+	// Once the unread data has crept past the middle of the buffer, move it back to the start.
+	// That keeps at least half a buffer (more than any message) available after the refill,
+	// while the data is only moved once per half buffer instead of after every read.
+	if (pb_start > (int)sizeof(pb_buf) / 2)
+	{
+		memmove(pb_buf, pb_buf + pb_start, pb_cnt);
+		pb_start = 0;
+	}
 
-	if (pb_cnt == (int)sizeof(pb_buf) || pb_eof)
+	// Try to fill the rest of the buffer with demo data.
+	pb_cnt += pb_raw_read(pb_buf + pb_start + pb_cnt, max(0, (int)sizeof(pb_buf) - pb_start - pb_cnt));
+
+	if (pb_start + pb_cnt == (int)sizeof(pb_buf) || pb_eof)
 		return true; // Return true if we have full buffer or get EOF.
 
 	// Probably not enough data in buffer, check do we have at least one message in buffer.
 	if (cls.mvdplayback && pb_cnt)
 	{
-		if(ConsistantMVDData((unsigned char*)pb_buf, pb_cnt))
+		if(ConsistantMVDData(pb_buf + pb_start, pb_cnt))
 			return true;
 	}
 
@@ -1645,6 +1672,252 @@ qbool pb_ensure(void)
 
 static float prevtime = 0; // TODO: Put in a demo struct.
 
+//=============================================================================
+//								DEMO KEYFRAMES
+//=============================================================================
+
+//
+// While a demo is played a snapshot of the client state is taken every
+// demo_keyframes_interval seconds, together with the file position of the
+// next message. Seeking restores the newest keyframe before the destination
+// and only parses the demo from there, instead of replaying it from the start.
+// The snapshots point at the models of the level they were taken on, so they
+// are only used on that level and aren't saved to disk.
+//
+
+cvar_t demo_keyframes = {"demo_keyframes", "1"};
+cvar_t demo_keyframes_interval = {"demo_keyframes_interval", "10"};
+
+static demo_keyframe_t *demo_keyframes_last = NULL;	// Newest keyframe, older ones are linked through prev.
+static byte *demo_keyframe_buf = NULL;				// Scratch space for (de)compressing snapshots.
+static int demo_keyframe_bufsize = 0;
+
+extern player_state_t oldplayerstates[MAX_CLIENTS];
+extern int parsecountmod;
+extern double parsecounttime;
+
+// The client state built up by parsing the demo.
+static struct { void *ptr; int size; } demo_keyframe_state[] = 
+{
+	{ &cl,				sizeof(cl) },
+	{ cl_entities,		sizeof(cl_entities) },
+	{ cl_lightstyle,	sizeof(cl_lightstyle) },
+	{ oldplayerstates,	sizeof(oldplayerstates) },
+	{ &parsecountmod,	sizeof(parsecountmod) },
+	{ &parsecounttime,	sizeof(parsecounttime) },
+};
+
+#define DEMO_KEYFRAME_STATES (sizeof(demo_keyframe_state) / sizeof(demo_keyframe_state[0]))
+
+// State other modules build up from the demo, they copy it in and out themselves.
+// size is the most a module may need, save and restore return how much they actually used.
+static struct { int (*size)(void); int (*save)(byte *buf); int (*restore)(byte *buf); } demo_keyframe_module[] = 
+{
+	{ Stats_StateSize,		Stats_SaveState,		Stats_RestoreState },		// fragstats
+	{ MVD_Stats_StateSize,	MVD_Stats_SaveState,	MVD_Stats_RestoreState },	// mvd_utils item and kill stats
+};
+
+#define DEMO_KEYFRAME_MODULES (sizeof(demo_keyframe_module) / sizeof(demo_keyframe_module[0]))
+
+// Every part of a snapshot starts aligned, the modules copy whole structs.
+#define DEMO_KEYFRAME_ALIGN(size) (((size) + 15) & ~15)
+
+static int CL_Demo_Keyframe_StateSize(void)
+{
+	int i, size = 0;
+
+	for (i = 0; i < DEMO_KEYFRAME_STATES; i++)
+		size += DEMO_KEYFRAME_ALIGN(demo_keyframe_state[i].size);
+
+	for (i = 0; i < DEMO_KEYFRAME_MODULES; i++)
+		size += DEMO_KEYFRAME_ALIGN(demo_keyframe_module[i].size());
+
+	return size;
+}
+
+//
+// Frees the keyframes of the demo that was played.
+//
+void CL_Demo_Keyframes_Clear(void)
+{
+	demo_keyframe_t *kf;
+
+	while ((kf = demo_keyframes_last))
+	{
+		demo_keyframes_last = kf->prev;
+		Q_free(kf->data);
+		Q_free(kf);
+	}
+}
+
+static qbool CL_Demo_Keyframes_Available(void)
+{
+	return demo_keyframes.integer && playbackfile && !cls.nqdemoplayback && cls.mvdplayback != QTV_PLAYBACK;
+}
+
+//
+// Takes a keyframe if it's been long enough since the last one.
+// Must be called between two demo messages.
+//
+static void CL_Demo_Keyframe_Check(void)
+{
+	demo_keyframe_t *kf;
+	byte *raw, *p;
+	int i, rawsize, size;
+
+	if (!CL_Demo_Keyframes_Available() || cls.state != ca_active || cls.demorewinding || !cl.validsequence)
+		return;
+
+	// The index only grows, so after rewinding we don't take keyframes again until we're past the last one.
+	if (demo_keyframes_last && prevtime < demo_keyframes_last->timestamp + max(1, demo_keyframes_interval.value))
+		return;
+
+	// MVD stats are only kept for MVDs, so the size depends on the demo.
+	size = CL_Demo_Keyframe_StateSize();
+	if (size > demo_keyframe_bufsize)
+	{
+		Q_free(demo_keyframe_buf);
+		#ifdef WITH_ZLIB
+		demo_keyframe_buf = Q_calloc(1, size + compressBound(size));
+		#else
+		demo_keyframe_buf = Q_calloc(1, size);
+		#endif
+		demo_keyframe_bufsize = size;
+	}
+
+	raw = demo_keyframe_buf;
+	for (i = 0, p = raw; i < DEMO_KEYFRAME_STATES; p += DEMO_KEYFRAME_ALIGN(demo_keyframe_state[i].size), i++)
+		memcpy(p, demo_keyframe_state[i].ptr, demo_keyframe_state[i].size);
+
+	for (i = 0; i < DEMO_KEYFRAME_MODULES; i++)
+		p += DEMO_KEYFRAME_ALIGN(demo_keyframe_module[i].save(p));
+
+	rawsize = p - raw;
+
+	#ifdef WITH_ZLIB
+	{
+		uLongf destlen = compressBound(rawsize);
+
+		if (compress2(raw + demo_keyframe_bufsize, &destlen, raw, rawsize, Z_BEST_SPEED) != Z_OK)
+			return;
+
+		raw += demo_keyframe_bufsize;
+		size = (int) destlen;
+	}
+	#else
+	size = rawsize;
+	#endif
+
+	kf = Q_malloc(sizeof(*kf));
+	kf->data = Q_malloc(size);
+	memcpy(kf->data, raw, size);
+	kf->size = size;
+	kf->rawsize = rawsize;
+
+	kf->filepos = VFS_TELL(playbackfile) - pb_cnt;
+	kf->timestamp = prevtime;
+	kf->servercount = cl.servercount;
+	kf->worldmodel = cl.worldmodel;
+	kf->olddemotime = olddemotime;
+	kf->nextdemotime = nextdemotime;
+	kf->incoming_sequence = cls.netchan.incoming_sequence;
+	kf->incoming_acknowledged = cls.netchan.incoming_acknowledged;
+	kf->outgoing_sequence = cls.netchan.outgoing_sequence;
+	kf->lastto = cls.lastto;
+	kf->lasttype = cls.lasttype;
+
+	kf->prev = demo_keyframes_last;
+	demo_keyframes_last = kf;
+}
+
+//
+// Continues playback from the newest keyframe taken before demotime.
+// When seeking forward, only keyframes well ahead of where we are now are worth it.
+// Returns false if there is no usable keyframe.
+//
+static qbool CL_Demo_Keyframe_Restore(double demotime, qbool forward)
+{
+	demo_keyframe_t *kf;
+	byte *p;
+	int i, rawsize, track, paused;
+	vec3_t angles, pos;
+
+	if (!CL_Demo_Keyframes_Available() || cls.state != ca_active)
+		return false;
+
+	// The next message may already have been peeked at, so its time must be before the destination too.
+	for (kf = demo_keyframes_last; kf && max(kf->timestamp, kf->nextdemotime) > demotime; kf = kf->prev)
+		;
+
+	if (!kf || kf->servercount != cl.servercount || kf->worldmodel != cl.worldmodel)
+		return false;
+
+	if (forward && kf->timestamp < prevtime + max(1, demo_keyframes_interval.value))
+		return false;
+
+	rawsize = kf->rawsize;
+	if (rawsize > demo_keyframe_bufsize)
+		return false;
+
+	#ifdef WITH_ZLIB
+	{
+		uLongf destlen = rawsize;
+
+		if (uncompress(demo_keyframe_buf, &destlen, kf->data, kf->size) != Z_OK || destlen != rawsize)
+			return false;
+	}
+	#else
+	memcpy(demo_keyframe_buf, kf->data, rawsize);
+	#endif
+
+	if (VFS_SEEK(playbackfile, kf->filepos, SEEK_SET) == -1)
+		return false;
+
+	CL_Demo_PB_Init(NULL, 0);
+
+	// Keep what the user is looking at and whether the demo is paused.
+	track = WhoIsSpectated();
+	VectorCopy(cl.viewangles, angles);
+	VectorCopy(cl.simorg, pos);
+	paused = cl.paused;
+
+	for (i = 0, p = demo_keyframe_buf; i < DEMO_KEYFRAME_STATES; p += DEMO_KEYFRAME_ALIGN(demo_keyframe_state[i].size), i++)
+		memcpy(demo_keyframe_state[i].ptr, p, demo_keyframe_state[i].size);
+
+	for (i = 0; i < DEMO_KEYFRAME_MODULES; i++)
+		p += DEMO_KEYFRAME_ALIGN(demo_keyframe_module[i].restore(p));
+
+	cl.paused = paused;
+	prevtime = kf->timestamp;
+	olddemotime = kf->olddemotime;
+	nextdemotime = kf->nextdemotime;
+	cls.netchan.incoming_sequence = kf->incoming_sequence;
+	cls.netchan.incoming_acknowledged = kf->incoming_acknowledged;
+	cls.netchan.outgoing_sequence = kf->outgoing_sequence;
+	cls.lastto = kf->lastto;
+	cls.lasttype = kf->lasttype;
+
+	if (track >= 0)
+	{
+		Cam_Lock(track);
+	}
+	else
+	{
+		Cam_Pos_Set(pos[0], pos[1], pos[2]);
+		Cam_Angles_Set(angles[0], angles[1], angles[2]);
+	}
+
+	// Effects from the time we jumped away from don't belong here.
+	memset(cl_dlights, 0, sizeof(cl_dlights));
+	CL_ClearTEnts();
+	R_InitParticles();
+
+	TP_RefreshSkins();
+	Sbar_Changed();
+
+	return true;
+}
+
 //
 // Peeks the demo time.
 //
@@ -1861,6 +2134,10 @@ static qbool CL_DemoShouldWeReadNextMessage(float demotime)
 			// and calculate the framerate when it's done.
 			cls.td_starttime = Sys_DoubleTime();
 			cls.td_startframe = cls.framecount;
+			cls.td_startbytes = pb_consumed;
+			cls.td_parsetime = 0;
+			cls.td_messages = 0;
+			memset(cls.td_stagetime, 0, sizeof(cls.td_stagetime));
 		}
 
 		cls.demotime = demotime; // Warp.
@@ -1962,6 +2239,11 @@ qbool CL_GetDemoMessage (void)
 		CL_Demo_Check_For_Rewind(nextdemotime);
 	}
 
+	// Skip ahead to a keyframe when seeking far forward, and take one if it's time.
+	if (cls.demoseeking == DST_SEEKING_NORMAL && !cls.demorewinding && cls.demotime > nextdemotime)
+		CL_Demo_Keyframe_Restore(cls.demotime, true);
+	CL_Demo_Keyframe_Check();
+
 	// Adjust the time for MVD playback.
 	if (cls.mvdplayback)
 	{
@@ -3136,6 +3418,18 @@ void CL_Demo_DumpBenchmarkResult(int frames, float timet)
 	fputs(va("\t<demo><name>%s</name></demo>\n", cls.demoname), f);
 
 	fputs(va("\t<result frames=\"%i\" time=\"PT%fS\" fps=\"%f\"/>\n", frames, timet, frames/timet), f);
+
+	if (cls.td_norender)
+	{
+		double bytes = pb_consumed - cls.td_startbytes;
+
+		fputs(va("\t<parse bytes=\"%.0f\" messages=\"%i\" time=\"PT%fS\" mbps=\"%f\" mps=\"%f\"/>\n",
+			bytes, cls.td_messages, cls.td_parsetime, cls.td_parsetime > 0 ? bytes / (1024 * 1024) / cls.td_parsetime : 0,
+			timet > 0 ? cls.td_messages / timet : 0), f);
+		fputs(va("\t<stages read=\"PT%fS\" parse=\"PT%fS\" predict=\"PT%fS\" link=\"PT%fS\"/>\n",
+			cls.td_stagetime[TD_STAGE_READ], cls.td_stagetime[TD_STAGE_PARSE],
+			cls.td_stagetime[TD_STAGE_PREDICT], cls.td_stagetime[TD_STAGE_LINK]), f);
+	}
 	
 	fputs("</timedemo>\n", f);
 
@@ -3195,8 +3489,28 @@ void CL_StopPlayback (void)
 		if (time <= 0)
 			time = 1;
 		Com_Printf ("%i frames %5.1f seconds %5.1f fps\n", frames, time, frames / time);
+		if (cls.td_norender)
+		{
+			double mb = (pb_consumed - cls.td_startbytes) / (1024 * 1024);
+
+			// Reading is whatever CL_ReadPackets spent outside of the parser.
+			cls.td_stagetime[TD_STAGE_READ] = max(0, cls.td_parsetime - cls.td_stagetime[TD_STAGE_PARSE]);
+
+			Com_Printf ("%.2f MB parsed, %.1f MB/s, %.1f MB/s in CL_ReadPackets\n",
+				mb, mb / time, cls.td_parsetime > 0 ? mb / cls.td_parsetime : 0);
+			Com_Printf ("%i messages, %.0f messages/s\n", cls.td_messages, cls.td_messages / time);
+			Com_Printf ("read %.3fs parse %.3fs predict %.3fs link %.3fs\n",
+				cls.td_stagetime[TD_STAGE_READ], cls.td_stagetime[TD_STAGE_PARSE],
+				cls.td_stagetime[TD_STAGE_PREDICT], cls.td_stagetime[TD_STAGE_LINK]);
+		}
 		if (demo_benchmarkdumps.integer)
 			CL_Demo_DumpBenchmarkResult(frames, time);
+
+		cls.td_norender = false;
+
+		// Started with -benchmark, we're done.
+		if (COM_CheckParm("-benchmark"))
+			Cbuf_AddText("quit\n");
 	}
 
 	// Go to the next demo in the demo playlist.
@@ -3209,6 +3523,7 @@ void CL_StopPlayback (void)
 	// Reset demoseeking and such.
 	cls.demoseeking = DST_SEEKING_NONE;
 	cls.demorewinding = false;
+	CL_Demo_Keyframes_Clear();
 
 	TP_ExecTrigger("f_demoend");
 }
@@ -3718,14 +4033,8 @@ static vfsfile_t* CL_Open_Demo_File(char* name, qbool searchpaks, char** fullPat
 //
 // Renders a demo as quickly as possible.
 //
-void CL_TimeDemo_f (void)
+static void CL_TimeDemo_Start(qbool norender)
 {
-	if (Cmd_Argc() != 2)
-	{
-		Com_Printf ("timedemo <demoname> : gets demo speeds\n");
-		return;
-	}
-
 	CL_Play_f ();
 
 	// We failed to start demoplayback.
@@ -3736,11 +4045,37 @@ void CL_TimeDemo_f (void)
 	// so all the loading time doesn't get counted.
 
 	cls.timedemo = true;
+	cls.td_norender = norender;
 	cls.td_starttime = 0;
 	cls.td_startframe = cls.framecount;
 	cls.td_lastframe = -1;		// Get a new message this frame.
 }
 
+void CL_TimeDemo_f (void)
+{
+	if (Cmd_Argc() != 2)
+	{
+		Com_Printf ("timedemo <demoname> : gets demo speeds\n");
+		return;
+	}
+
+	CL_TimeDemo_Start(false);
+}
+
+//
+// Timedemo without drawing anything, measures how fast the demo is read and parsed.
+//
+void CL_TimeDemo_NoRender_f (void)
+{
+	if (Cmd_Argc() != 2)
+	{
+		Com_Printf ("timedemo_norender <demoname> : gets demo parsing speed\n");
+		return;
+	}
+
+	CL_TimeDemo_Start(true);
+}
+
 void CL_QTVPlay (vfsfile_t *newf, void *buf, int buflen);
 
 char qtvrequestbuffer[512 * 1024] = {0}; // mmm, demo list may be pretty long
@@ -4488,6 +4823,10 @@ void CL_Demo_Check_For_Rewind(float nextdemotime)
 	// If we're seeking and our seek destination is in the past we need to rewind.
 	if (cls.demoseeking && !cls.demorewinding && (cls.demotime < nextdemotime))
 	{
+		// Go back to the closest keyframe if we have one, the seek continues from there.
+		if (CL_Demo_Keyframe_Restore(cls.demotime, false))
+			return;
+
 		// Restart playback from the start of the file and then demo seek to the rewind spot.
 		VFS_SEEK(playbackfile, 0, SEEK_SET);
 
@@ -4943,13 +5282,12 @@ double Demo_GetSpeed(void)
 	{
 		if (qtv_adjustbuffer.integer)
 		{
-			extern	unsigned char pb_buf[];
 			extern	int		pb_cnt;
 
 			int				ms;
 			double			demospeed, desired, current;
 
-			ConsistantMVDDataEx(pb_buf, pb_cnt, &ms);
+			ConsistantMVDDataEx(CL_Demo_PB_Data(), pb_cnt, &ms);
 
 			desired = max(0.5, QTVBUFFERTIME); // well, we need some reserve for adjusting
 			current = 0.001 * ms;
@@ -5076,6 +5414,14 @@ void CL_Demo_Init(void)
 		}
 	}
 
+	//
+	// -benchmark <demo> plays the demo without drawing, logs the timings and quits.
+	//
+	if ((parm = COM_CheckParm("-benchmark")) && parm + 1 < COM_Argc())
+	{
+		Cbuf_AddText(va("timedemo_norender \"%s\"\n", COM_Argv(parm + 1)));
+	}
+
 	//
 	// Add demo commands.
 	//
@@ -5085,6 +5431,7 @@ void CL_Demo_Init(void)
 	Cmd_AddCommand ("stopqwd", CL_Stop_f);
 	Cmd_AddCommand ("playdemo", CL_Play_f);
 	Cmd_AddCommand ("timedemo", CL_TimeDemo_f);
+	Cmd_AddCommand ("timedemo_norender", CL_TimeDemo_NoRender_f);
 	Cmd_AddCommand ("easyrecord", CL_EasyRecord_f);
 
 	Cmd_AddCommand("demo_setspeed", CL_Demo_SetSpeed_f);
@@ -5115,6 +5462,8 @@ void CL_Demo_Init(void)
 	Cvar_Register(&demo_dir);
 	Cvar_Register(&demo_benchmarkdumps);
 	Cvar_Register(&cl_startupdemo);
+	Cvar_Register(&demo_keyframes);
+	Cvar_Register(&demo_keyframes_interval);
 
 	Cvar_ResetCurrentGroup();
 }
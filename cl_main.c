@@ -51,6 +51,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "qsound.h"
 #include "menu.h"
 #include "image.h"
+#include "prefetch.h"
 #ifndef _WIN32
 #include <netdb.h>
 #include <sys/socket.h>
@@ -1298,6 +1299,7 @@ void CL_Disconnect (void)
 
 	// Stop sounds (especially looping!)
 	S_StopAllSounds (true);
+	Prefetch_Flush ();
 
 	MT_Disconnect();
 
@@ -1641,7 +1643,7 @@ qbool CL_GetMessage (void)
 	return true;
 }
 
-void CL_ReadPackets (void) 
+static void CL_ReadServerPackets (void) 
 {
 	if (cls.nqdemoplayback) 
 	{
@@ -1682,7 +1684,18 @@ void CL_ReadPackets (void)
 				continue; // Wasn't accepted for some reason.
 		}
 
-		CL_ParseServerMessage();
+		if (cls.timedemo)
+		{
+			double start = Sys_DoubleTime();
+
+			CL_ParseServerMessage();
+			cls.td_stagetime[TD_STAGE_PARSE] += Sys_DoubleTime() - start;
+			cls.td_messages++;
+		}
+		else
+		{
+			CL_ParseServerMessage();
+		}
 	}
 
 	// Check timeout.
@@ -1697,6 +1710,22 @@ void CL_ReadPackets (void)
 	}
 }
 
+void CL_ReadPackets (void) 
+{
+	double start;
+
+	if (!cls.timedemo)
+	{
+		CL_ReadServerPackets();
+		return;
+	}
+
+	// Timedemo also measures how long reading and parsing the demo takes.
+	start = Sys_DoubleTime();
+	CL_ReadServerPackets();
+	cls.td_parsetime += Sys_DoubleTime() - start;
+}
+
 void CL_SendToServer (void) 
 {
 	// When recording demos, request new ping times every cl_demoPingInterval.value seconds.
@@ -2035,15 +2064,19 @@ void CL_Init (void)
 	V_Init ();
 	MVD_Utils_Init ();
 
+	cls.headless = COM_CheckParm("-benchmark") ? true : false;
+
 	VID_Init(host_basepal);
 	IN_Init();
 
 	Image_Init();
+	Prefetch_Init();
 
 	GFX_Init ();
 
 #if defined(FRAMEBUFFERS)
-	Framebuffer_Init();
+	if (!cls.headless)
+		Framebuffer_Init();
 #endif
 
 	S_Init ();
@@ -2478,6 +2511,8 @@ void CL_Frame (double time)
 	if (cls.state >= ca_onserver)
 	{
 		qbool setup_player_prediction = ((physframe && cl_independentPhysics.value != 0) || cl_independentPhysics.value == 0);
+		double stagestart;
+
 		if (!cls.demoplayback && cl_earlypackets.integer)
 		{
 			// actually it should be curtime == cls.netchan.last_received but that did not work on float values...
@@ -2490,6 +2525,8 @@ void CL_Frame (double time)
 				}
 			}
 		}
+		stagestart = cls.timedemo ? Sys_DoubleTime() : 0;
+
 		Cam_SetViewPlayer();
 
 		// Set up prediction for other players
@@ -2507,8 +2544,19 @@ void CL_Frame (double time)
 			CL_SetUpPlayerPrediction(true);
 		}
 
+		if (cls.timedemo)
+		{
+			double now = Sys_DoubleTime();
+
+			cls.td_stagetime[TD_STAGE_PREDICT] += now - stagestart;
+			stagestart = now;
+		}
+
 		// build a refresh entity list
 		CL_EmitEntities();
+
+		if (cls.timedemo)
+			cls.td_stagetime[TD_STAGE_LINK] += Sys_DoubleTime() - stagestart;
 	}
 
 	//
@@ -2543,7 +2591,8 @@ void CL_Frame (double time)
 	}
 
 	// update video
-	SCR_UpdateScreen();
+	if (!cls.td_norender)
+		SCR_UpdateScreen();
 
 	CL_DecayLights();
 
@@ -45,6 +45,7 @@ $Id: cl_parse.c,v 1.135 2007-10-28 19:56:44 qqshka Exp $
 #include "mvd_utils.h"
 #include "input.h"
 #include "qtv.h"
+#include "prefetch.h"
 
 void R_TranslatePlayerSkin (int playernum);
 
@@ -592,6 +593,7 @@ void CL_Prespawn (void)
 
 	CL_FindModelNumbers ();
 	R_NewMap (false);
+	Prefetch_Flush ();
 	TP_NewMap();
 	MT_NewMap();
 	Stats_NewMap();
@@ -769,6 +771,14 @@ void Sound_NextDownload (void)
 			return;		// started a download
 	}
 
+	// let the loader threads work through the list while the loop below waits on them in order
+	for (i = 1; i < MAX_SOUNDS && Prefetch_Active(); i++) 
+	{
+		if (!cl.sound_name[i][0])
+			break;
+		S_PrefetchSound (cl.sound_name[i]);
+	}
+
 	for (i = 1; i < MAX_SOUNDS; i++) 
 	{
 		if (!cl.sound_name[i][0])
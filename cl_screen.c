@@ -822,7 +822,7 @@ void SCR_DrawDemoClock (void) {
 void SCR_DrawQTVBuffer (void)
 {
 	extern double Demo_GetSpeed(void);
-	extern unsigned char pb_buf[];
+	extern unsigned char *CL_Demo_PB_Data(void);
 	extern int	pb_cnt;
 
 	int x, y;
@@ -847,7 +847,7 @@ void SCR_DrawQTVBuffer (void)
 			break;
 	}
 
-	len = ConsistantMVDDataEx(pb_buf, pb_cnt, &ms);
+	len = ConsistantMVDDataEx(CL_Demo_PB_Data(), pb_cnt, &ms);
 
 	snprintf(str, sizeof(str), "%6dms %5db %2.3f", ms, len, Demo_GetSpeed());
 
@@ -3353,7 +3353,7 @@ void SCR_UpdateScreen (void)
 		return;
 	}
 
-	if (scr_skipupdate || block_drawing) {
+	if (scr_skipupdate || block_drawing || cls.headless) {
 		SCR_RenderFrameEnd();
 		return;
 	}
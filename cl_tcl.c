@@ -118,6 +118,7 @@ static int TCL_Alias (ClientData data, Tcl_Interp* interp, int objc, Tcl_Obj *co
 	// if the alias already exists, reuse it
 	for (a = cmd_alias_hash[h] ; a ; a=a->hash_next) {
 		if (!strcasecmp(s, a->name)) {
+			Cmd_FlushAliasCache (a);
 			Q_free (a->value);
 			a->flags = 0;
 			break;
@@ -131,6 +132,7 @@ static int TCL_Alias (ClientData data, Tcl_Interp* interp, int objc, Tcl_Obj *co
 		cmd_alias = a;
 		a->hash_next = cmd_alias_hash[h];
 		cmd_alias_hash[h] = a;
+		Cmd_NamesChanged ();
 	}
 
 	strlcpy (a->name, s, MAX_ALIAS_NAME);
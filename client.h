@@ -173,7 +173,22 @@ typedef struct demo_keyframe_s
 	unsigned long			filepos;	// The position in the demo file where the keyframe can be found.
 	double					timestamp;	// The time stamp in question.
 	struct demo_keyframe_s	*prev;
-	// TODO : Add any state information needed to reproduce this frame.
+
+	// Only valid for the level it was taken on, the snapshot points at its models.
+	int						servercount;
+	struct model_s			*worldmodel;
+
+	float					olddemotime;
+	float					nextdemotime;
+	int						incoming_sequence;
+	int						incoming_acknowledged;
+	int						outgoing_sequence;
+	int						lastto;
+	int						lasttype;
+
+	int						rawsize;	// Size of the client state snapshot, it depends on how many players there are.
+	int						size;		// Size of the snapshot in data (compressed if we have zlib).
+	byte					*data;
 } demo_keyframe_t;
 
 typedef struct 
@@ -272,6 +287,16 @@ typedef enum
 	dl_single
 } dltype_t;		// download type
 
+/// Stages timed by timedemo_norender.
+typedef enum
+{
+	TD_STAGE_READ,		///< CL_GetDemoMessage
+	TD_STAGE_PARSE,		///< CL_ParseServerMessage
+	TD_STAGE_PREDICT,	///< CL_SetUpPlayerPrediction and CL_PredictMove
+	TD_STAGE_LINK,		///< CL_EmitEntities (CL_LinkPacketEntities, CL_LinkPlayers...)
+	TD_NUM_STAGES
+} timedemo_stage_t;
+
 typedef enum demoseekingtype_e
 {
 	DST_SEEKING_NONE = 0, ///< seeking nothing
@@ -406,6 +431,12 @@ typedef struct
 	float		td_lastframe;       ///< To meter out one message a frame.
 	int			td_startframe;      ///< cls.framecount at start
 	float		td_starttime;       ///< Realtime at second frame of timedemo.
+	qbool		td_norender;		///< Don't draw anything, only measure reading and parsing the demo.
+	qbool		headless;			///< Started with -benchmark, there's no window or GL context and nothing is uploaded.
+	double		td_parsetime;		///< Time spent in CL_ReadPackets since td_starttime.
+	double		td_startbytes;		///< Demo bytes parsed at td_starttime.
+	double		td_stagetime[TD_NUM_STAGES];	///< Time spent in each stage since td_starttime.
+	int			td_messages;		///< Server messages parsed since td_starttime.
 
 	qbool		mvdrecording;		///< this is not real mvd recording, but just cut particular moment of mvd stream
 
@@ -708,6 +739,7 @@ void CL_Demo_Jump(double seconds, int relative, demoseekingtype_t seeking);
 void CL_Demo_Init(void);
 void CL_Demo_Jump_Status_Check (void);
 void CL_Demo_Check_For_Rewind(float nextdemotime);
+void CL_Demo_Keyframes_Clear(void);
 void CL_Demo_Stop_Rewinding(void);
 double Demo_GetSpeed(void);
 qbool CL_IsDemoExtension(const char *filename);
@@ -920,6 +952,9 @@ char *MT_ShortStatus(void);
 void Stats_Init(void);
 void Stats_Reset(void);
 void Stats_NewMap(void);
+int Stats_StateSize(void);
+int Stats_SaveState(byte *buf);
+int Stats_RestoreState(byte *buf);
 void Stats_EnterSlot(int num);
 void Stats_ParsePrint(char *s, int level, cfrags_format *cff);
 
@@ -39,7 +39,15 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 qbool CL_CheckServerCommand (void);
 
 static void Cmd_ExecuteStringEx (cbuf_t *context, char *text);
+static void Cmd_ExecuteAliasMark (cbuf_t *cbuf, int *cursize);
+static void Cmd_FreeAliasCode (void);
+static void Cmd_RetireAliasCode (cmd_alias_t *a);
 static int gtf = 0; // global trigger flag
+static int cbuf_depth; // nested Cbuf_ExecuteEx calls
+
+// a compiled alias in the command buffer: the mark, alias code slot and line in hex, \n
+#define CBUF_ALIAS_MARK		'\x01'
+#define CBUF_ALIAS_MARKLEN	10
 
 cvar_t cl_warncmd = {"cl_warncmd", "1"};
 
@@ -114,6 +122,9 @@ void Cbuf_Execute (void)
 	Cbuf_ExecuteEx (&cbuf_main);
 	Cbuf_ExecuteEx (&cbuf_safe);
 	Cbuf_ExecuteEx (&cbuf_formatted_comms);
+
+	if (!cbuf_depth)
+		Cmd_FreeAliasCode ();
 }
 
 //fuh : ideally we should have 'cbuf_t *Cbuf_Register(int maxsize, int flags, qbool (*blockcmd)(void))
@@ -198,78 +209,108 @@ void Cbuf_InsertTextEx (cbuf_t *cbuf, const char *text)
 
 #define MAX_RUNAWAYLOOP 1000
 
-void Cbuf_ExecuteEx (cbuf_t *cbuf)
+// Finds the \n or ; which ends the command at the start of text.
+// Escaped line ends are turned into \r which Cbuf_CopyLine drops.
+static int Cbuf_LineLength (char *text, int cursize)
 {
-	int i, j, cursize, nextsize;
-	char *text, line[1024], *src, *dest;
-	qbool comment;
-	int quotes;
-
-	if (cbuf == &cbuf_safe)
-		gtf++;
-
-	nextsize = cbuf->text_end - cbuf->text_start;
+	int i;
+	qbool comment = false;
+	int quotes = 0;
 
-	while (cbuf->text_end > cbuf->text_start)
+	for (i = 0; i < cursize; i++)
 	{
-		// find a \n or ; line break
-		text = (char *) cbuf->text_buf + cbuf->text_start;
-
-		cursize = cbuf->text_end - cbuf->text_start;
-		comment = false;
-		quotes = 0;
-
-		for (i = 0; i < cursize; i++)
+		if (cl_curlybraces.integer)
 		{
-			if (cl_curlybraces.integer)
+			if (text[i] == '\\')
 			{
-				if (text[i] == '\\')
-				{
-					if (i + 1 < cursize && text[i+1] == '\n')
-					{ // escaped endline
-						text[i] = text[i+1] = '\r'; // '\r' removed later during copying
-						i++;
-						continue;
-					}
-					else if (i + 2 < cursize && text[i+1] == '\r' && text[i+2] == '\n')
-					{ // escaped dos endline
-						text[i] = text[i+2] = '\r';
-						i+=2;
-						continue;
-					}
+				if (i + 1 < cursize && text[i+1] == '\n')
+				{ // escaped endline
+					text[i] = text[i+1] = '\r'; // '\r' removed later during copying
+					i++;
+					continue;
+				}
+				else if (i + 2 < cursize && text[i+1] == '\r' && text[i+2] == '\n')
+				{ // escaped dos endline
+					text[i] = text[i+2] = '\r';
+					i+=2;
+					continue;
 				}
 			}
+		}
 
-			if (text[i] == '\n')
-				break;
+		if (text[i] == '\n')
+			break;
 
-			if (text[i] == '"' && quotes <= 0)
-			{
-				if (!quotes)
-					quotes = -1;
-				else
-					quotes = 0;
-			}
-			else if (quotes >= 0)
+		if (text[i] == '"' && quotes <= 0)
+		{
+			if (!quotes)
+				quotes = -1;
+			else
+				quotes = 0;
+		}
+		else if (quotes >= 0)
+		{
+			if (cl_curlybraces.integer)
 			{
-				if (cl_curlybraces.integer)
-				{
-					if (text[i] == '{')
-						quotes++;
-					else if (text[i] == '}')
-						quotes--;
-				}
+				if (text[i] == '{')
+					quotes++;
+				else if (text[i] == '}')
+					quotes--;
 			}
+		}
 
-			if (comment || quotes)
-				continue;
+		if (comment || quotes)
+			continue;
 
-			if (text[i] == '/' && i + 1 < cursize && text[i + 1] == '/')
-				comment = true;
-			else if (text[i] == ';' && !quotes)
-				break;
+		if (text[i] == '/' && i + 1 < cursize && text[i + 1] == '/')
+			comment = true;
+		else if (text[i] == ';' && !quotes)
+			break;
+	}
+
+	return i;
+}
+
+// Copy the command to line, skipping carriage return chars
+static void Cbuf_CopyLine (char *line, int size, const char *text, int len)
+{
+	int j;
+
+	j = min (len, size - 1);
+	for ( ; j; j--, text++)
+	{
+		if (*text != '\r')
+			*line++ = *text;
+	}
+	*line = 0;
+}
+
+void Cbuf_ExecuteEx (cbuf_t *cbuf)
+{
+	int i, cursize, nextsize;
+	char *text, line[1024];
+
+	if (cbuf == &cbuf_safe)
+		gtf++;
+	cbuf_depth++;
+
+	nextsize = cbuf->text_end - cbuf->text_start;
+
+	while (cbuf->text_end > cbuf->text_start)
+	{
+		text = (char *) cbuf->text_buf + cbuf->text_start;
+
+		// a compiled alias, see Cmd_InsertAliasCode
+		if (*text == CBUF_ALIAS_MARK && cbuf != &cbuf_svc)
+		{
+			Cmd_ExecuteAliasMark (cbuf, &cursize);
+			goto executed;
 		}
 
+		// find a \n or ; line break
+		cursize = cbuf->text_end - cbuf->text_start;
+		i = Cbuf_LineLength (text, cursize);
+
 		if ((cursize - i) < nextsize) // have we reached the next command?
 			nextsize = cursize - i;
 
@@ -279,16 +320,7 @@ void Cbuf_ExecuteEx (cbuf_t *cbuf)
 		if (cbuf_current == &cbuf_svc && i == cursize)
 			break;
 
-		// Copy text to line, skipping carriage return chars
-		src = text;
-		dest = line;
-		j = min (i, sizeof (line) - 1);
-		for ( ; j; j--, src++)
-		{
-			if (*src != '\r')
-				*dest++ = *src;
-		}
-		*dest = 0;
+		Cbuf_CopyLine (line, sizeof (line), text, i);
 
 		// delete the text from the command buffer and move remaining commands down  This is necessary
 		// because commands (exec, alias) can insert data at the beginning of the text buffer
@@ -314,6 +346,7 @@ void Cbuf_ExecuteEx (cbuf_t *cbuf)
 
 		Cmd_ExecuteStringEx (cbuf, line);	// execute the command line
 
+executed:
 		if (cbuf->text_end - cbuf->text_start > cursize)
 			cbuf->runAwayLoop++;
 
@@ -333,12 +366,14 @@ void Cbuf_ExecuteEx (cbuf_t *cbuf)
 
 			if (cbuf == &cbuf_safe)
 				gtf--;
+			cbuf_depth--;
 			return;
 		}
 	}
 
 	if (cbuf == &cbuf_safe)
 		gtf--;
+	cbuf_depth--;
 
 	cbuf->runAwayLoop = 0;
 
@@ -547,6 +582,101 @@ cmd_alias_t *Cmd_FindAlias (const char *name)
 	return NULL;
 }
 
+// QW262 %parameters: the value is cut once into text and parameter references,
+// so executing the alias is just concatenation
+#define ALIASPART_TEXT	-1
+#define ALIASPART_ARGS	0		// %0, all the parameters
+								// 1-9: %1 to %9
+
+typedef struct aliaspart_s {
+	int		param;		// ALIASPART_TEXT, ALIASPART_ARGS or parameter number
+	int		start, len;	// of the text in value
+} aliaspart_t;
+
+void Cmd_FlushAliasCache (cmd_alias_t *a)
+{
+	Q_free(a->parts);
+	a->parts = NULL;
+	Cmd_RetireAliasCode(a);
+}
+
+static void Cmd_AddAliasPart (aliaspart_t *parts, int *count, int param, int start, int len)
+{
+	if (param == ALIASPART_TEXT && len <= 0)
+		return;
+
+	parts[*count].param = param;
+	parts[*count].start = start;
+	parts[*count].len = len;
+	(*count)++;
+}
+
+// the parts end with a zero length text part
+static aliaspart_t *Cmd_AliasParts (cmd_alias_t *a)
+{
+	aliaspart_t *parts;
+	char *s, *n;
+	int count = 0;
+
+	if (a->parts)
+		return a->parts;
+
+	// at most a text and a parameter for each '%'
+	for (s = a->value; (s = strchr(s, '%')); s++)
+		count += 2;
+	parts = (aliaspart_t *) Q_malloc((count + 2) * sizeof(aliaspart_t));
+	count = 0;
+
+	for (s = a->value; (n = strchr(s, '%')); ) {
+		n++;
+		if (*n >= '0' && *n <= '9') {
+			Cmd_AddAliasPart(parts, &count, ALIASPART_TEXT, s - a->value, n - 1 - s);
+			Cmd_AddAliasPart(parts, &count, *n - '0', 0, 0);
+		} else if (*n == '%') {
+			// %% is a single %
+			Cmd_AddAliasPart(parts, &count, ALIASPART_TEXT, s - a->value, n - s);
+		} else if (*n) {
+			Cmd_AddAliasPart(parts, &count, ALIASPART_TEXT, s - a->value, n + 1 - s);
+		} else {
+			Cmd_AddAliasPart(parts, &count, ALIASPART_TEXT, s - a->value, n - s);
+			s = n;
+			break;
+		}
+		s = n + 1;
+	}
+	Cmd_AddAliasPart(parts, &count, ALIASPART_TEXT, s - a->value, strlen(s));
+
+	parts[count].param = ALIASPART_TEXT;
+	parts[count].len = 0;
+
+	a->parts = parts;
+	return parts;
+}
+
+// puts the value with %parameters replaced by the arguments of the current command to buf
+static void Cmd_ExpandAliasParameters (cmd_alias_t *a, char *buf, int bufsize)
+{
+	aliaspart_t *part;
+	const char *src;
+	int len = 0, n;
+
+	for (part = Cmd_AliasParts(a); part->param != ALIASPART_TEXT || part->len; part++) {
+		if (part->param == ALIASPART_TEXT) {
+			src = a->value + part->start;
+			n = part->len;
+		} else {
+			src = part->param == ALIASPART_ARGS ? Cmd_Args() : Cmd_Argv(part->param);
+			n = strlen(src);
+		}
+
+		n = min(n, bufsize - 1 - len);
+		memcpy(buf + len, src, n);
+		len += n;
+	}
+
+	buf[len] = 0;
+}
+
 char *Cmd_AliasString (char *name)
 {
 	int key;
@@ -715,6 +845,7 @@ static cmd_alias_t* Cmd_AliasCreate (char* name)
 	cmd_alias_hash[key] = a;
 
 	strlcpy (a->name, name, sizeof (a->name));
+	Cmd_NamesChanged();
 	return a;
 }
 
@@ -743,6 +874,7 @@ void Cmd_Alias_f (void)
 	// if the alias already exists, reuse it
 	for (a = cmd_alias_hash[key]; a; a = a->hash_next) {
 		if (!strcasecmp(a->name, s)) {
+			Cmd_FlushAliasCache(a);
 			Q_free(a->value);
 			break;
 		}
@@ -754,6 +886,7 @@ void Cmd_Alias_f (void)
 		cmd_alias = a;
 		a->hash_next = cmd_alias_hash[key];
 		cmd_alias_hash[key] = a;
+		Cmd_NamesChanged();
 	}
 
 	strlcpy (a->name, s, sizeof (a->name));
@@ -802,6 +935,8 @@ qbool Cmd_DeleteAlias (char *name)
 	if (!a)
 		return false;	// not found
 
+	Cmd_NamesChanged();
+
 	prev = NULL;
 	for (a = cmd_alias; a; a = a->next) {
 		if (!strcasecmp(a->name, name)) {
@@ -812,6 +947,7 @@ qbool Cmd_DeleteAlias (char *name)
 				cmd_alias = a->next;
 
 			// free
+			Cmd_FlushAliasCache(a);
 			Q_free(a->value);
 			Q_free(a);
 			return true;
@@ -897,6 +1033,7 @@ void Cmd_UnAliasAll_f (void)
 	} else {
 		for (a = cmd_alias; a ; a = next) {
 			next = a->next;
+			Cmd_FlushAliasCache(a);
 			Q_free(a->value);
 			Q_free(a);
 		}
@@ -904,6 +1041,7 @@ void Cmd_UnAliasAll_f (void)
 
 		// clear hash
 		memset (cmd_alias_hash, 0, sizeof(cmd_alias_t*) * ALIAS_HASHPOOL_SIZE);
+		Cmd_NamesChanged();
 	}
 }
 
@@ -1042,7 +1180,9 @@ void Cmd_TokenizeStringEx (tokenizecontext_t *ctx, char *text)
 {
 	int idx = 0, token_len;
 
-	memset(ctx, 0, sizeof(*ctx));
+	// the buffers are only read up to cmd_argc, no need to clear all of them
+	ctx->cmd_argc = 0;
+	ctx->cmd_args[0] = 0;
 
 	while (1)
 	{
@@ -1158,6 +1298,7 @@ void Cmd_AddCommand (char *cmd_name, xcommand_t function)
 	cmd_functions = cmd;
 	cmd->hash_next = cmd_hash_array[key];
 	cmd_hash_array[key] = cmd;
+	Cmd_NamesChanged();
 }
 
 qbool Cmd_AddRemCommand (char *cmd_name, xcommand_t function)
@@ -1184,6 +1325,7 @@ qbool Cmd_AddRemCommand (char *cmd_name, xcommand_t function)
 	cmd_functions = cmd;
 	cmd->hash_next = cmd_hash_array[key];
 	cmd_hash_array[key] = cmd;
+	Cmd_NamesChanged();
 
 	return true;
 }
@@ -1245,6 +1387,7 @@ void Cmd_RemoveCommand (char *cmd_name)
 	cmd = Cmd_RemoveCommand_Hash(cmd_name);
 
 	if (cmd) {
+		Cmd_NamesChanged();
 		if (cmd->zmalloced)
 		{
 			Q_free(cmd);
@@ -1407,6 +1550,108 @@ void Cmd_CmdList_re_f (void)
 static macro_command_t macro_commands[MAX_MACROS];
 static int macro_count = 0;
 
+// $names are resolved by walking a tree of cvar and macro names one character
+// at a time, which finds the longest cvar and the first registered macro that
+// prefix the text in a single pass
+typedef struct expandnode_s {
+	struct expandnode_s	*child;		// first node of the next character
+	struct expandnode_s	*sibling;	// other nodes of this character
+	char				c;			// lower case
+	cvar_t				*var;		// cvar ending here
+	macro_command_t		*macro;		// macro ending here
+} expandnode_t;
+
+static expandnode_t *expand_root;
+
+// nodes are kept when names go away, the same cvars tend to come back
+static expandnode_t *Cmd_ExpandNode (const char *name)
+{
+	expandnode_t **link = &expand_root, *node = NULL;
+	char c;
+
+	for ( ; *name; name++) {
+		c = tolower((unsigned char) *name);
+
+		for (node = *link; node && node->c != c; node = node->sibling)
+			;
+
+		if (!node) {
+			node = (expandnode_t *) Q_malloc(sizeof(expandnode_t));
+			node->c = c;
+			node->sibling = *link;
+			*link = node;
+		}
+
+		link = &node->child;
+	}
+
+	return node;
+}
+
+void Cmd_AddExpandCvar (cvar_t *var)
+{
+	expandnode_t *node = Cmd_ExpandNode(var->name);
+
+	Cmd_NamesChanged();
+
+	if (node)
+		node->var = var;
+}
+
+void Cmd_RemoveExpandCvar (cvar_t *var)
+{
+	expandnode_t *node = Cmd_ExpandNode(var->name);
+
+	Cmd_NamesChanged();
+
+	if (node && node->var == var)
+		node->var = NULL;
+}
+
+// Matches text up to the first blank or '$'. Returns how much of it was looked at.
+static int Cmd_ExpandLookup (const char *s, int maxlen, cvar_t **bestvar, macro_command_t **bestmacro, int *var_length, int *macro_length)
+{
+	expandnode_t *node = expand_root;
+	int i;
+
+	*bestvar = NULL;
+	*bestmacro = NULL;
+	*var_length = *macro_length = 0;
+
+	for (i = 0; i < maxlen && (unsigned char) s[i] > 32 && s[i] != '$'; i++) {
+		if (node) {
+			char c = tolower((unsigned char) s[i]);
+
+			for ( ; node && node->c != c; node = node->sibling)
+				;
+
+			if (node) {
+				if (node->var) {
+					*bestvar = node->var;
+					*var_length = i + 1;
+				}
+
+				if (node->macro && (!*bestmacro || node->macro < *bestmacro)) {
+					*bestmacro = node->macro;
+					*macro_length = i + 1;
+				}
+
+				node = node->child;
+			}
+		}
+	}
+
+	return i;
+}
+
+static char *Cmd_RunMacro (macro_command_t *macro)
+{
+	if (cbuf_current == &cbuf_main && (macro->teamplay == MACRO_DISALLOWED))
+		cbuf_current = &cbuf_formatted_comms;
+
+	return macro->func();
+}
+
 void Cmd_ReInitAllMacro (void)
 {
 	int i;
@@ -1421,6 +1666,8 @@ void Cmd_ReInitAllMacro (void)
 
 void Cmd_AddMacroEx (const char *s, char *(*f) (void), int teamplay)
 {
+	expandnode_t *node;
+
 	if (macro_count == MAX_MACROS)
 		Sys_Error ("Cmd_AddMacro: macro_count == MAX_MACROS");
 
@@ -1428,6 +1675,11 @@ void Cmd_AddMacroEx (const char *s, char *(*f) (void), int teamplay)
 	macro_commands[macro_count].func = f;
 	macro_commands[macro_count].teamplay = teamplay;
 
+	// the first macro registered under a name wins
+	node = Cmd_ExpandNode(macro_commands[macro_count].name);
+	if (node && !node->macro)
+		node->macro = &macro_commands[macro_count];
+
 #ifdef WITH_TCL
 // disconnect: it seems macro are safe with TCL NOW
 //	if (!teamplay)	// don't allow teamplay protected macros since there's no protection for this in TCL yet
@@ -1444,23 +1696,13 @@ void Cmd_AddMacro (const char *s, char *(*f) (void))
 
 char *Cmd_MacroString (const char *s, int *macro_length)
 {
-	int i;
 	macro_command_t	*macro;
+	cvar_t *var;
+	int var_length;
 
-	for (i = 0; i < macro_count; i++) {
-		macro = &macro_commands[i];
-		if (!strncasecmp (s, macro->name, strlen (macro->name))) {
-			if (cbuf_current == &cbuf_main && (macro->teamplay == MACRO_DISALLOWED))
-				cbuf_current = &cbuf_formatted_comms;
-			*macro_length = strlen (macro->name);
-			return macro->func();
-		}
-		macro++;
-	}
-
-	*macro_length = 0;
+	Cmd_ExpandLookup(s, strlen(s), &var, &macro, &var_length, macro_length);
 
-	return NULL;
+	return macro ? Cmd_RunMacro(macro) : NULL;
 }
 
 static int Cmd_MacroCompare (const void *p1, const void *p2)
@@ -1510,8 +1752,15 @@ void Cmd_ExpandString (const char *data, char *dest)
 	unsigned int c;
 	char buf[255], *str;
 	int i, len = 0, quotes = 0, name_length = 0;
-	cvar_t *var, *bestvar;
-	int macro_length;
+	cvar_t *bestvar;
+	macro_command_t *macro;
+	int var_length, macro_length;
+
+	// most lines have nothing to expand
+	if (!strchr(data, '$')) {
+		strlcpy(dest, data, 1024);
+		return;
+	}
 
 	while ((c = *data)) {
 		if (c == '"')
@@ -1521,30 +1770,17 @@ void Cmd_ExpandString (const char *data, char *dest)
 			data++;
 
 			// Copy the text after '$' to a temp buffer
-			i = 0;
-			buf[0] = 0;
-			bestvar = NULL;
-			while ((c = *data) > 32) {
-				if (c == '$')
-					break;
+			i = Cmd_ExpandLookup(data, sizeof(buf) - 1, &bestvar, &macro, &var_length, &macro_length);
+			memcpy(buf, data, i);
+			buf[i] = 0;
+			data += i;
 
-				data++;
-				buf[i++] = c;
-				buf[i] = 0;
-
-				if ((var = Cvar_Find(buf)))
-					bestvar = var;
-
-				if (i >= (int) sizeof (buf) - 1)
-					break; // there no more space in buf
-			}
-
-			str = Cmd_MacroString (buf, &macro_length);
+			str = macro ? Cmd_RunMacro(macro) : NULL;
 			name_length = macro_length;
 
-			if (bestvar && (!str || (strlen (bestvar->name) > macro_length))) {
+			if (bestvar && (!str || var_length > macro_length)) {
 				str = bestvar->string;
-				name_length = strlen(bestvar->name);
+				name_length = var_length;
                 if (bestvar->teamplay)
                     cbuf_current = &cbuf_formatted_comms;
 			}
@@ -1664,15 +1900,356 @@ static qbool Cmd_IsCommandAllowedInTeamPlayMacros( const char *command )
 	return *s != NULL;
 }
 
+/*
+=============================================================================
+						COMPILED ALIASES
+=============================================================================
+An alias is split into command lines the first time it runs, and the lines
+without $names are tokenized and looked up once. Running the alias puts a
+short mark into the command buffer rather than its text, see CBUF_ALIAS_MARK.
+The mark steps through the lines as they are executed, so wait, exec and
+nested aliases behave just like with the text.
+*/
+
+static int cmd_names_version = 1;
+
+void Cmd_NamesChanged (void)
+{
+	cmd_names_version++;
+}
+
+// what the first word of a command line is
+typedef struct {
+	int				version;	// cmd_names_version it was looked up at
+	cmd_function_t	*cmd;
+	cvar_t			*var;
+	cmd_alias_t		*alias;
+} cmdtarget_t;
+
+typedef struct {
+	char		*text;		// as Cbuf_ExecuteEx would cut it from the buffer
+	qbool		expand;		// has $names, expanded and tokenized when executed
+
+	// the tokens if not expand
+	int			argc;
+	int			*argofs;	// of the tokens in argv_buf
+	char		*argv_buf;
+	int			argv_len;
+	char		*args;
+	cmdtarget_t	target;
+} aliasline_t;
+
+typedef struct aliascode_s {
+	cmd_alias_t	*alias;			// NULL once the alias changed, freed when no mark is left
+	int			slot;
+	int			curlybraces;	// cl_curlybraces it was split with
+	int			numlines;
+	aliasline_t	*lines;
+	qbool		marked;
+} aliascode_t;
+
+#define MAX_ALIAS_CODE 0x10000	// CBUF_ALIAS_MARK has four hex digits for the slot
+
+static aliascode_t **alias_code;
+static int alias_code_slots;
+static int alias_code_retired;
+
+static void Cmd_LookupTarget (cmdtarget_t *target, const char *name)
+{
+	target->version = cmd_names_version;
+	target->cmd = Cmd_FindCommand(name);
+	target->var = Cvar_Find(name);
+	target->alias = Cmd_FindAlias(name);
+}
+
+static void Cmd_FreeAliasLines (aliascode_t *code)
+{
+	int i;
+
+	for (i = 0; i < code->numlines; i++) {
+		Q_free(code->lines[i].text);
+		Q_free(code->lines[i].argofs);
+		Q_free(code->lines[i].argv_buf);
+		Q_free(code->lines[i].args);
+	}
+
+	alias_code[code->slot] = NULL;
+	Q_free(code->lines);
+	Q_free(code);
+}
+
+// the code can still be referenced from a command buffer, see Cmd_FreeAliasCode
+static void Cmd_RetireAliasCode (cmd_alias_t *a)
+{
+	if (!a->code)
+		return;
+
+	a->code->alias = NULL;
+	a->code = NULL;
+	alias_code_retired++;
+}
+
+static aliascode_t *Cmd_AliasCode (cmd_alias_t *a)
+{
+	static tokenizecontext_t ctx;
+	aliascode_t *code;
+	aliasline_t *line;
+	char *text, *body, buf[1024];
+	int slot, i, cursize, maxlines;
+
+	if (a->code && a->code->curlybraces == cl_curlybraces.integer)
+		return a->code;
+
+	Cmd_RetireAliasCode(a);
+
+	for (slot = 0; slot < alias_code_slots && alias_code[slot]; slot++)
+		;
+	if (slot == alias_code_slots) {
+		if (alias_code_slots == MAX_ALIAS_CODE)
+			return NULL;
+		alias_code_slots = min(MAX_ALIAS_CODE, max(64, alias_code_slots * 2));
+		alias_code = (aliascode_t **) Q_realloc(alias_code, alias_code_slots * sizeof(aliascode_t *));
+		memset(alias_code + slot, 0, (alias_code_slots - slot) * sizeof(aliascode_t *));
+	}
+
+	// the alias runs as if its value and a \n were put in the buffer
+	cursize = strlen(a->value) + 1;
+	body = text = (char *) Q_malloc(cursize + 1);
+	memcpy(body, a->value, cursize - 1);
+	body[cursize - 1] = '\n';
+
+	maxlines = 1;
+	for (i = 0; i < cursize; i++)
+		if (body[i] == '\n' || body[i] == ';')
+			maxlines++;
+
+	code = (aliascode_t *) Q_malloc(sizeof(aliascode_t));
+	code->lines = (aliasline_t *) Q_malloc(maxlines * sizeof(aliasline_t));
+	code->curlybraces = cl_curlybraces.integer;
+
+	while (cursize > 0 && code->numlines < maxlines) {
+		i = Cbuf_LineLength(text, cursize);
+		Cbuf_CopyLine(buf, sizeof(buf), text, i);
+		text += i + 1;
+		cursize -= i + 1;
+
+		if (!buf[0])
+			continue;
+
+		line = &code->lines[code->numlines++];
+		line->text = Q_strdup(buf);
+		line->expand = strchr(buf, '$') != NULL;
+		if (line->expand)
+			continue;
+
+		Cmd_TokenizeStringEx(&ctx, buf);
+		line->argc = ctx.cmd_argc;
+		line->argofs = (int *) Q_malloc(max(1, ctx.cmd_argc) * sizeof(int));
+		for (i = 0; i < ctx.cmd_argc; i++)
+			line->argofs[i] = ctx.cmd_argv[i] - ctx.argv_buf;
+		line->argv_len = ctx.cmd_argc ? line->argofs[ctx.cmd_argc - 1] + strlen(ctx.cmd_argv[ctx.cmd_argc - 1]) + 1 : 0;
+		line->argv_buf = (char *) Q_malloc(max(1, line->argv_len));
+		memcpy(line->argv_buf, ctx.argv_buf, line->argv_len);
+		line->args = Q_strdup(ctx.cmd_args);
+	}
+
+	Q_free(body);
+
+	code->alias = a;
+	code->slot = slot;
+	alias_code[slot] = code;
+	a->code = code;
+
+	return code;
+}
+
+// Puts the mark for the first line of the alias into the buffer, false if it has to go as text.
+static qbool Cmd_InsertAliasCode (cbuf_t *cbuf, cmd_alias_t *a)
+{
+	char mark[CBUF_ALIAS_MARKLEN + 1];
+	aliascode_t *code;
+
+	// the buffers which live for the whole session, Cmd_FreeAliasCode looks in these
+	if (cbuf != &cbuf_main && cbuf != &cbuf_safe && cbuf != &cbuf_formatted_comms)
+		return false;
+
+	if (!(code = Cmd_AliasCode(a)))
+		return false;
+
+	if (!code->numlines)
+		return true;
+
+	snprintf(mark, sizeof(mark), "%c%04x%04x\n", CBUF_ALIAS_MARK, code->slot, 0);
+	Cbuf_InsertTextEx(cbuf, mark);
+	return true;
+}
+
+// Takes the line pointed to by the mark at the start of the buffer, the mark moves on to the next line.
+static aliasline_t *Cmd_TakeAliasLine (cbuf_t *cbuf)
+{
+	char *text = cbuf->text_buf + cbuf->text_start, *end, num[5];
+	int cursize = cbuf->text_end - cbuf->text_start;
+	int slot, lineno;
+	aliascode_t *code;
+
+	code = NULL;
+	slot = lineno = 0;
+	if (cursize >= CBUF_ALIAS_MARKLEN && text[CBUF_ALIAS_MARKLEN - 1] == '\n') {
+		memcpy(num, text + 1, 4);
+		num[4] = 0;
+		slot = strtol(num, &end, 16);
+		if (end == num + 4 && slot < alias_code_slots)
+			code = alias_code[slot];
+
+		memcpy(num, text + 5, 4);
+		lineno = strtol(num, &end, 16);
+		if (end != num + 4)
+			code = NULL;
+	}
+
+	if (!code || lineno >= code->numlines) {
+		// not ours, drop it like a line of text
+		end = memchr(text, '\n', cursize);
+		cbuf->text_start += end ? end - text + 1 : cursize;
+		if (cbuf->text_start == cbuf->text_end)
+			cbuf->text_start = cbuf->text_end = (cbuf->maxsize >> 1);
+		return NULL;
+	}
+
+	if (lineno + 1 < code->numlines) {
+		snprintf(num, sizeof(num), "%04x", lineno + 1);
+		memcpy(text + 5, num, 4);
+	} else {
+		cbuf->text_start += CBUF_ALIAS_MARKLEN;
+		if (cbuf->text_start == cbuf->text_end)
+			cbuf->text_start = cbuf->text_end = (cbuf->maxsize >> 1);
+	}
+
+	return &code->lines[lineno];
+}
+
+static void Cmd_ExecuteTokens (cmdtarget_t *target);
+
+// Executes the line the mark at the start of the buffer points to, *cursize is what's left
+// in the buffer after taking the line, as in Cbuf_ExecuteEx.
+static void Cmd_ExecuteAliasMark (cbuf_t *cbuf, int *cursize)
+{
+	tokenizecontext_t *ctx = &cmd_tokenizecontext;
+	char text_exp[1024];
+	cbuf_t *oldcontext;
+	cmdtarget_t target;
+	aliasline_t *line;
+	int i;
+
+	line = Cmd_TakeAliasLine(cbuf);
+	*cursize = cbuf->text_end - cbuf->text_start;
+	if (!line)
+		return;
+
+	if (!host_initialized)
+		Hud262_CatchStringsOnLoad(line->text);
+
+	oldcontext = cbuf_current;
+	cbuf_current = cbuf;
+
+	if (line->expand) {
+		Cmd_ExpandString (line->text, text_exp);
+		Cmd_TokenizeString (text_exp);
+		Cmd_ExecuteTokens (NULL);
+	} else {
+		memcpy(ctx->argv_buf, line->argv_buf, line->argv_len);
+		for (i = 0; i < line->argc; i++)
+			ctx->cmd_argv[i] = ctx->argv_buf + line->argofs[i];
+		ctx->cmd_argc = line->argc;
+		strlcpy(ctx->cmd_args, line->args, sizeof(ctx->cmd_args));
+
+		if (line->argc && line->target.version != cmd_names_version)
+			Cmd_LookupTarget(&line->target, ctx->cmd_argv[0]);
+
+		// the line may go away with the alias while it runs
+		target = line->target;
+		Cmd_ExecuteTokens (&target);
+	}
+
+	cbuf_current = oldcontext;
+}
+
+// Frees the code of changed aliases which no command buffer refers to anymore.
+static void Cmd_FreeAliasCode (void)
+{
+	cbuf_t *cbufs[] = { &cbuf_main, &cbuf_safe, &cbuf_formatted_comms };
+	char *text, *end, num[5];
+	int i, slot;
+
+	if (!alias_code_retired)
+		return;
+
+	for (i = 0; i < sizeof(cbufs) / sizeof(cbufs[0]); i++) {
+		text = cbufs[i]->text_buf + cbufs[i]->text_start;
+		end = cbufs[i]->text_buf + cbufs[i]->text_end;
+
+		while ((text = memchr(text, CBUF_ALIAS_MARK, end - text)) && end - text >= CBUF_ALIAS_MARKLEN) {
+			memcpy(num, text + 1, 4);
+			num[4] = 0;
+			slot = strtol(num, NULL, 16);
+			if (slot < alias_code_slots && alias_code[slot])
+				alias_code[slot]->marked = true;
+			text++;
+		}
+	}
+
+	for (slot = 0; slot < alias_code_slots; slot++) {
+		if (!alias_code[slot])
+			continue;
+
+		if (!alias_code[slot]->alias && !alias_code[slot]->marked) {
+			Cmd_FreeAliasLines(alias_code[slot]);
+			alias_code_retired--;
+		} else {
+			alias_code[slot]->marked = false;
+		}
+	}
+}
+
+static int Cmd_AliasProfileCompare (const void *p1, const void *p2)
+{
+	return (*((cmd_alias_t **) p2))->calls - (*((cmd_alias_t **) p1))->calls;
+}
+
+void Cmd_AliasProfile_f (void)
+{
+	cmd_alias_t *a, **sorted;
+	int i, count = 0;
+
+	if (Cmd_Argc() == 2 && !strcmp(Cmd_Argv(1), "reset")) {
+		for (a = cmd_alias; a; a = a->next)
+			a->calls = 0;
+		return;
+	}
+
+	for (a = cmd_alias; a; a = a->next)
+		if (a->calls)
+			count++;
+
+	sorted = (cmd_alias_t **) Q_malloc(max(1, count) * sizeof(cmd_alias_t *));
+	for (a = cmd_alias, i = 0; a; a = a->next)
+		if (a->calls)
+			sorted[i++] = a;
+	qsort(sorted, count, sizeof(cmd_alias_t *), Cmd_AliasProfileCompare);
+
+	Com_Printf ("calls  lines  alias\n");
+	for (i = 0; i < count; i++)
+		Com_Printf ("%5i  %5s  %s\n", sorted[i]->calls,
+			sorted[i]->code ? va("%i", sorted[i]->code->numlines) : "-", sorted[i]->name);
+	Com_Printf ("------------\n%i aliases executed\n", count);
+
+	Q_free(sorted);
+}
+
 //A complete command line has been parsed, so try to execute it
 static void Cmd_ExecuteStringEx (cbuf_t *context, char *text)
 {
-	cvar_t *v;
-	cmd_function_t *cmd;
-	cmd_alias_t *a;
-	static char buf[1024];
-	cbuf_t *inserttarget, *oldcontext;
-	char *p, *n, *s;
+	cbuf_t *oldcontext;
 	char text_exp[1024];
 
 	oldcontext = cbuf_current;
@@ -1680,26 +2257,41 @@ static void Cmd_ExecuteStringEx (cbuf_t *context, char *text)
 
 	Cmd_ExpandString (text, text_exp);
 	Cmd_TokenizeString (text_exp);
+	Cmd_ExecuteTokens (NULL);
+
+	cbuf_current = oldcontext;
+}
+
+// Executes the tokenized command line, target has the lookups of the first word if they're known.
+static void Cmd_ExecuteTokens (cmdtarget_t *target)
+{
+	cvar_t *v;
+	cmd_function_t *cmd;
+	cmd_alias_t *a;
+	static char buf[1024];
+	cbuf_t *inserttarget;
+	char *p;
+	qbool addargs;
 
 	if (!Cmd_Argc())
-		goto done; // no tokens
+		return; // no tokens
 
 	if (cbuf_current == &cbuf_svc) {
 		if (CL_CheckServerCommand())
-			goto done;
+			return;
 	}
 
 	// check functions
-	if ((cmd = Cmd_FindCommand(Cmd_Argv(0)))) {
+	if ((cmd = target ? target->cmd : Cmd_FindCommand(Cmd_Argv(0)))) {
 		if (gtf || cbuf_current == &cbuf_safe) {
 			if (!Cmd_IsCommandAllowedInMessageTrigger(Cmd_Argv(0))) {
 				Com_Printf ("\"%s\" cannot be used in message triggers\n", Cmd_Argv(0));
-				goto done;
+				return;
 			}
 		} else if ((cbuf_current == &cbuf_formatted_comms)) {
 			if (!Cmd_IsCommandAllowedInTeamPlayMacros(Cmd_Argv(0))) {
 				Com_Printf ("\"%s\" cannot be used in combination with teamplay $macros\n", Cmd_Argv(0));
-				goto done;
+				return;
 			}
 		}
 
@@ -1707,73 +2299,41 @@ static void Cmd_ExecuteStringEx (cbuf_t *context, char *text)
 			cmd->function();
 		else
 			Cmd_ForwardToServer ();
-		goto done;
+		return;
 	}
 
 	// some bright guy decided to use "skill" as a mod command in Custom TF, sigh
-	if (!strcmp(Cmd_Argv(0), "skill") && Cmd_Argc() == 1 && Cmd_FindAlias("skill"))
+	if (!strcmp(Cmd_Argv(0), "skill") && Cmd_Argc() == 1 && (target ? target->alias : Cmd_FindAlias("skill")))
 		goto checkaliases;
 
 	// check cvars
-	if ((v = Cvar_Find(Cmd_Argv(0)))) {
+	if ((v = target ? target->var : Cvar_Find(Cmd_Argv(0)))) {
 		if ((cbuf_current == &cbuf_formatted_comms)) {
 			Com_Printf ("\"%s\" cannot be used in combination with teamplay $macros\n", Cmd_Argv(0));
-			goto done;
+			return;
 		}
 		if (Cvar_Command())
-			goto done;
+			return;
 	}
 
 	// check aliases
 checkaliases:
-	if ((a = Cmd_FindAlias(Cmd_Argv(0)))) {
+	if ((a = target ? target->alias : Cmd_FindAlias(Cmd_Argv(0)))) {
+		a->calls++;
 
 		// QW262 -->
 #ifdef WITH_TCL
 		if (a->flags & ALIAS_TCL)
 		{
 			TCL_ExecuteAlias (a);
-			goto done;
+			return;
 		}
 #endif
 
-		if (a->value[0]=='\0') goto done; // alias is empty.
+		if (a->value[0]=='\0') return; // alias is empty.
 
 		if(a->flags & ALIAS_HAS_PARAMETERS) { // %parameters are given in alias definition
-			s=a->value;
-			buf[0] = '\0';
-			do {
-				n = strchr(s, '%');
-				if(n) {
-					if(*++n >= '1' && *n <= '9') {
-						n[-1] = 0;
-						strlcat(buf, s, sizeof(buf));
-						n[-1] = '%';
-						// insert numbered parameter
-						strlcat(buf,Cmd_Argv(*n-'0'), sizeof(buf));
-					} else if (*n == '0') {
-						n[-1] = 0;
-						strlcat(buf, s, sizeof(buf));
-						n[-1] = '%';
-						// insert all parameters
-						strlcat(buf, Cmd_Args(), sizeof(buf));
-					} else if (*n == '%') {
-						n[0] = 0;
-						strlcat(buf, s, sizeof(buf));
-						n[0] = '%';
-					} else {
-						if (*n) {
-							char tmp = n[1];
-							n[1] = 0;
-							strlcat(buf, s, sizeof(buf));
-							n[1] = tmp;
-						} else
-							strlcat(buf, s, sizeof(buf));
-					}
-					s=n+1;
-				}
-			} while(n);
-			strlcat(buf, s, sizeof(buf));
+			Cmd_ExpandAliasParameters(a, buf, sizeof(buf));
 			p = buf;
 
 		} else  // alias has no parameters
@@ -1787,27 +2347,31 @@ checkaliases:
 		} else
 		{
 			inserttarget = cbuf_current ? cbuf_current : &cbuf_main;
-			Cbuf_InsertTextEx (inserttarget, "\n");
 
 			// if the alias value is a command or cvar and
 			// the alias is called with parameters, add them
-			if (Cmd_Argc() > 1 && !strchr(p, ' ') && !strchr(p, '\t') &&
-			        (Cvar_Find(p) || (Cmd_FindCommand(p) && p[0] != '+' && p[0] != '-'))
-			   ) {
+			addargs = Cmd_Argc() > 1 && !strchr(p, ' ') && !strchr(p, '\t') &&
+			        (Cvar_Find(p) || (Cmd_FindCommand(p) && p[0] != '+' && p[0] != '-'));
+
+			if (p == a->value && !addargs && Cmd_InsertAliasCode(inserttarget, a))
+				return;
+
+			Cbuf_InsertTextEx (inserttarget, "\n");
+			if (addargs) {
 				Cbuf_InsertTextEx (inserttarget, Cmd_Args());
 				Cbuf_InsertTextEx (inserttarget, " ");
 			}
 			Cbuf_InsertTextEx (inserttarget, p);
 		}
-		goto done;
+		return;
 	}
 
 	if (Cmd_LegacyCommand())
-		goto done;
+		return;
 
 	if (!host_initialized && Cmd_Argc() > 1) {
 		if (Cvar_CreateTempVar())
-			goto done;
+			return;
 	}
 
 	if (cbuf_current != &cbuf_svc)
@@ -1815,9 +2379,6 @@ checkaliases:
 		if (cl_warncmd.integer || developer.integer)
 			Com_Printf ("Unknown command \"%s\"\n", Cmd_Argv(0));
 	}
-
-done:
-	cbuf_current = oldcontext;
 }
 
 void Cmd_ExecuteString (char *text)
@@ -2182,6 +2743,7 @@ void Cmd_Alias_In_f (void)
 		return;
 	}
 
+	Cmd_FlushAliasCache(alias);
 	Q_free(alias->value);
 	alias->value = Q_strdup(buf);
 	if (strchr(buf, '%'))
@@ -2218,6 +2780,8 @@ void Cmd_Alias_Out_f (void)
 			Com_Printf ("alias_out: not found\n");
 		return;
 	}
+
+	Cmd_FlushAliasCache(alias);
 }
 
 void Cmd_Cvar_In_f (void)
@@ -2315,6 +2879,7 @@ void Cmd_Init (void)
 	Cmd_AddCommand ("echo", Cmd_Echo_f);
 	Cmd_AddCommand ("aliaslist", Cmd_AliasList_f);
 	Cmd_AddCommand ("aliasedit", Cmd_EditAlias_f);
+	Cmd_AddCommand ("aliasprofile", Cmd_AliasProfile_f);
 	Cmd_AddCommand ("alias", Cmd_Alias_f);
 	Cmd_AddCommand ("tempalias", Cmd_Alias_f);
 	Cmd_AddCommand ("viewalias", Cmd_Viewalias_f);
@@ -200,8 +200,17 @@ typedef struct cmd_alias_s {
 	char				name[MAX_ALIAS_NAME];
 	char				*value;
 	int					flags;
+	struct aliaspart_s	*parts;		// value split at %parameters, made on first use
+	struct aliascode_s	*code;		// value split into lines, made on first use
+	int					calls;		// times executed, see aliasprofile
 } cmd_alias_t;
 
+// call whenever value of an alias is changed or freed
+void Cmd_FlushAliasCache (cmd_alias_t *a);
+
+// call when commands, aliases or cvars are added or removed
+void Cmd_NamesChanged (void);
+
 qbool Cmd_DeleteAlias (char *name);	// return true if successful
 cmd_alias_t *Cmd_FindAlias (const char *name); // returns NULL on failure
 char *Cmd_AliasString (char *name); // returns NULL on failure
@@ -223,3 +232,7 @@ typedef struct
 void Cmd_AddMacro (const char *s, char *(*f)(void)); 
 void Cmd_AddMacroEx (const char *s, char *(*f) (void), int teamplay);
 char *Cmd_MacroString (const char *s, int *macro_length);
+
+// cvar names are kept in the same lookup tree as macros for $expansion
+void Cmd_AddExpandCvar (cvar_t *var);
+void Cmd_RemoveExpandCvar (cvar_t *var);
@@ -20,6 +20,12 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "common.h"
 #include "cvar.h"
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
 
 typedef struct cnode_s {
 	// common with leaf
@@ -58,7 +64,7 @@ static int			numplanes;
 static cnode_t		*map_nodes;
 static int			numnodes;
 
-static dclipnode_t	*map_clipnodes;
+static cclipnode_t	*map_clipnodes;
 static int			numclipnodes;
 
 static cleaf_t		*map_leafs;
@@ -77,6 +83,8 @@ static char			*map_entitystring;
 static qbool		map_halflife;
 
 static byte			*cmod_base;					// for CM_Load* functions
+static fs_mapping_t	cmod_map;					// file view cmod_base points into
+static fs_mapping_t	cmod_vismap;				// map_pvs and map_phs when they come from the cache
 
 
 /*
@@ -88,8 +96,7 @@ HULL BOXES
 */
 
 static hull_t		box_hull;
-static dclipnode_t	box_clipnodes[6];
-static mplane_t		box_planes[6];
+static cclipnode_t	box_clipnodes[6];
 
 /*
 ** CM_InitBoxHull
@@ -103,17 +110,15 @@ static void CM_InitBoxHull (void)
 	int		side;
 
 	box_hull.clipnodes = box_clipnodes;
-	box_hull.planes = box_planes;
 	box_hull.firstclipnode = 0;
 	box_hull.lastclipnode = 5;
 
 	for (i=0 ; i<6 ; i++) {
-		box_clipnodes[i].planenum = i;
 		side = i&1;
 		box_clipnodes[i].children[side] = CONTENTS_EMPTY;
 		box_clipnodes[i].children[side^1] = (i != 5) ? (i + 1) : CONTENTS_SOLID;
-		box_planes[i].type = i>>1;
-		box_planes[i].normal[i>>1] = 1;
+		box_clipnodes[i].type = i>>1;
+		box_clipnodes[i].normal[i>>1] = 1;
 	}
 }
 
@@ -125,35 +130,71 @@ static void CM_InitBoxHull (void)
 */
 hull_t *CM_HullForBox (vec3_t mins, vec3_t maxs)
 {
-	box_planes[0].dist = maxs[0];
-	box_planes[1].dist = mins[0];
-	box_planes[2].dist = maxs[1];
-	box_planes[3].dist = mins[1];
-	box_planes[4].dist = maxs[2];
-	box_planes[5].dist = mins[2];
+	box_clipnodes[0].dist = maxs[0];
+	box_clipnodes[1].dist = mins[0];
+	box_clipnodes[2].dist = maxs[1];
+	box_clipnodes[3].dist = mins[1];
+	box_clipnodes[4].dist = maxs[2];
+	box_clipnodes[5].dist = mins[2];
 
 	return &box_hull;
 }
 
+// Pmove and the server ask for the contents of the same points over and over,
+// the answer can only change with the map. Box hulls change all the time so
+// they're not remembered. The sv_threads workers ask too, so every thread
+// keeps a memo of its own and drops it when the map generation changes.
+#define CONTENTS_MEMO_SIZE 256
+
+typedef struct {
+	const cclipnode_t	*clipnodes;
+	int					num;
+	vec3_t				p;
+	int					contents;
+} contentsmemo_t;
+
+static Q_THREADLOCAL contentsmemo_t	contents_memo[CONTENTS_MEMO_SIZE];
+static Q_THREADLOCAL int				contents_memo_map;		// contents_memo_generation it was filled for
+static int								contents_memo_generation = 1;
+
+// Only called between maps, when no worker thread is running.
+static void CM_ClearContentsMemo (void)
+{
+	contents_memo_generation++;
+}
+
+// Children were checked when the map was loaded, see CM_CheckClipnodes.
 int CM_HullPointContents (hull_t *hull, int num, vec3_t p)
 {
-	dclipnode_t *node;
-	mplane_t *plane;
-	float d;
+	const cclipnode_t *node;
+	contentsmemo_t *memo = NULL;
+	unsigned int bits[3];
+	int start = num;
 
-	while (num >= 0) {
-		if (num < hull->firstclipnode || num > hull->lastclipnode)
-		{
-			if (map_halflife && num == hull->lastclipnode + 1)
-				return CONTENTS_EMPTY;
-			Sys_Error ("CM_HullPointContents: bad node number");
+	if (hull != &box_hull)
+	{
+		if (contents_memo_map != contents_memo_generation) {
+			memset (contents_memo, 0, sizeof (contents_memo));
+			contents_memo_map = contents_memo_generation;
 		}
 
+		memcpy (bits, p, sizeof (bits));
+		memo = &contents_memo[((bits[0] * 73856093) ^ (bits[1] * 19349663) ^ (bits[2] * 83492791) ^ num) % CONTENTS_MEMO_SIZE];
+		if (memo->clipnodes == hull->clipnodes && memo->num == num && VectorCompare (memo->p, p))
+			return memo->contents;
+	}
+
+	while (num >= 0) {
 		node = hull->clipnodes + num;
-		plane = hull->planes + node->planenum;
+		num = (PlaneDiff (p, node) < 0) ? node->children[1] : node->children[0];
+	}
 
-		d = PlaneDiff (p, plane);
-		num = (d < 0) ? node->children[1] : node->children[0];
+	// the key goes in with the result
+	if (memo) {
+		memo->clipnodes = hull->clipnodes;
+		memo->num = start;
+		VectorCopy (p, memo->p);
+		memo->contents = num;
 	}
 
 	return num;
@@ -171,161 +212,190 @@ LINE TESTING IN HULLS
 // 1/32 epsilon to keep floating point happy
 #define	DIST_EPSILON	0.03125
 
+// deeper than any map gets
+#define MAX_TRACE_DEPTH	256
+
 enum { TR_EMPTY, TR_SOLID, TR_BLOCKED };
 
+// a node the trace crosses, waiting for its children
 typedef struct {
-	hull_t *hull;
-	trace_t	trace;
-	int leafcount;
-} hulltrace_local_t;
+	const cclipnode_t *node;
+	float		t1, t2;
+	float		p1f, p2f, midf;
+	vec3_t		p1, p2, mid;
+	int			nearside;
+	int			nearcheck;		// -1 while the near side is traced
+} hulltrace_frame_t;
 
+/*
+==================
+CM_HullTraceNodes
 
-//====================
-int RecursiveHullTrace (hulltrace_local_t *htl, int num, float p1f, float p2f, const vec3_t p1, const vec3_t p2)
+Same as the recursive id trace, but walks with a stack of its own: a crossed
+node is pushed, its near side traced and then its far side, and when both are
+done the result is handled as the return of the recursive call would have been.
+==================
+*/
+static int CM_HullTraceNodes (hull_t *hull, trace_t *trace, int num, const vec3_t start, const vec3_t end)
 {
-	mplane_t	*plane;
-	float		t1, t2;
-	dclipnode_t *node;
-	int			i;
-	int			nearside;
-	float		frac, midf;
-	vec3_t		mid;
-	int			check, oldcheck;
-	hull_t *hull = htl->hull;
-	trace_t *trace = &htl->trace;
-
-start:
-	if (num < 0) {
-		// this is a leaf node
-		htl->leafcount++;
-		if (num == CONTENTS_SOLID) {
-			if (htl->leafcount == 1)
-				trace->startsolid = true;
-			return TR_SOLID;
+	hulltrace_frame_t stack[MAX_TRACE_DEPTH], *f;
+	const cclipnode_t *node;
+	int sp = 0, i, check, leafcount = 0;
+	float t1, t2, frac, p1f = 0, p2f = 1;
+	vec3_t p1, p2;
+
+	VectorCopy (start, p1);
+	VectorCopy (end, p2);
+
+descend:
+	while (num >= 0) {
+		node = hull->clipnodes + num;
+
+		// find the point distances
+		if (node->type < 3) {
+			t1 = p1[node->type] - node->dist;
+			t2 = p2[node->type] - node->dist;
 		}
 		else {
-			if (num == CONTENTS_EMPTY)
-				trace->inopen = true;
-			else
-				trace->inwater = true;
-			return TR_EMPTY;
+			t1 = DotProduct (node->normal, p1) - node->dist;
+			t2 = DotProduct (node->normal, p2) - node->dist;
 		}
-	}
-
-	// FIXME, check at load time
-	if (num < hull->firstclipnode || num > hull->lastclipnode)
-	{
-		if (map_halflife && num == hull->lastclipnode + 1)
-			return TR_EMPTY;
-		Sys_Error ("RecursiveHullTrace: bad node number");
-	}
-
-	node = hull->clipnodes + num;
 
-	//
-	// find the point distances
-	//
-	plane = hull->planes + node->planenum;
+		// see which sides we need to consider
+		if (t1 >= 0 && t2 >= 0) {
+			num = node->children[0];	// go down the front side
+			continue;
+		}
+		if (t1 < 0 && t2 < 0) {
+			num = node->children[1];	// go down the back side
+			continue;
+		}
 
-	if (plane->type < 3) {
-		t1 = p1[plane->type] - plane->dist;
-		t2 = p2[plane->type] - plane->dist;
-	}
-	else {
-		t1 = DotProduct (plane->normal, p1) - plane->dist;
-		t2 = DotProduct (plane->normal, p2) - plane->dist;
-	}
-	
-	// see which sides we need to consider
-	if (t1 >= 0 && t2 >= 0) {
-		num = node->children[0];	// go down the front side
-		goto start;
-	}
-	if (t1 < 0 && t2 < 0) {
-		num = node->children[1];	// go down the back side
-		goto start;
+		if (sp == MAX_TRACE_DEPTH)
+			Sys_Error ("CM_HullTrace: hull too deep");
+		f = &stack[sp++];
+
+		// find the intersection point
+		frac = t1 / (t1 - t2);
+		frac = bound (0, frac, 1);
+		f->node = node;
+		f->t1 = t1;
+		f->t2 = t2;
+		f->p1f = p1f;
+		f->p2f = p2f;
+		f->midf = p1f + (p2f - p1f)*frac;
+		for (i = 0; i < 3; i++)
+			f->mid[i] = p1[i] + frac*(p2[i] - p1[i]);
+		VectorCopy (p1, f->p1);
+		VectorCopy (p2, f->p2);
+		f->nearside = (t1 < t2) ? 1 : 0;
+		f->nearcheck = -1;
+
+		// move up to the node
+		num = node->children[f->nearside];
+		p2f = f->midf;
+		VectorCopy (f->mid, p2);
 	}
 
-	// find the intersection point
-	frac = t1 / (t1 - t2);
-	frac = bound (0, frac, 1);
-	midf = p1f + (p2f - p1f)*frac;
-	for (i = 0; i < 3; i++)
-		mid[i] = p1[i] + frac*(p2[i] - p1[i]);
-
-	// move up to the node
-	nearside = (t1 < t2) ? 1 : 0;
-	check = RecursiveHullTrace (htl, node->children[nearside], p1f, midf, p1, mid);
-	if (check == TR_BLOCKED)
-		return check;
-
-	// if we started in solid, allow us to move out to an empty area
-	if (check == TR_SOLID && (trace->inopen || trace->inwater))
-		return check;
-	oldcheck = check;
-
-	// go past the node
-	check = RecursiveHullTrace (htl, node->children[1 - nearside], midf, p2f, mid, p2);
-	if (check == TR_EMPTY || check == TR_BLOCKED)
-		return check;
-
-	if (oldcheck != TR_EMPTY)
-		return check;	// still in solid
-
-	// near side is empty, far side is solid
-	// this is the impact point
-	if (!nearside) {
-		VectorCopy (plane->normal, trace->plane.normal);
-		trace->plane.dist = plane->dist;
+	// this is a leaf node
+	leafcount++;
+	if (num == CONTENTS_SOLID) {
+		if (leafcount == 1)
+			trace->startsolid = true;
+		check = TR_SOLID;
 	}
 	else {
-		VectorNegate (plane->normal, trace->plane.normal);
-		trace->plane.dist = -plane->dist;
+		if (num == CONTENTS_EMPTY)
+			trace->inopen = true;
+		else
+			trace->inwater = true;
+		check = TR_EMPTY;
 	}
 
-// put the final point DIST_EPSILON pixels on the near side
-	if (t1 < t2)
-		frac = (t1 + DIST_EPSILON) / (t1 - t2);
-	else
-		frac = (t1 - DIST_EPSILON) / (t1 - t2);
-	frac = bound (0, frac, 1);
-	midf = p1f + (p2f - p1f)*frac;
-	for (i = 0; i < 3; i++)
-		mid[i] = p1[i] + frac*(p2[i] - p1[i]);
+	while (sp) {
+		f = &stack[sp - 1];
 
-	trace->fraction = midf;
-	VectorCopy (mid, trace->endpos);
+		if (f->nearcheck < 0) {
+			// back from the near side
+			if (check == TR_BLOCKED) {
+				sp--;
+				continue;
+			}
+
+			// if we started in solid, allow us to move out to an empty area
+			if (check == TR_SOLID && (trace->inopen || trace->inwater)) {
+				sp--;
+				continue;
+			}
+			f->nearcheck = check;
+
+			// go past the node
+			num = f->node->children[1 - f->nearside];
+			p1f = f->midf;
+			p2f = f->p2f;
+			VectorCopy (f->mid, p1);
+			VectorCopy (f->p2, p2);
+			goto descend;
+		}
+
+		// back from the far side
+		sp--;
+		if (check == TR_EMPTY || check == TR_BLOCKED)
+			continue;
+
+		if (f->nearcheck != TR_EMPTY)
+			continue;	// still in solid
+
+		// near side is empty, far side is solid
+		// this is the impact point
+		if (!f->nearside) {
+			VectorCopy (f->node->normal, trace->plane.normal);
+			trace->plane.dist = f->node->dist;
+		}
+		else {
+			VectorNegate (f->node->normal, trace->plane.normal);
+			trace->plane.dist = -f->node->dist;
+		}
 
-	return TR_BLOCKED;
+		// put the final point DIST_EPSILON pixels on the near side
+		if (f->t1 < f->t2)
+			frac = (f->t1 + DIST_EPSILON) / (f->t1 - f->t2);
+		else
+			frac = (f->t1 - DIST_EPSILON) / (f->t1 - f->t2);
+		frac = bound (0, frac, 1);
+		trace->fraction = f->p1f + (f->p2f - f->p1f)*frac;
+		for (i = 0; i < 3; i++)
+			trace->endpos[i] = f->p1[i] + frac*(f->p2[i] - f->p1[i]);
+
+		check = TR_BLOCKED;
+	}
+
+	return check;
 }
 
 trace_t CM_HullTrace (hull_t *hull, vec3_t start, vec3_t end)
 {
 	int check;
+	trace_t trace;
 
-	// this structure is passed as a pointer to RecursiveHullTrace
-	// so as not to use much stack but still be thread safe
-	hulltrace_local_t htl;
-	htl.hull = hull;
-	htl.leafcount = 0;
 	// fill in a default trace
-	memset (&htl.trace, 0, sizeof(htl.trace));
-	htl.trace.fraction = 1;
-	htl.trace.startsolid = false;
-	VectorCopy (end, htl.trace.endpos);
+	memset (&trace, 0, sizeof(trace));
+	trace.fraction = 1;
+	trace.startsolid = false;
+	VectorCopy (end, trace.endpos);
 
-	check = RecursiveHullTrace (&htl, hull->firstclipnode, 0, 1, start, end);
+	check = CM_HullTraceNodes (hull, &trace, hull->firstclipnode, start, end);
 
 	if (check == TR_SOLID) {
-		htl.trace.startsolid = htl.trace.allsolid = true;
+		trace.startsolid = trace.allsolid = true;
 		// it would be logical to set fraction to 0, but original id code
 		// would leave it at 1.   We emulate that just in case.
 		// (FIXME: is it just QW, or NQ as well?)
-		//htl.trace.fraction = 0;
-		VectorCopy (start, htl.trace.endpos);
+		//trace.fraction = 0;
+		VectorCopy (start, trace.endpos);
 	}
 
-	return htl.trace;
+	return trace;
 }
 
 
@@ -415,11 +485,10 @@ crosses a waterline.
 =============================================================================
 */
 
-static int	fatbytes;
-static byte	fatpvs[MAX_MAP_LEAFS/8];
-static vec3_t	fatpvs_org;
+static unsigned int	fatpvs_words[MAX_MAP_LEAFS/32]; // word aligned, so the server can test leafs word-wise
+static byte	*fatpvs = (byte *) fatpvs_words;
 
-static void AddToFatPVS_r (cnode_t *node)
+static void AddToFatPVS_r (cnode_t *node, const vec3_t org, byte *fat, int fatbytes)
 {
 	int i;
 	float d;
@@ -434,20 +503,20 @@ static void AddToFatPVS_r (cnode_t *node)
 			{
 				pvs = CM_LeafPVS ( (cleaf_t *)node);
 				for (i=0 ; i<fatbytes ; i++)
-					fatpvs[i] |= pvs[i];
+					fat[i] |= pvs[i];
 			}
 			return;
 		}
 	
 		plane = node->plane;
-		d = DotProduct (fatpvs_org, plane->normal) - plane->dist;
+		d = DotProduct (org, plane->normal) - plane->dist;
 		if (d > 8)
 			node = node->children[0];
 		else if (d < -8)
 			node = node->children[1];
 		else
 		{ // go down both
-			AddToFatPVS_r (node->children[0]);
+			AddToFatPVS_r (node->children[0], org, fat, fatbytes);
 			node = node->children[1];
 		}
 	}
@@ -455,19 +524,33 @@ static void AddToFatPVS_r (cnode_t *node)
 
 /*
 =============
-CM_FatPVS
+CM_BuildFatPVS
 
 Calculates a PVS that is the inclusive or of all leafs within 8 pixels of the
-given point.
+given point into pvs, which must hold MAX_MAP_LEAFS/8 bytes. If add is true
+the result is or'ed into what pvs already holds, to build the union of several
+points. Does not touch any shared state, so it can run on several threads.
 =============
 */
-byte *CM_FatPVS (vec3_t org)
+void CM_BuildFatPVS (vec3_t org, byte *pvs, qbool add)
 {
-	VectorCopy (org, fatpvs_org);
+	int fatbytes = (visleafs+31)>>3;
 
-	fatbytes = (visleafs+31)>>3;
-	memset (fatpvs, 0, fatbytes);
-	AddToFatPVS_r (map_nodes);
+	if (!add)
+		memset (pvs, 0, fatbytes);
+	AddToFatPVS_r (map_nodes, org, pvs, fatbytes);
+}
+
+/*
+=============
+CM_FatPVS
+
+Like CM_BuildFatPVS, into a static buffer.
+=============
+*/
+byte *CM_FatPVS (vec3_t org)
+{
+	CM_BuildFatPVS (org, fatpvs, false);
 	return fatpvs;
 }
 
@@ -600,10 +683,17 @@ static void CM_LoadSubmodels (lump_t *l)
 			out->origin[j] = LittleFloat (in->origin[j]);
 		}
 		for (j = 0; j < MAX_MAP_HULLS; j++) {
-			out->hulls[j].planes = map_planes;
 			out->hulls[j].clipnodes = map_clipnodes;
 			out->hulls[j].firstclipnode = LittleLong (in->headnode[j]);
 			out->hulls[j].lastclipnode = numclipnodes - 1;
+
+			// hull 0 is checked in CM_MakeHull0, hull 3 isn't used for anything
+			if (j && out->hulls[j].firstclipnode >= numclipnodes) {
+				if ((map_halflife && out->hulls[j].firstclipnode == numclipnodes) || j == 3)
+					out->hulls[j].firstclipnode = CONTENTS_EMPTY;
+				else
+					Host_Error ("CM_LoadMap: bad headnode");
+			}
 		}
 
 		VectorClear (out->hulls[0].clip_mins);
@@ -710,6 +800,44 @@ static void CM_LoadLeafs (lump_t *l)
 
 }
 
+// two nodes to a cache line
+static cclipnode_t *CM_AllocClipnodes (int count)
+{
+	byte *mem = Hunk_AllocName ((count + 1) * sizeof(cclipnode_t), loadname);
+
+	return (cclipnode_t *) (((intptr_t) mem + sizeof(cclipnode_t) - 1) & ~(intptr_t) (sizeof(cclipnode_t) - 1));
+}
+
+static void CM_SetClipnodePlane (cclipnode_t *node, int planenum)
+{
+	if (planenum < 0 || planenum >= numplanes)
+		Host_Error ("CM_LoadMap: bad planenum");
+
+	VectorCopy (map_planes[planenum].normal, node->normal);
+	node->dist = map_planes[planenum].dist;
+	node->type = map_planes[planenum].type;
+}
+
+// Traces don't check node numbers as they walk, so it's done here once.
+static void CM_CheckClipnodes (cclipnode_t *nodes, int count)
+{
+	int i, j;
+
+	for (i = 0; i < count; i++)
+	{
+		for (j = 0; j < 2; j++)
+		{
+			if (nodes[i].children[j] < count)
+				continue;
+			// Half-Life maps point one past the last node for empty space
+			if (map_halflife && nodes[i].children[j] == count)
+				nodes[i].children[j] = CONTENTS_EMPTY;
+			else
+				Host_Error ("CM_LoadMap: bad clipnode child");
+		}
+	}
+}
+
 /*
 =================
 CM_LoadClipnodes
@@ -717,7 +845,8 @@ CM_LoadClipnodes
 */
 static void CM_LoadClipnodes (lump_t *l)
 {
-	dclipnode_t *in, *out;
+	dclipnode_t *in;
+	cclipnode_t *out;
 	int i, count;
 
 	in = (void *)(cmod_base + l->fileofs);
@@ -726,17 +855,19 @@ static void CM_LoadClipnodes (lump_t *l)
 		Host_Error ("CM_LoadMap: funny lump size");
 
 	count = l->filelen / sizeof(*in);
-	out = Hunk_AllocName ( count*sizeof(*out), loadname);
+	out = CM_AllocClipnodes (count);
 
 	map_clipnodes = out;
 	numclipnodes = count;
 
 	for (i = 0; i < count; i++, out++, in++)
 	{
-		out->planenum = LittleLong(in->planenum);
+		CM_SetClipnodePlane (out, LittleLong(in->planenum));
 		out->children[0] = LittleShort(in->children[0]);
 		out->children[1] = LittleShort(in->children[1]);
 	}
+
+	CM_CheckClipnodes (map_clipnodes, count);
 }
 
 /*
@@ -749,23 +880,25 @@ Deplicate the drawing hull structure as a clipping hull
 static void CM_MakeHull0 (void)
 {
 	cnode_t *in, *child;
-	dclipnode_t *out;
+	cclipnode_t *out;
 	int i, j, count;
 
 	in = map_nodes;
 	count = numnodes;
-	out = Hunk_AllocName ( count*sizeof(*out), loadname);
+	out = CM_AllocClipnodes (count);
 
 	// fix up hull 0 in all cmodels
 	for (i = 0; i < numcmodels; i++) {
 		map_cmodels[i].hulls[0].clipnodes = out;
 		map_cmodels[i].hulls[0].lastclipnode = count - 1;
+		if (map_cmodels[i].hulls[0].firstclipnode >= count)
+			Host_Error ("CM_LoadMap: bad headnode");
 	}
 
 	// build clipnodes from nodes
 	for (i = 0; i < count; i++, out++, in++)
 	{
-		out->planenum = in->plane - map_planes;
+		CM_SetClipnodePlane (out, in->plane - map_planes);
 		for (j = 0; j < 2; j++)
 		{
 			child = in->children[j];
@@ -936,6 +1069,162 @@ static void CM_BuildPHS (void)
 
 
 
+/*
+** PVS/PHS cache
+**
+** A server writes the decompressed PVS and PHS to viscache/<map>_<checksum>.vis
+** in the home directory (or the ezquake one). Later loads of the same map map
+** the file instead of building them, so several servers on one machine share
+** the pages. The client only reads the cache, it never writes one.
+** -noviscache turns it off.
+*/
+#define VISCACHE_VERSION	1
+
+typedef struct {
+	char		id[4];				// "EZVC"
+	int			version;
+	unsigned int checksum;			// map_checksum
+	int			visleafs;
+	int			rowbytes;
+	int			hasphs;
+	int			pad[2];				// keep the rows 32 byte aligned in the file
+} viscacheheader_t;
+
+static qbool CM_VisCacheDir (char *dir, int size)
+{
+	int len;
+
+	if (com_homedir[0])
+		len = snprintf (dir, size, "%s/viscache", com_homedir);
+	else
+		len = snprintf (dir, size, "%s/ezquake/viscache", com_basedir);
+
+	return len > 0 && len < size;
+}
+
+static qbool CM_VisCachePath (char *path, int size)
+{
+	char dir[MAX_OSPATH];
+	int len;
+
+	if (!CM_VisCacheDir (dir, sizeof(dir)))
+		return false;
+	len = snprintf (path, size, "%s/%s_%08x.vis", dir, loadname, map_checksum);
+
+	return len > 0 && len < size;
+}
+
+// removes <loadname>_<checksum>.vis files left behind by older versions of the map
+static int CM_PruneVisCacheFile (char *name, int size, void *parm)
+{
+	char path[MAX_OSPATH], current[16];
+	int i, len = strlen (loadname);
+
+	// the pattern also matches other maps whose names start with loadname_
+	if (strlen (name) != len + 13 || strncmp (name, loadname, len) || name[len] != '_' || strcmp (name + len + 9, ".vis"))
+		return true;
+	for (i = len + 1; i < len + 9; i++)
+		if (!isxdigit ((unsigned char) name[i]))
+			return true;
+
+	snprintf (current, sizeof(current), "%08x.vis", map_checksum);
+	if (!strcmp (name + len + 1, current))
+		return true;
+
+	len = snprintf (path, sizeof(path), "%s/%s", (char *) parm, name);
+	if (len > 0 && len < sizeof(path))
+		remove (path);
+
+	return true;
+}
+
+static qbool CM_LoadVisCache (lump_t *lump_vis, qbool needphs)
+{
+	viscacheheader_t header;
+	char path[MAX_OSPATH];
+	int pvsbytes;
+	FILE *f;
+
+	// maps without vis are all visible, which is quick to build
+	if (!lump_vis->filelen || COM_CheckParm ("-noviscache"))
+		return false;
+
+	if (!CM_VisCachePath (path, sizeof(path)) || !(f = fopen (path, "rb")))
+		return false;
+
+	if (fread (&header, sizeof(header), 1, f) != 1) {
+		fclose (f);
+		return false;
+	}
+	fclose (f);
+
+	map_vis_rowlongs = (visleafs + 31) >> 5;
+	map_vis_rowbytes = map_vis_rowlongs * 4;
+	pvsbytes = map_vis_rowbytes * visleafs;
+
+	if (strncmp (header.id, "EZVC", 4) || header.version != VISCACHE_VERSION || header.checksum != map_checksum
+		|| header.visleafs != visleafs || header.rowbytes != map_vis_rowbytes || (needphs && !header.hasphs))
+		return false;
+
+	if (!FS_MapOSFile (path, sizeof(header), header.hasphs ? 2 * pvsbytes : pvsbytes, &cmod_vismap))
+		return false;
+
+	map_pvs = cmod_vismap.data;
+	map_phs = header.hasphs ? map_pvs + pvsbytes : NULL;
+
+	return true;
+}
+
+static void CM_SaveVisCache (lump_t *lump_vis)
+{
+	viscacheheader_t header;
+	char path[MAX_OSPATH], tmppath[MAX_OSPATH], dir[MAX_OSPATH];
+	int pvsbytes = map_vis_rowbytes * visleafs, len;
+	qbool ok;
+	FILE *f;
+
+	if (!lump_vis->filelen || COM_CheckParm ("-noviscache"))
+		return;
+
+	memset (&header, 0, sizeof(header));
+	memcpy (header.id, "EZVC", 4);
+	header.version = VISCACHE_VERSION;
+	header.checksum = map_checksum;
+	header.visleafs = visleafs;
+	header.rowbytes = map_vis_rowbytes;
+	header.hasphs = (map_phs != NULL);
+
+	// written under another name and renamed, so other servers never map half a file
+	if (!CM_VisCachePath (path, sizeof(path)))
+		return;
+	len = snprintf (tmppath, sizeof(tmppath), "%s.%d", path, (int) getpid ());
+	if (len <= 0 || len >= sizeof(tmppath))
+		return;
+	FS_CreatePath (tmppath);
+	if (!(f = fopen (tmppath, "wb")))
+		return;
+
+	ok = fwrite (&header, sizeof(header), 1, f) == 1 && fwrite (map_pvs, pvsbytes, 1, f) == 1
+		&& (!map_phs || fwrite (map_phs, pvsbytes, 1, f) == 1);
+	ok = !fclose (f) && ok;
+
+	if (ok && rename (tmppath, path)) {
+		// windows won't rename over an existing file
+		remove (path);
+		ok = !rename (tmppath, path);
+	}
+
+	if (!ok) {
+		remove (tmppath);
+		return;
+	}
+
+	// one file per map, so a rotation of frequently updated maps doesn't fill the disk
+	if (CM_VisCacheDir (dir, sizeof(dir)))
+		Sys_EnumerateFiles (dir, va ("%s_*.vis", loadname), CM_PruneVisCacheFile, dir);
+}
+
+
 /*
 ** hunk was reset by host, so the data is no longer valid
 */
@@ -948,8 +1237,10 @@ void CM_InvalidateMap (void)
 	map_nodes = NULL;
 	map_clipnodes = NULL;
 	map_leafs = NULL;
+	CM_ClearContentsMemo ();
 	map_pvs = NULL;
 	map_phs = NULL;
+	FS_UnmapFile (&cmod_vismap);
 	map_entitystring = NULL;
 }
 
@@ -972,8 +1263,10 @@ cmodel_t *CM_LoadMap (char *name, qbool clientload, unsigned *checksum, unsigned
 		return &map_cmodels[0]; // still have the right version
 	}
 
-	// load the file
-	buf = (unsigned int *) FS_LoadTempFile (name, NULL);
+	// load the file, a previous load may have been aborted by Host_Error
+	FS_UnmapFile (&cmod_map);
+	FS_UnmapFile (&cmod_vismap);
+	buf = (unsigned int *) FS_MapFile (name, NULL, &cmod_map);
 	if (!buf)
 		Host_Error ("CM_LoadMap: %s not found", name);
 
@@ -1020,10 +1313,17 @@ cmodel_t *CM_LoadMap (char *name, qbool clientload, unsigned *checksum, unsigned
 
 	CM_MakeHull0 ();
 
-	CM_BuildPVS (&header->lumps[LUMP_VISIBILITY], &header->lumps[LUMP_LEAFS]);
+	if (!CM_LoadVisCache (&header->lumps[LUMP_VISIBILITY], !clientload)) {
+		CM_BuildPVS (&header->lumps[LUMP_VISIBILITY], &header->lumps[LUMP_LEAFS]);
 
-	if (!clientload) // client doesn't need PHS
-		CM_BuildPHS ();
+		if (!clientload) { // client doesn't need PHS
+			CM_BuildPHS ();
+			CM_SaveVisCache (&header->lumps[LUMP_VISIBILITY]);
+		}
+	}
+
+	FS_UnmapFile (&cmod_map);
+	cmod_base = NULL;
 
 	strlcpy (map_name, name, sizeof(map_name));
 
@@ -1044,8 +1344,79 @@ cmodel_t *CM_InlineModel (char *name)
 	return &map_cmodels[num];
 }
 
+/*
+** CM_TraceBench_f
+**
+** cm_tracebench [count] [length]: times CM_HullTrace and CM_HullPointContents
+** on the loaded map. Segments start at random points inside the world bounds
+** and go up to length units (default 256) in a random direction. The random
+** numbers are seeded the same every time, so runs on one map can be compared.
+*/
+#define TRACEBENCH_MAX	1000000
+
+static void CM_TraceBench_f (void)
+{
+	vec3_t (*points)[2];
+	unsigned int seed = 1;
+	int count, i, j, h, hits, contents;
+	float length;
+	double start, trace_time, contents_time;
+	cmodel_t *world = &map_cmodels[0];
+	hull_t *hull;
+	trace_t trace;
+
+	if (!map_name[0]) {
+		Com_Printf ("cm_tracebench: no map loaded\n");
+		return;
+	}
+
+	count = (Cmd_Argc () > 1) ? atoi (Cmd_Argv (1)) : 100000;
+	count = bound (1, count, TRACEBENCH_MAX);
+	length = (Cmd_Argc () > 2) ? atof (Cmd_Argv (2)) : 256;
+
+	points = Q_malloc (count * sizeof (*points));
+	for (i = 0; i < count; i++) {
+		for (j = 0; j < 3; j++) {
+			seed = seed * 1103515245 + 12345;
+			points[i][0][j] = world->mins[j] + (world->maxs[j] - world->mins[j]) * ((seed >> 8) & 0xffff) / 65535.0;
+			seed = seed * 1103515245 + 12345;
+			points[i][1][j] = points[i][0][j] + length * ((int) ((seed >> 8) & 0xffff) - 32768) / 32768.0;
+		}
+	}
+
+	Com_Printf ("cm_tracebench: %d segments of up to %.0f units on %s\n", count, length, map_name);
+
+	for (h = 0; h < 3; h++) {
+		hull = &world->hulls[h];
+		if (!hull->clipnodes)
+			continue;
+
+		hits = contents = 0;
+		start = Sys_DoubleTime ();
+		for (i = 0; i < count; i++) {
+			trace = CM_HullTrace (hull, points[i][0], points[i][1]);
+			if (trace.fraction < 1 || trace.startsolid)
+				hits++;
+		}
+		trace_time = Sys_DoubleTime () - start;
+
+		start = Sys_DoubleTime ();
+		for (i = 0; i < count; i++)
+			contents += (CM_HullPointContents (hull, hull->firstclipnode, points[i][1]) == CONTENTS_SOLID);
+		contents_time = Sys_DoubleTime () - start;
+
+		Com_Printf ("hull %d: %.0f traces/sec (%d%% hit), %.0f point contents/sec (%d%% solid)\n", h,
+			count / max (trace_time, 0.000001), 100 * hits / count,
+			count / max (contents_time, 0.000001), 100 * contents / count);
+	}
+
+	Q_free (points);
+}
+
 void CM_Init (void)
 {
 //	memset (map_novis, 0xff, sizeof(map_novis));
 	CM_InitBoxHull ();
+
+	Cmd_AddCommand ("cm_tracebench", CM_TraceBench_f);
 }
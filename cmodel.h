@@ -40,10 +40,17 @@ typedef struct mplane_s {
 	byte	pad[2];
 } mplane_t;
 
-// !!! if this is changed, it must be changed in asm_i386.h too !!!
+// clipping hull node with its plane inline, built when the map is loaded
+typedef struct cclipnode_s {
+	vec3_t	normal;
+	float	dist;
+	int		type;			// < 3 for axial planes
+	int		children[2];	// negative numbers are contents
+	int		pad;			// 32 bytes, two nodes to a cache line
+} cclipnode_t;
+
 typedef struct {
-	dclipnode_t	*clipnodes;
-	mplane_t	*planes;
+	cclipnode_t	*clipnodes;
 	int			firstclipnode;
 	int			lastclipnode;
 	vec3_t		clip_mins;
@@ -83,6 +90,7 @@ int CM_LeafAmbientLevel (const struct cleaf_s *leaf, int ambient_channel);
 byte *CM_LeafPVS (const struct cleaf_s *leaf);
 byte *CM_LeafPHS (const struct cleaf_s *leaf); // only for the server
 byte *CM_FatPVS (vec3_t org);
+void CM_BuildFatPVS (vec3_t org, byte *pvs, qbool add);
 int CM_FindTouchedLeafs (const vec3_t mins, const vec3_t maxs, int leafs[], int maxleafs, int headnode, int *topnode);
 char *CM_EntityString (void);
 int CM_NumInlineModels (void);
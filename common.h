@@ -220,6 +220,20 @@ int FS_FOpenPathFile (const char *filename, FILE **file);
 byte *FS_LoadTempFile (char *path, int *len);
 byte *FS_LoadHunkFile (char *path, int *len);
 byte *FS_LoadHeapFile (const char *path, int *len);
+
+// view of a whole file, mapped straight from the OS file (or pak) when possible,
+// otherwise it is a heap copy. Writes go to private pages, data is not zero terminated.
+typedef struct fs_mapping_s {
+	byte	*data;
+	int		len;
+
+	void	*base;		// what to unmap or free
+	size_t	baselen;	// size of mapping, 0 if base is a heap copy
+} fs_mapping_t;
+
+byte *FS_MapFile (const char *path, int *len, fs_mapping_t *map);
+byte *FS_MapOSFile (const char *path, int offset, int len, fs_mapping_t *map);
+void FS_UnmapFile (fs_mapping_t *map);
 qbool FS_WriteFile (char *filename, void *data, int len); //The filename will be prefixed by com_basedir
 qbool FS_WriteFile_2 (char *filename, void *data, int len); //The filename used as is
 void FS_CreatePath (char *path);
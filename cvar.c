@@ -581,6 +581,7 @@ void Cvar_Register (cvar_t *var)
 	cvar_hash[key] = var;
 	var->next = cvar_vars;
 	cvar_vars = var;
+	Cmd_AddExpandCvar(var);
 
 #ifdef WITH_TCL
 	TCL_RegisterVariable (var);
@@ -769,6 +770,7 @@ cvar_t *Cvar_Create (char *name, char *string, int cvarflags)
 	cvar_hash[key] = v;
 
 	v->name = Q_strdup(name);
+	Cmd_AddExpandCvar(v);
 	v->string = Q_strdup(string);
 	v->defaultvalue = Q_strdup(string);
 	v->flags = cvarflags | CVAR_USER_CREATED;
@@ -815,6 +817,7 @@ qbool Cvar_Delete (const char *name)
 #ifdef WITH_TCL
 			TCL_UnregisterVariable (name);
 #endif
+			Cmd_RemoveExpandCvar(var);
 			// free
 			Q_free(var->defaultvalue);
 			Q_free(var->string);
@@ -745,6 +745,33 @@ void Stats_Reset(void) {
 	flag_touched = flag_dropped = flag_captured = false;
 }
 
+// Demo keyframes keep the stats with the rest of the client state,
+// so seeking back doesn't count the same frags twice.
+// Save and restore return how many bytes of buf they used.
+int Stats_StateSize(void) {
+	return sizeof(fragstats) + 3 * sizeof(qbool);
+}
+
+int Stats_SaveState(byte *buf) {
+	memcpy(buf, fragstats, sizeof(fragstats));
+	buf += sizeof(fragstats);
+	memcpy(buf, &flag_dropped, sizeof(qbool));
+	memcpy(buf + sizeof(qbool), &flag_touched, sizeof(qbool));
+	memcpy(buf + 2 * sizeof(qbool), &flag_captured, sizeof(qbool));
+
+	return Stats_StateSize();
+}
+
+int Stats_RestoreState(byte *buf) {
+	memcpy(fragstats, buf, sizeof(fragstats));
+	buf += sizeof(fragstats);
+	memcpy(&flag_dropped, buf, sizeof(qbool));
+	memcpy(&flag_touched, buf + sizeof(qbool), sizeof(qbool));
+	memcpy(&flag_captured, buf + 2 * sizeof(qbool), sizeof(qbool));
+
+	return Stats_StateSize();
+}
+
 void Stats_NewMap(void) {
 	static char last_gamedir[MAX_OSPATH] = {0};
 
@@ -35,14 +35,24 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #ifdef _WIN32
 #include <errno.h>
 #include <shlobj.h>
+#include <process.h>
+#define getpid _getpid
 #else
 #include <unistd.h>
 #include <strings.h>
+#include <sys/mman.h>
 #endif
+#include <sys/stat.h>
 
 
 char *com_filesearchpath;
 
+#define FS_INDEX_FILE		"fs_index.dat"	// archive directories, see FS_IndexedArchive
+
+static void FS_LoadArchiveIndex(void);
+static void FS_SaveArchiveIndex(void);
+static void FS_FreeArchiveIndex(void);
+
 /*
 =============================================================================
                         QUAKE FILESYSTEM
@@ -85,6 +95,9 @@ int fs_hash_dups;
 int fs_hash_files;
 
 cvar_t fs_cache = {"fs_cache", "1"};
+cvar_t fs_dircache = {"fs_dircache", "1"};
+
+fs_stats_t fs_stats;
 
 typedef enum {
 	FSLFRT_IFFOUND,
@@ -101,6 +114,8 @@ int FS_FileOpenRead (char *path, FILE **hndl);
 void FS_ReloadPackFiles_f(void);
 void FS_ListFiles_f(void);
 void FS_FlushFSHash(void);
+static void FS_HashAddPath(searchpath_t *search);
+static void FS_HashRemovePath(searchpath_t *search);
 void FS_AddHomeDirectory(char *dir, FS_Load_File_Types loadstuff);
 
 static void FS_AddDataFiles(char *pathto, searchpath_t *search, char *extension, searchpathfuncs_t *funcs);
@@ -154,6 +169,29 @@ int FS_FileOpenRead (char *path, FILE **hndl)
 	return FS_FileLength(f);
 }
 
+/*
+============
+FS_Stats_f
+
+fs_stats [reset]: what the file system did since startup
+============
+*/
+void FS_Stats_f (void)
+{
+	if (Cmd_Argc() == 2 && !strcmp(Cmd_Argv(1), "reset")) {
+		memset(&fs_stats, 0, sizeof(fs_stats));
+		return;
+	}
+
+	Com_Printf("file lookups: %i (%i not found), %.1f ms\n", fs_stats.locates, fs_stats.locate_misses, fs_stats.locate_time * 1000);
+	Com_Printf("os path lookups: %i, from cached listings: %i\n", fs_stats.os_probes, fs_stats.dircache_hits);
+	Com_Printf("directories listed: %i\n", fs_stats.dircache_lists);
+	Com_Printf("files loaded: %i, os files opened: %i\n", fs_stats.loads, fs_stats.opens);
+	Com_Printf("read from os files: %.0f kb\n", fs_stats.bytes_read / 1024);
+	Com_Printf("archives attached: %i, from fs index: %i\n", fs_stats.archives, fs_stats.archives_indexed);
+	Com_Printf("file system startup: %.1f ms\n", fs_stats.init_time * 1000);
+}
+
 /*
 ============
 FS_Path_f
@@ -342,6 +380,8 @@ static byte *FS_LoadFile (const char *path, int usehunk, int *file_length)
     if (Sys_PathProtection(path)) 
 		return NULL;
 
+	fs_stats.loads++;
+
 	// VFS-FIXME: This only checks the pak files, not the base dir's
     FS_FLocateFile(path, FSLFRT_LENGTH, &loc);
 	if (loc.search) {
@@ -362,7 +402,7 @@ static byte *FS_LoadFile (const char *path, int usehunk, int *file_length)
 	// TODO: Make these into defines.
 	if (usehunk == 1)
 	{
-		buf = (byte *) Hunk_AllocName (len + 1, base);
+		buf = (byte *) Hunk_AllocNameNoZero (len + 1, base);
 	}
 	else if (usehunk == 2)
 	{
@@ -409,6 +449,85 @@ byte *FS_LoadHeapFile (const char *path, int *len)
 	return FS_LoadFile (path, 5, len);
 }
 
+// Gives a read-only view of the whole file, straight from page cache if the search path
+// can map it (OS files, .pak and stored .pk3 entries) so that several processes loading the
+// same map share the memory. Falls back to a heap copy. Release with FS_UnmapFile.
+byte *FS_MapFile (const char *path, int *len, fs_mapping_t *map)
+{
+	flocation_t loc;
+
+	memset (map, 0, sizeof(*map));
+
+	if (Sys_PathProtection(path))
+		return NULL;
+
+	FS_FLocateFile(path, FSLFRT_LENGTH, &loc);
+	if (loc.search && loc.search->funcs->MapFile && loc.search->funcs->MapFile(loc.search->handle, &loc, map)) {
+		fs_stats.loads++;
+		if (len)
+			*len = map->len;
+		return map->data;
+	}
+
+	if (!(map->data = FS_LoadFile (path, 5, &map->len)))
+		return NULL;
+
+	map->base = map->data;
+	map->baselen = 0;
+	if (len)
+		*len = map->len;
+	return map->data;
+}
+
+// Like FS_MapFile, but for len bytes at offset of a file outside the search paths,
+// such as a cache in the home directory. Fails if the file is shorter than that.
+byte *FS_MapOSFile (const char *path, int offset, int len, fs_mapping_t *map)
+{
+	struct stat st;
+	FILE *f;
+
+	memset (map, 0, sizeof(*map));
+
+	if (offset < 0 || len <= 0 || !(f = fopen(path, "rb")))
+		return NULL;
+
+	if (fstat(fileno(f), &st) || st.st_size < (off_t) offset + len) {
+		fclose(f);
+		return NULL;
+	}
+
+	if (FSOS_MapRegion(fileno(f), offset, len, map)) {
+		fclose(f);
+		return map->data;
+	}
+
+	map->base = map->data = Q_malloc (len);
+	map->len = len;
+	if (fseek(f, offset, SEEK_SET) || fread(map->data, len, 1, f) != 1) {
+		fclose(f);
+		FS_UnmapFile (map);
+		return NULL;
+	}
+
+	fclose(f);
+	return map->data;
+}
+
+void FS_UnmapFile (fs_mapping_t *map)
+{
+	if (!map->base)
+		return;
+
+#ifndef _WIN32
+	if (map->baselen)
+		munmap (map->base, map->baselen);
+	else
+#endif
+		Q_free (map->base);
+
+	memset (map, 0, sizeof(*map));
+}
+
 // QW262 -->
 /*
 ================
@@ -599,20 +718,16 @@ void FS_SetGamedir (char *dir)
 	
 	strlcpy (com_gamedirfile, dir, sizeof(com_gamedirfile));
 
-	// Free up any current game dir info.
-	FS_FlushFSHash();
-
 	// free up any current game dir info
 	while (fs_searchpaths != fs_base_searchpaths)
 	{
+		FS_HashRemovePath(fs_searchpaths);
 		fs_searchpaths->funcs->ClosePath(fs_searchpaths->handle);
 		next = fs_searchpaths->next;
 		Q_free (fs_searchpaths);
 		fs_searchpaths = next;
 	}
 
-	filesystemchanged=true;
-
 	// Flush all data, so it will be forced to reload.
 	Cache_Flush ();
 
@@ -629,6 +744,8 @@ void FS_SetGamedir (char *dir)
 	Draw_InitConback();
 
 	FS_AddUserDirectory(dir);
+
+	FS_SaveArchiveIndex();
 }
 
 char *FS_NextPath (char *prevpath)
@@ -655,6 +772,11 @@ char *FS_NextPath (char *prevpath)
 
 void FS_ShutDown( void ) {
 
+	FS_FlushFSHash();
+
+	FS_SaveArchiveIndex();
+	FS_FreeArchiveIndex();
+
 	// free data
 	while (fs_searchpaths)	{
 		searchpath_t  *next;
@@ -686,8 +808,10 @@ void FS_InitFilesystemEx( qbool guess_cwd ) {
 	char *ev;
 #endif
 	char tmp_path[MAX_OSPATH];
+	double start = Sys_DoubleTime();
 
 	FS_ShutDown();
+	fs_stats.archives = fs_stats.archives_indexed = 0;
 
 	if (guess_cwd) { // so, com_basedir directory will be where ezquake*.exe located
 		char *e;
@@ -766,6 +890,8 @@ void FS_InitFilesystemEx( qbool guess_cwd ) {
 		Com_Printf("Using home directory \"%s\"\n", com_homedir);
 	}
 
+	FS_LoadArchiveIndex();
+
 	// start up with id1 by default
 	snprintf(&tmp_path[0], sizeof(tmp_path), "%s/%s", com_basedir, "id1");
 	FS_AddGameDirectory(tmp_path, FS_LOAD_FILE_ALL);
@@ -804,6 +930,12 @@ void FS_InitFilesystemEx( qbool guess_cwd ) {
 		i = COM_CheckParm ("+gamedir");
 	if (i && i < COM_Argc() - 1)
 		FS_SetGamedir (COM_Argv(i + 1));
+
+	FS_SaveArchiveIndex();
+
+	fs_stats.init_time = Sys_DoubleTime() - start;
+	Com_DPrintf("File system: %i archives attached (%i from %s) in %.1f ms\n",
+		fs_stats.archives, fs_stats.archives_indexed, FS_INDEX_FILE, fs_stats.init_time * 1000);
 }
 
 void FS_InitFilesystem( void ) {
@@ -2067,7 +2199,9 @@ void FS_InitModuleFS (void)
 	Cmd_AddCommand("dir", FS_Dir_f);
 	Cmd_AddCommand("locate", FS_Locate_f);
 	Cmd_AddCommand("fs_search", FS_ListFiles_f);
+	Cmd_AddCommand("fs_stats", FS_Stats_f);
 	Cvar_Register(&fs_cache);
+	Cvar_Register(&fs_dircache);
 	Com_Printf("Initialising quake VFS filesystem\n");
 }
 
@@ -2100,16 +2234,21 @@ searchpath_t *FS_AddPathHandle(char *probablepath, searchpathfuncs_t *funcs, voi
 {
 	searchpath_t *search;
 
-	search = (searchpath_t*)Q_malloc (sizeof(searchpath_t));
+	search = (searchpath_t*)Q_calloc (1, sizeof(searchpath_t));
 	search->copyprotected = copyprotect;
 	search->istemporary = istemporary;
 	search->handle = handle;
 	search->funcs = funcs;
+	search->priority = fs_searchpaths ? fs_searchpaths->priority - 1 : 0;
 
 	search->next = fs_searchpaths;
 	fs_searchpaths = search;
 
-	filesystemchanged = true;
+	// goes in front of everything, pure paths aside
+	if (fs_purepaths)
+		FS_FlushFSHash();
+	else
+		FS_HashAddPath(search);
 
 	//add any data files too
 	if (loadstuff & FS_LOAD_FILE_PAK)
@@ -2212,42 +2351,139 @@ char * FS_Locate_GetPath (const char *file)
 int fs_hash_dups;
 int fs_hash_files;
 
-void FS_FlushFSHash(void)
+// Each search path keeps its own entries in filesystemhash so it can be added and
+// removed on its own. A name can have an entry from several paths, lookups take the
+// one with the lowest priority, which is the one a walk of the search paths finds first.
+typedef struct fshash_s {
+	bucket_t		bucket;		// must be first
+	searchpath_t	*search;
+	void			*data;		// hashedresult for FindFile
+	struct fshash_s	*next;		// same search path
+	char			name[1];
+} fshash_t;
+
+static qbool fs_hashvalid;			// filesystemhash holds every search path
+static searchpath_t *fs_hashpath;	// path being added by FS_HashAddPath
+
+// Called from the BuildHash functions.
+void FS_AddFileHash(char *name, void *data)
+{
+	fshash_t *fh;
+	int len = strlen(name);
+
+	fh = (fshash_t *) Q_malloc (sizeof(*fh) + len);
+	memcpy (fh->name, name, len + 1);
+	fh->search = fs_hashpath;
+	fh->data = data;
+	fh->next = fs_hashpath->hash;
+	fs_hashpath->hash = fh;
+
+	if (Hash_GetInsensitive(filesystemhash, name))
+		fs_hash_dups++;
+	else
+		fs_hash_files++;
+
+	Hash_AddBucketInsensitive(filesystemhash, fh->name, fh, &fh->bucket);
+}
+
+static void FS_HashAddPath(searchpath_t *search)
 {
-	if (filesystemhash)
+	if (!fs_hashvalid)
+		return; // all done on the next FS_RebuildFSHash
+
+	fs_hashpath = search;
+	search->funcs->BuildHash(search->handle);
+	fs_hashpath = NULL;
+}
+
+static void FS_HashRemovePath(searchpath_t *search)
+{
+	fshash_t *fh, *next;
+
+	for (fh = search->hash; fh; fh = next)
+	{
+		next = fh->next;
+		Hash_RemoveBucketInsensitive(filesystemhash, &fh->bucket);
+		Q_free(fh);
+	}
+
+	search->hash = NULL;
+}
+
+static fshash_t *FS_HashFind(const char *name)
+{
+	bucket_t *buck = Hash_GetBucketInsensitive(filesystemhash, name);
+	fshash_t *fh, *best = NULL;
+
+	// all entries of this name, newest first
+	for ( ; buck; buck = buck->next)
 	{
-		Hash_Flush(filesystemhash);
+		fh = (fshash_t *) buck;
+		// <= so that of the same names in one archive the first one is used, as it's added last
+		if (!best || fh->search->priority <= best->search->priority)
+			best = fh;
 	}
 
+	return best;
+}
+
+void FS_FlushFSHash(void)
+{
+	searchpath_t *search;
+
+	for (search = fs_searchpaths; search; search = search->next)
+		FS_HashRemovePath(search);
+
+	fs_hashvalid = false;
 	filesystemchanged = true;
 }
 
+// Does a full build when needed, otherwise only the directories on disk are hashed
+// again, the contents of archives doesn't change.
 void FS_RebuildFSHash(void)
 {
 	searchpath_t	*search;
+	int				priority = 0;
+
 	if (!filesystemhash)
+		filesystemhash = Hash_InitTable(8192);
+
+	if (fs_hashvalid)
 	{
-		filesystemhash = Hash_InitTable(1024);
-	}
-	else
-	{
-		FS_FlushFSHash();
+		for (search = fs_searchpaths; search; search = search->next)
+		{
+			if (search->funcs == &osfilefuncs)
+			{
+				FS_HashRemovePath(search);
+				FS_HashAddPath(search);
+			}
+		}
+
+		filesystemchanged = false;
+		return;
 	}
 
+	FS_FlushFSHash();
+
 	fs_hash_dups = 0;
 	fs_hash_files = 0;
+	fs_hashvalid = true;
 
 	if (fs_purepaths)
 	{	
 		// Go for the pure paths first.
 		for (search = fs_purepaths; search; search = search->nextpure)
 		{
-			search->funcs->BuildHash(search->handle);
+			search->priority = priority++;
+			FS_HashAddPath(search);
 		}
 	}
 	for (search = fs_searchpaths ; search ; search = search->next)
 	{
-		search->funcs->BuildHash(search->handle);
+		if (search->hash)
+			continue; // pure
+		search->priority = priority++;
+		FS_HashAddPath(search);
 	}
 
 	filesystemchanged = false;
@@ -2255,6 +2491,303 @@ void FS_RebuildFSHash(void)
 	Com_DPrintf("%i unique files, %i duplicates\n", fs_hash_files, fs_hash_dups);
 }
 
+void FS_BuildPackIndex(packindex_t *index, packfile_t *files, int numfiles, qbool caseless)
+{
+	int i;
+
+	index->table = Hash_InitTable(max(16, numfiles));
+	index->buckets = (bucket_t *) Q_malloc(max(1, numfiles) * sizeof(bucket_t));
+	index->caseless = caseless;
+
+	// the first of duplicate names is the one found
+	for (i = 0; i < numfiles; i++)
+	{
+		if (FS_PackIndexFind(index, files[i].name))
+			continue;
+
+		if (caseless)
+			Hash_AddBucketInsensitive(index->table, files[i].name, &files[i], &index->buckets[i]);
+		else
+			Hash_AddBucket(index->table, files[i].name, &files[i], &index->buckets[i]);
+	}
+}
+
+packfile_t *FS_PackIndexFind(packindex_t *index, const char *name)
+{
+	if (index->caseless)
+		return (packfile_t *) Hash_GetInsensitive(index->table, name);
+	else
+		return (packfile_t *) Hash_Get(index->table, (char *) name);
+}
+
+void FS_FreePackIndex(packindex_t *index)
+{
+	if (!index->table)
+		return;
+
+	Hash_FreeTable(index->table);
+	Q_free(index->buckets);
+	index->table = NULL;
+}
+
+//============================================================================
+// Archive directory index
+//============================================================================
+// The directories of the archives we open are kept in fs_index.dat, in the home
+// directory or the ezquake one, so archives which didn't change since the last run
+// can be attached without reading them. Entries are keyed on path, size and mtime.
+
+#define FS_INDEX_VERSION	1
+
+typedef struct fsindex_s {
+	char		path[MAX_OSPATH];
+	unsigned int size, mtime;
+	int			numfiles;
+	packfile_t	*files;
+	qbool		used;			// seen this session
+	struct fsindex_s *next;
+} fsindex_t;
+
+typedef struct {
+	char		id[4];			// "EZFI"
+	int			version;
+	int			filesize;		// sizeof(packfile_t)
+	int			numarchives;
+} fsindexheader_t;
+
+static char fs_indexpath[MAX_OSPATH];
+static hashtable_t *fs_indexhash;
+static fsindex_t *fs_index;
+static qbool fs_indexchanged;
+
+static qbool FS_IndexStat(const char *path, unsigned int *size, unsigned int *mtime)
+{
+	struct stat st;
+
+	if (stat(path, &st) || !(st.st_mode & S_IFREG))
+		return false;
+
+	*size = (unsigned int) st.st_size;
+	*mtime = (unsigned int) st.st_mtime;
+	return true;
+}
+
+static void FS_FreeArchiveIndex(void)
+{
+	fsindex_t *idx, *next;
+
+	for (idx = fs_index; idx; idx = next)
+	{
+		next = idx->next;
+		Q_free(idx->files);
+		Q_free(idx);
+	}
+
+	if (fs_indexhash)
+	{
+		Hash_Flush(fs_indexhash);
+		Hash_FreeTable(fs_indexhash);
+	}
+
+	fs_index = NULL;
+	fs_indexhash = NULL;
+	fs_indexchanged = false;
+}
+
+static void FS_LoadArchiveIndex(void)
+{
+	fsindexheader_t header;
+	fsindex_t *idx;
+	FILE *f;
+	int i, len;
+
+	FS_FreeArchiveIndex();
+
+	if (COM_CheckParm("-nofsindex"))
+	{
+		fs_indexpath[0] = 0;
+		return;
+	}
+
+	if (com_homedir[0])
+		snprintf(fs_indexpath, sizeof(fs_indexpath), "%s/%s", com_homedir, FS_INDEX_FILE);
+	else
+		snprintf(fs_indexpath, sizeof(fs_indexpath), "%s/ezquake/%s", com_basedir, FS_INDEX_FILE);
+
+	fs_indexhash = Hash_InitTable(256);
+
+	if (!(f = fopen(fs_indexpath, "rb")))
+		return;
+
+	if (fread(&header, sizeof(header), 1, f) != 1 || strncmp(header.id, "EZFI", 4)
+		|| header.version != FS_INDEX_VERSION || header.filesize != sizeof(packfile_t))
+	{
+		fclose(f);
+		return;
+	}
+
+	for (i = 0; i < header.numarchives; i++)
+	{
+		idx = (fsindex_t *) Q_calloc(1, sizeof(*idx));
+
+		if (fread(&len, sizeof(len), 1, f) != 1 || len <= 0 || len >= sizeof(idx->path)
+			|| fread(idx->path, len, 1, f) != 1
+			|| fread(&idx->size, sizeof(idx->size), 1, f) != 1
+			|| fread(&idx->mtime, sizeof(idx->mtime), 1, f) != 1
+			|| fread(&idx->numfiles, sizeof(idx->numfiles), 1, f) != 1
+			|| idx->numfiles < 0 || idx->numfiles > 1024 * 1024)
+		{
+			Q_free(idx);
+			break;
+		}
+
+		idx->files = (packfile_t *) Q_malloc(max(1, idx->numfiles) * sizeof(packfile_t));
+		if (idx->numfiles && fread(idx->files, sizeof(packfile_t), idx->numfiles, f) != idx->numfiles)
+		{
+			Q_free(idx->files);
+			Q_free(idx);
+			break;
+		}
+
+		idx->next = fs_index;
+		fs_index = idx;
+		Hash_Add(fs_indexhash, idx->path, idx);
+	}
+
+	fclose(f);
+}
+
+// Drops archives which are gone or changed and weren't seen this session.
+static void FS_SaveArchiveIndex(void)
+{
+	fsindexheader_t header;
+	fsindex_t *idx, **prev;
+	unsigned int size, mtime;
+	char tmppath[MAX_OSPATH];
+	qbool ok;
+	FILE *f;
+	int len;
+
+	if (!fs_indexchanged || !fs_indexpath[0])
+		return;
+
+	memcpy(header.id, "EZFI", 4);
+	header.version = FS_INDEX_VERSION;
+	header.filesize = sizeof(packfile_t);
+	header.numarchives = 0;
+
+	for (prev = &fs_index; (idx = *prev); )
+	{
+		if (!idx->used && (!FS_IndexStat(idx->path, &size, &mtime) || size != idx->size || mtime != idx->mtime))
+		{
+			*prev = idx->next;
+			Q_free(idx->files);
+			Q_free(idx);
+			continue;
+		}
+
+		header.numarchives++;
+		prev = &idx->next;
+	}
+
+	// some of the buckets point to freed entries now
+	Hash_Flush(fs_indexhash);
+	for (idx = fs_index; idx; idx = idx->next)
+		Hash_Add(fs_indexhash, idx->path, idx);
+
+	// written under another name and renamed, so a crash or another client
+	// writing at the same time never leaves half an index behind
+	len = snprintf(tmppath, sizeof(tmppath), "%s.%d", fs_indexpath, (int) getpid());
+	if (len <= 0 || len >= sizeof(tmppath))
+		return;
+	FS_CreatePath(tmppath);
+	if (!(f = fopen(tmppath, "wb")))
+		return;
+
+	ok = fwrite(&header, sizeof(header), 1, f) == 1;
+	for (idx = fs_index; ok && idx; idx = idx->next)
+	{
+		len = strlen(idx->path) + 1;
+		ok = fwrite(&len, sizeof(len), 1, f) == 1
+			&& fwrite(idx->path, len, 1, f) == 1
+			&& fwrite(&idx->size, sizeof(idx->size), 1, f) == 1
+			&& fwrite(&idx->mtime, sizeof(idx->mtime), 1, f) == 1
+			&& fwrite(&idx->numfiles, sizeof(idx->numfiles), 1, f) == 1
+			&& fwrite(idx->files, sizeof(packfile_t), idx->numfiles, f) == idx->numfiles;
+	}
+	ok = !fclose(f) && ok;
+
+	if (ok && rename(tmppath, fs_indexpath))
+	{
+		// windows won't rename over an existing file
+		remove(fs_indexpath);
+		ok = !rename(tmppath, fs_indexpath);
+	}
+
+	if (!ok)
+	{
+		remove(tmppath);
+		return;
+	}
+
+	fs_indexchanged = false;
+}
+
+// Directory of the archive at path as it was the last time, if it didn't change since.
+// The list is the caller's to Q_free.
+packfile_t *FS_IndexedArchive(const char *path, int *numfiles)
+{
+	unsigned int size, mtime;
+	packfile_t *files;
+	fsindex_t *idx;
+
+	if (!fs_indexhash || !(idx = Hash_Get(fs_indexhash, (char *) path)))
+		return NULL;
+
+	if (!FS_IndexStat(path, &size, &mtime) || size != idx->size || mtime != idx->mtime)
+		return NULL;
+
+	idx->used = true;
+	fs_stats.archives++;
+	fs_stats.archives_indexed++;
+
+	files = (packfile_t *) Q_malloc(max(1, idx->numfiles) * sizeof(packfile_t));
+	memcpy(files, idx->files, idx->numfiles * sizeof(packfile_t));
+	*numfiles = idx->numfiles;
+	return files;
+}
+
+// Remembers the directory of an archive read from disk.
+void FS_IndexArchive(const char *path, packfile_t *files, int numfiles)
+{
+	fsindex_t *idx;
+	unsigned int size, mtime;
+
+	fs_stats.archives++;
+
+	if (!fs_indexhash || strlen(path) >= sizeof(idx->path) || !FS_IndexStat(path, &size, &mtime))
+		return; // inside another archive, or no index
+
+	if (!(idx = Hash_Get(fs_indexhash, (char *) path)))
+	{
+		idx = (fsindex_t *) Q_calloc(1, sizeof(*idx));
+		strlcpy(idx->path, path, sizeof(idx->path));
+		idx->next = fs_index;
+		fs_index = idx;
+		Hash_Add(fs_indexhash, idx->path, idx);
+	}
+
+	Q_free(idx->files);
+	idx->files = (packfile_t *) Q_malloc(max(1, numfiles) * sizeof(packfile_t));
+	memcpy(idx->files, files, numfiles * sizeof(packfile_t));
+	idx->numfiles = numfiles;
+	idx->size = size;
+	idx->mtime = mtime;
+	idx->used = true;
+
+	fs_indexchanged = true;
+}
+
 /* ===========
  * FS_FLocateFile
  * ===========
@@ -2267,17 +2800,35 @@ int FS_FLocateFile(const char *filename, FSLF_ReturnType_e returntype, flocation
 {
 	int depth=0, len;
 	searchpath_t	*search;
+	fshash_t		*fh;
+	double start = Sys_DoubleTime();
 
 	void *pf;
 //Com_Printf("Finding %s: ", filename);
 
  	if (fs_cache.value)
 	{
-		if (filesystemchanged)
+		if (filesystemchanged || !fs_hashvalid)
 			FS_RebuildFSHash();
-		pf = Hash_GetInsensitive(filesystemhash, filename);
-		if (!pf)
+		if (!(fh = FS_HashFind(filename)))
 			goto fail;
+		pf = fh->data;
+
+		// we know which path has it, only walk them if asked how deep it is
+		if (returntype == FSLFRT_IFFOUND || returntype == FSLFRT_LENGTH)
+		{
+			search = fh->search;
+			if (!search->funcs->FindFile(search->handle, loc, filename, pf))
+				goto fail;
+			if (loc)
+			{
+				loc->search = search;
+				len = loc->len;
+			}
+			else
+				len = 1;
+			goto out;
+		}
 	}
 	else
 		pf = NULL;
@@ -2338,6 +2889,10 @@ out:
 	else
 		Com_Printf("Failed\n");
 */
+	fs_stats.locates++;
+	fs_stats.locate_misses += (len == -1);
+	fs_stats.locate_time += Sys_DoubleTime() - start;
+
 	if (returntype == FSLFRT_IFFOUND)
 		return len != -1;
 	else if (returntype == FSLFRT_LENGTH)
@@ -3056,6 +3611,7 @@ void FS_ReloadPackFilesFlags(FS_Load_File_Types reloadflags)
 	}
 
 	FS_FlushFSHash();
+	FSOS_FlushDirCache();
 
 	oldpaths = fs_searchpaths;
 	fs_searchpaths = NULL;
@@ -3092,6 +3648,8 @@ void FS_ReloadPackFilesFlags(FS_Load_File_Types reloadflags)
 
 	if (!fs_base_searchpaths)
 		fs_base_searchpaths = fs_searchpaths;
+
+	FS_SaveArchiveIndex();
 }
 
 void FS_UnloadPackFiles(void)
@@ -3127,15 +3685,18 @@ void FS_ListFiles_f(void)
 	}
 	else {
 		int i;
+		bucket_t *b;
 		char *ext = Cmd_Argv(1);
 		size_t ext_len = strlen(ext);
 
-		for (i = 0; i < filesystemhash->numbuckets; i++) {
-			bucket_t *b = filesystemhash->bucket[i];
+		if (filesystemchanged || !fs_hashvalid)
+			FS_RebuildFSHash();
+
+		for (i = 0; (b = Hash_NextBucket(filesystemhash, &i)); ) {
 			while (b) {
 				char *key = b->keystring;
 				size_t len = strlen(key);
-				if (strcmp(key+len-ext_len, ext) == 0) {
+				if (strcmp(key+len-ext_len, ext) == 0 && FS_HashFind(key) == (fshash_t *) b) {
 					Com_Printf("%s\n", b->keystring);
 				}
 				b = b->next;
@@ -143,6 +143,7 @@ typedef enum
 	G_SETPAUSE,
 	G_SETUSERINFO,
 	G_MOVETOGOAL,
+	G_SETANTILAG,
 } gameImport_t;
 
 // !!! new things comes to end of list !!!
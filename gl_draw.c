@@ -147,7 +147,7 @@ static void Apply_OnChange_gl_smoothfont(int value)
 {
 	int i;
 
-	if (!char_textures[0])
+	if (!char_textures[0] || cls.headless)
 		return;
 
 	for (i = 0; i < MAX_CHARSETS; i++)
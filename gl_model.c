@@ -31,6 +31,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "crc.h"
 #include "fmod.h"
 #include "utils.h"
+#include "prefetch.h"
 
 
 //VULT MODELS
@@ -193,6 +194,8 @@ void Mod_TouchModels (void)
 }
 
 //Loads a model into the cache
+static fs_mapping_t mod_map; // bsp file view, only alive while Mod_LoadBrushModel runs
+
 model_t *Mod_LoadModel (model_t *mod, qbool crash) {
 	void *d;
 	unsigned *buf;
@@ -221,7 +224,10 @@ model_t *Mod_LoadModel (model_t *mod, qbool crash) {
 		buf = (unsigned *) FS_LoadTempFile (newname, &filesize);
 	}
 
-	// load the file
+	// load the file, bsp files are parsed straight from the mapped file
+	FS_UnmapFile (&mod_map);
+	if (!buf && namelen >= 4 && !strcmp (mod->name + namelen - 4, ".bsp"))
+		buf = (unsigned *) FS_MapFile (mod->name, &filesize, &mod_map);
 	if (!buf)
 		buf = (unsigned *) FS_LoadTempFile (mod->name, &filesize);
 	if (!buf) {
@@ -256,6 +262,8 @@ model_t *Mod_LoadModel (model_t *mod, qbool crash) {
 		break;
 	}
 
+	FS_UnmapFile (&mod_map);
+
 	return mod;
 }
 
@@ -452,6 +460,25 @@ void R_LoadBrushModelTextures (model_t *m)
 
 //	Com_Printf("lm %d %s\n", lightmode, loadmodel->name);
 
+	// get the external textures decoding in the background, the loop below picks them up
+	if (Prefetch_Active()) {
+		GL_BeginPrefetch();
+		for (i = 0; i < loadmodel->numtextures; i++)
+		{
+			tx = loadmodel->textures[i];
+			if (!tx || tx->loaded)
+				continue;
+
+			if (loadmodel->isworldmodel && loadmodel->bspversion != HL_BSPVERSION && ISSKYTEX(tx->name))
+				continue;
+
+			Mod_LoadExternalTexture(tx, TEX_MIPMAP, 0);
+			tx->gl_texturenum = tx->fb_texturenum = 0;
+			tx->isLumaTexture = false;
+		}
+		GL_EndPrefetch();
+	}
+
 	for (i = 0; i < loadmodel->numtextures; i++)
 	{
 		tx = loadmodel->textures[i];
@@ -2035,7 +2035,8 @@ void R_Init(void)
 
 	R_InitOtherTextures (); // safe re-init
 
-	R_InitBloomTextures();
+	if (!cls.headless)
+		R_InitBloomTextures();
 }
 
 void R_RenderScene(void)
@@ -2096,7 +2097,8 @@ void OnChange_gl_clearColor(cvar_t *v, char *s, qbool *cancel) {
 	clearColor[1] = color[1] / 255.0;
 	clearColor[2] = color[2] / 255.0;
 
-	glClearColor (clearColor[0], clearColor[1], clearColor[2], 1.0);
+	if (!cls.headless)
+		glClearColor (clearColor[0], clearColor[1], clearColor[2], 1.0);
 }
 
 void R_Clear(void)
@@ -100,7 +100,7 @@ void R_TranslatePlayerSkin (int playernum) {
 	}
 
 	player = &cl.players[playernum];
-	if (!player->name[0])
+	if (!player->name[0] || cls.headless)
 		return;
 
 	strlcpy(s, Skin_FindName(player), sizeof(s));
@@ -296,7 +296,8 @@ void R_NewMap (qbool vid_restart) {
 		HUD_NewRadarMap();			// Need to reload the radar picture.
 	}
 
-	GL_BuildLightmaps ();
+	if (!cls.headless)
+		GL_BuildLightmaps ();
 
 	if (!vid_restart) {
 		// identify sky texture
@@ -1822,29 +1822,50 @@ void QMB_StaticBubble (entity_t *ent) {
 //writing anything else for it.
 void ParticleFirePool (vec3_t);
 extern cvar_t tei_lavafire;
-void WeatherEffect (void)
+#define MAX_WEATHER_TRACES	256
+
+// Picks count random spots around the view and traces each one dz units
+// straight up or down in a single batch, leaving the impact points in impacts.
+static int WeatherTraces (int count, float dz, vec3_t *impacts)
 {
-	vec3_t org, start, impact, normal;
+	static vec3_t starts[MAX_WEATHER_TRACES], ends[MAX_WEATHER_TRACES];
+	static trace_t traces[MAX_WEATHER_TRACES];
 	int i;
-	col_t colour = {128, 128, 128, 75};
 
-	if ((int) amf_weather_rain.value) {
-		for (i = 0; i <= (int) amf_weather_rain.value; i++) {
-			VectorCopy(r_refdef.vieworg, org);
-			org[0] = org[0] + (rand() % 3000) - 1500;
-			org[1] = org[1] + (rand() % 3000) - 1500;
-			VectorCopy(org, start);
-			org[2] = org[2] + 15000;
+	count = min (count, MAX_WEATHER_TRACES);
 
-			//Trace a line straight up, get the impact location
+	for (i = 0; i < count; i++) {
+		VectorCopy (r_refdef.vieworg, starts[i]);
+		starts[i][0] = starts[i][0] + (rand() % 3000) - 1500;
+		starts[i][1] = starts[i][1] + (rand() % 3000) - 1500;
+		VectorCopy (starts[i], ends[i]);
+		ends[i][2] = ends[i][2] + dz;
+	}
+
+	PM_TraceLineBatch (count, starts, ends, traces);
 
-			//trace up slowly until we are in sky
-			TraceLineN (start, org, impact, normal);
+	for (i = 0; i < count; i++)
+		VectorCopy (traces[i].endpos, impacts[i]);
+
+	return count;
+}
 
+void WeatherEffect (void)
+{
+	static vec3_t impacts[MAX_WEATHER_TRACES];
+	vec3_t org;
+	int i, count;
+	col_t colour = {128, 128, 128, 75};
+
+	if ((int) amf_weather_rain.value) {
+		//Trace lines straight up, get the impact locations
+		count = WeatherTraces ((int) amf_weather_rain.value + 1, 15000, impacts);
+
+		for (i = 0; i < count; i++) {
 			//fixme: see is surface above has SURF_DRAWSKY (we'll come back to that, when the important stuff is done fist, eh?)
 			//if (TruePointContents (impact) == CONTENTS_SKY && trace) {
-			if (Mod_PointInLeaf(impact, cl.worldmodel)->contents == CONTENTS_SKY) {
-				VectorCopy (impact, org);
+			if (Mod_PointInLeaf(impacts[i], cl.worldmodel)->contents == CONTENTS_SKY) {
+				VectorCopy (impacts[i], org);
 				org[2] = org[2] - 1;
 				AddParticle (p_rain, org, 1, 1, 15, colour, zerodir);
 			}
@@ -1855,18 +1876,12 @@ void WeatherEffect (void)
 	//Tei, lavafire on 2 or superior 
 	// this can be more better for some users than "eshaders"
 	if (tei_lavafire.value > 2) {
-		for (i = 0; i < (int) tei_lavafire.value; i++) {
-			VectorCopy( r_refdef.vieworg, org);
-			org[0] = org[0] + (rand() % 3000) - 1500;
-			org[1] = org[1] + (rand() % 3000) - 1500;
-			VectorCopy(org, start);
-			org[2] = org[2] - 15000;
-
-			TraceLineN (start, org, impact, normal);
+		count = WeatherTraces ((int) tei_lavafire.value, -15000, impacts);
 
+		for (i = 0; i < count; i++) {
 			//if (TruePointContents (impact) == CONTENTS_LAVA && trace) {
-			if (Mod_PointInLeaf(impact, cl.worldmodel)->contents == CONTENTS_LAVA) {
-				ParticleFirePool (impact);
+			if (Mod_PointInLeaf(impacts[i], cl.worldmodel)->contents == CONTENTS_LAVA) {
+				ParticleFirePool (impacts[i]);
 			}
 		}
 	}
@@ -25,6 +25,9 @@ $Id: gl_texture.c,v 1.44 2007-10-05 19:06:24 johnnycz Exp $
 #include "image.h"
 #include "gl_model.h"
 #include "gl_local.h"
+#include "hash.h"
+#include "vfs.h"
+#include "prefetch.h"
 
 
 void OnChange_gl_max_size (cvar_t *var, char *string, qbool *cancel);
@@ -156,6 +159,9 @@ void OnChange_gl_texturemode (cvar_t *var, char *string, qbool *cancel)
 		return;
 	}
 
+	if (cls.headless)
+		return;
+
 	// Make sure we set the proper texture filters for textures.
 	for (i = 0, glt = gltextures; i < numgltextures; i++, glt++)
 	{
@@ -509,7 +515,8 @@ int GL_LoadTexture (char *identifier, int width, int height, byte *data, int mod
 					crc == glt->crc && glt->bpp == bpp &&
 					(mode & ~(TEX_COMPLAIN | TEX_NOSCALE)) == (glt->texmode & ~(TEX_COMPLAIN | TEX_NOSCALE)))
 				{
-					GL_Bind(gltextures[i].texnum);
+					if (!cls.headless)
+						GL_Bind(gltextures[i].texnum);
 					return gltextures[i].texnum;
 				} 
 				else 
@@ -555,6 +562,10 @@ int GL_LoadTexture (char *identifier, int width, int height, byte *data, int mod
 	if (bpp == 4 && fs_netpath[0])
 		glt->pathname = Q_strdup(fs_netpath);
 
+	// No GL context under -benchmark, the texture only gets its texnum.
+	if (cls.headless)
+		return glt->texnum;
+
 	// Tell OpenGL the texnum of the texture before uploading it.
 	GL_Bind(glt->texnum);
 
@@ -644,6 +655,47 @@ static gltexture_t *current_texture = NULL;
 	}
 
 
+typedef byte *(*image_loader_t) (vfsfile_t *v, const char *path, int matchwidth, int matchheight, int *real_width, int *real_height);
+
+// External image formats, in the order GL_LoadImagePixels and GL_PrefetchImage look for them.
+static const struct {
+	char			*ext;
+	image_loader_t	load;
+} image_loaders[] = {
+	{ "tga", Image_LoadTGA },
+	#ifdef WITH_PNG
+	{ "png", Image_LoadPNG },
+	#endif
+	#ifdef WITH_JPEG
+	{ "jpg", Image_LoadJPEG },
+	#endif
+	{ "pcx", Image_LoadPCX_As32Bit },
+};
+
+#define NUM_IMAGE_LOADERS	(sizeof(image_loaders) / sizeof(image_loaders[0]))
+
+// Uses the result of GL_PrefetchImage if there is one, it's only made for the plain image size.
+static byte *GL_LoadImageFile (vfsfile_t *f, const char *name, image_loader_t load, int matchwidth, int matchheight, int *real_width, int *real_height)
+{
+	prefetch_t *job;
+	byte *data;
+
+	if (matchwidth || matchheight || !(job = Prefetch_Take(name)))
+		return load (f, name, matchwidth, matchheight, real_width, real_height);
+
+	VFS_CLOSE(f);
+
+	data = job->data;
+	job->data = NULL;
+	if (data && real_width)
+		*real_width = job->width;
+	if (data && real_height)
+		*real_height = job->height;
+	Prefetch_Free(job);
+
+	return data;
+}
+
 static qbool CheckTextureLoaded(int mode) 
 {
 	int scaled_width, scaled_height;
@@ -665,6 +717,7 @@ byte *GL_LoadImagePixels (const char *filename, int matchwidth, int matchheight,
 	char basename[MAX_QPATH], name[MAX_QPATH];
 	byte *c, *data = NULL;
 	vfsfile_t *f;
+	int i;
 
 	COM_StripExtension(filename, basename);
 	for (c = (byte *) basename; *c; c++)
@@ -673,8 +726,7 @@ byte *GL_LoadImagePixels (const char *filename, int matchwidth, int matchheight,
 			*c = '#';
 	}
 
-	snprintf (name, sizeof(name), "%s.link", basename);
-	if ((f = FS_OpenVFS(name, "rb", FS_ANY))) 
+	if (snprintf (name, sizeof(name), "%s.link", basename) < sizeof(name) && (f = FS_OpenVFS(name, "rb", FS_ANY))) 
 	{
 		char link[128];
 		int len;
@@ -699,81 +751,143 @@ byte *GL_LoadImagePixels (const char *filename, int matchwidth, int matchheight,
 		if ((f = FS_OpenVFS(name, "rb", FS_ANY))) 
 		{
        		CHECK_TEXTURE_ALREADY_LOADED;
-       		if( !data && !strcasecmp(link + len - 3, "tga") )
+			for (i = 0; i < NUM_IMAGE_LOADERS; i++)
 			{
-				data = Image_LoadTGA (f, name, matchwidth, matchheight, real_width, real_height);
-			}
+				// TEX_NO_PCX - preventing loading skins here
+				if ((mode & TEX_NO_PCX) && image_loaders[i].load == Image_LoadPCX_As32Bit)
+					continue;
 
-			#ifdef WITH_PNG
-       		if( !data && !strcasecmp(link + len - 3, "png") )
-			{
-       			data = Image_LoadPNG (f, name, matchwidth, matchheight, real_width, real_height);
-			}
-			#endif // WITH_PNG
-			
-			#ifdef WITH_JPEG
-       		if( !data && !strcasecmp(link + len - 3, "jpg") )
-			{
-				data = Image_LoadJPEG (f, name, matchwidth, matchheight, real_width, real_height);
+				if (!strcasecmp(link + len - 3, image_loaders[i].ext))
+				{
+					data = image_loaders[i].load (f, name, matchwidth, matchheight, real_width, real_height);
+					break;
+				}
 			}
-			#endif // WITH_JPEG
 
-			// TEX_NO_PCX - preventing loading skins here
-       		if( !(mode & TEX_NO_PCX) && !data && !strcasecmp(link + len - 3, "pcx") )
-			{
-				data = Image_LoadPCX_As32Bit (f, name, matchwidth, matchheight, real_width, real_height);
-			}
+			if (i == NUM_IMAGE_LOADERS)
+				VFS_CLOSE(f);
 
        		if ( data )
 				return data;
 		}
 	}
 
-	snprintf (name, sizeof(name), "%s.tga", basename);
-	if ((f = FS_OpenVFS(name, "rb", FS_ANY))) 
+	for (i = 0; i < NUM_IMAGE_LOADERS; i++)
 	{
-		CHECK_TEXTURE_ALREADY_LOADED;
-		if ((data = Image_LoadTGA (f, name, matchwidth, matchheight, real_width, real_height)))
-			return data;
+		// TEX_NO_PCX - preventing loading skins here.
+		if ((mode & TEX_NO_PCX) && image_loaders[i].load == Image_LoadPCX_As32Bit)
+			continue;
+
+		if (snprintf (name, sizeof(name), "%s.%s", basename, image_loaders[i].ext) >= sizeof(name))
+			continue;
+
+		if ((f = FS_OpenVFS(name, "rb", FS_ANY))) 
+		{
+			CHECK_TEXTURE_ALREADY_LOADED;
+			if ((data = GL_LoadImageFile (f, name, image_loaders[i].load, matchwidth, matchheight, real_width, real_height)))
+				return data;
+		}
 	}
 
-	#ifdef WITH_PNG
-	snprintf (name, sizeof(name), "%s.png", basename);
-	if ((f = FS_OpenVFS(name, "rb", FS_ANY))) 
+	if (mode & TEX_COMPLAIN) 
 	{
-		CHECK_TEXTURE_ALREADY_LOADED;
-		if ((data = Image_LoadPNG (f, name, matchwidth, matchheight, real_width, real_height)))
-			return data;
+		if (!no24bit)
+			Com_Printf_State(PRINT_FAIL, "Couldn't load %s image\n", COM_SkipPath(filename));
 	}
-	#endif // WITH_PNG
 
-	#ifdef WITH_JPEG
-	snprintf (name, sizeof(name), "%s.jpg", basename);
-	if ((f = FS_OpenVFS(name, "rb", FS_ANY))) 
+	return NULL;
+}
+
+static qbool gl_prefetching;
+
+// Between these, GL_LoadTextureImage only queues the image for decoding in the background
+// and tells if it was found, so callers can be run once to get their files going.
+void GL_BeginPrefetch (void)
+{
+	gl_prefetching = true;
+}
+
+void GL_EndPrefetch (void)
+{
+	gl_prefetching = false;
+}
+
+static void GL_DecodeImage (prefetch_t *job)
+{
+	image_loader_t load = *(image_loader_t *) job->param;
+
+	// The loader closes the file, which frees the buffer.
+	job->data = load (FSMMAP_OpenVFS(job->file, job->filelen), job->name, 0, 0, &job->width, &job->height);
+}
+
+// Reads the file GL_LoadImagePixels would find first and has it decoded on a worker thread.
+// Only the decoding moves there, resampling and the upload are done by GL_LoadTexture on the
+// main thread as before. Textures which are loaded from the same file already are skipped.
+static int GL_PrefetchImage (const char *filename, char *identifier, int mode)
+{
+	char basename[MAX_QPATH], name[MAX_QPATH];
+	image_loader_t *param;
+	gltexture_t *gltexture;
+	byte *c, *file;
+	vfsfile_t *f;
+	qbool loaded;
+	int i, len;
+
+	COM_StripExtension(filename, basename);
+	for (c = (byte *) basename; *c; c++)
 	{
-		CHECK_TEXTURE_ALREADY_LOADED;
-		if ((data = Image_LoadJPEG (f, name, matchwidth, matchheight, real_width, real_height)))
-			return data;
+		if (*c == '*')
+			*c = '#';
 	}
-	#endif // WITH_JPEG
 
-	snprintf (name, sizeof(name), "%s.pcx", basename);
-	
-	// TEX_NO_PCX - preventing loading skins here.
-	if (!(mode & TEX_NO_PCX) && (f = FS_OpenVFS(name, "rb", FS_ANY))) 
+	// Links are left to GL_LoadImagePixels.
+	if (snprintf (name, sizeof(name), "%s.link", basename) < sizeof(name) && (f = FS_OpenVFS(name, "rb", FS_ANY)))
 	{
-		CHECK_TEXTURE_ALREADY_LOADED;
-		if ((data = Image_LoadPCX_As32Bit (f, name, matchwidth, matchheight, real_width, real_height)))
-			return data;
+		VFS_CLOSE(f);
+		return 1;
 	}
 
-	if (mode & TEX_COMPLAIN) 
+	gltexture = GL_FindTexture(identifier);
+
+	for (i = 0; i < NUM_IMAGE_LOADERS; i++)
 	{
-		if (!no24bit)
-			Com_Printf_State(PRINT_FAIL, "Couldn't load %s image\n", COM_SkipPath(filename));
+		// TEX_NO_PCX - preventing loading skins here.
+		if ((mode & TEX_NO_PCX) && image_loaders[i].load == Image_LoadPCX_As32Bit)
+			continue;
+
+		if (snprintf (name, sizeof(name), "%s.%s", basename, image_loaders[i].ext) >= sizeof(name))
+			continue;
+
+		if (!(f = FS_OpenVFS(name, "rb", FS_ANY)))
+			continue;
+
+		// the check GL_LoadImagePixels will make, fs_netpath is set by the open
+		current_texture = gltexture;
+		loaded = CheckTextureLoaded(mode);
+		current_texture = NULL;
+		if (loaded)
+		{
+			VFS_CLOSE(f);
+			return 1;
+		}
+
+		len = VFS_GETLEN(f);
+		file = Q_malloc(len + 1);
+		if (VFS_READ(f, file, len, NULL) != len)
+		{
+			VFS_CLOSE(f);
+			Q_free(file);
+			return 0;
+		}
+		VFS_CLOSE(f);
+
+		param = Q_malloc(sizeof(*param));
+		*param = image_loaders[i].load;
+		Prefetch_Add(name, GL_DecodeImage, param, file, len);
+		return 1;
 	}
 
-	return NULL;
+	return 0;
 }
 
 int GL_LoadTexturePixels (byte *data, char *identifier, int width, int height, int mode) 
@@ -828,6 +942,9 @@ int GL_LoadTextureImage (char *filename, char *identifier, int matchwidth, int m
 	if (!identifier)
 		identifier = filename;
 
+	if (gl_prefetching)
+		return Prefetch_Active() ? GL_PrefetchImage (filename, identifier, mode) : 0;
+
 	gltexture = current_texture = GL_FindTexture(identifier);
 
 	if (!(data = GL_LoadImagePixels (filename, matchwidth, matchheight, mode, &image_width, &image_height))) 
@@ -1033,7 +1150,10 @@ void GL_Texture_Init(void)
     Cvar_Register(&gl_no24bit);
 	Cvar_Register(&gl_wicked_luma_level);
 
-	glGetIntegerv(GL_MAX_TEXTURE_SIZE, (GLint *)&gl_max_size_default);
+	if (cls.headless)
+		gl_max_size_default = 2048; // Nothing is uploaded, any size will do.
+	else
+		glGetIntegerv(GL_MAX_TEXTURE_SIZE, (GLint *)&gl_max_size_default);
 	Cvar_SetDefault(&gl_max_size, gl_max_size_default);
 
 	// This way user can specifie gl_max_size in his cfg.
@@ -53,6 +53,8 @@ int GL_LoadPicTexture (const char *name, mpic_t *pic, byte *data);
 byte *GL_LoadImagePixels (const char *filename, int matchwidth, int matchheight, int mode, int *real_width, int *real_height);
 int GL_LoadTexturePixels (byte *, char *, int, int, int);
 int GL_LoadTextureImage (char * , char *, int, int, int);
+void GL_BeginPrefetch (void);
+void GL_EndPrefetch (void);
 mpic_t *GL_LoadPicImage (const char *, char *, int, int, int);
 int GL_LoadCharsetImage (char *, char *, int);
 
@@ -25,14 +25,44 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "q_shared.h"
 #include "hash.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define HASH_SSE2
+#endif
+
+#define HASH_GROUP		16		// control bytes tested at once
+#define HASH_EMPTY		0x80
+#define HASH_DELETED	0xFE	// both have the top bit set, used slots don't
+#define HASH_H1(h)		((h) >> 7)
+#define HASH_H2(h)		((h) & 0x7F)
+
+typedef enum {
+	HASH_CASE,
+	HASH_NOCASE,
+	HASH_POINTER
+} hashmode_t;
+
+static void Hash_Alloc(hashtable_t *table, int size)
+{
+	table->size = size;
+	table->count = 0;
+	table->deleted = 0;
+	table->ctrl = (unsigned char *) Q_malloc(size);
+	table->slots = (hashslot_t *) Q_malloc(size * sizeof(hashslot_t));
+	memset(table->ctrl, HASH_EMPTY, size);
+}
+
+// numbucks is how many keys are expected, the table grows when there are more
 hashtable_t *Hash_InitTable(int numbucks)
 {
 	hashtable_t *table;
+	int size = HASH_GROUP;
 
-	table = Q_malloc(sizeof(*table));
+	while (size / 8 * 7 < numbucks)
+		size <<= 1;
 
-	table->bucket = (bucket_t**)Q_calloc(numbucks, sizeof(bucket_t *));
-	table->numbuckets = numbucks;
+	table = Q_malloc(sizeof(*table));
+	Hash_Alloc(table, size);
 
 	return table;
 }
@@ -45,21 +75,31 @@ hashtable_t *Hash_InitTable(int numbucks)
  * it works better than many other constants, prime or not) has never been 
  * adequately explained.
  */
-int Hash_Key(char *name, int modulus) {
-	unsigned int key = 5381;
+static unsigned int Hash_String(const char *name)
+{
+	unsigned int key;
 
 	for (key = 5381; *name; name++)
 		key = ((key << 5) + key) + *name; /* key * 33 + c */
 
-	return (int) (key % modulus);
+	return key;
 }
-int Hash_KeyInsensitive(const char *name, int modulus) {
-	unsigned int key = 5381;
+// folds A-Z only, same as strcasecmp does in the C locale
+static unsigned int Hash_StringInsensitive(const char *name)
+{
+	unsigned int key, c;
 
-	for (key = 5381; *name; name++)
-		key = ((key << 5) + key) + tolower(*name); /* key * 33 + c */
+	for (key = 5381; (c = (unsigned char) *name); name++)
+		key = ((key << 5) + key) + (c - 'A' < 26 ? c + 'a' - 'A' : c); /* key * 33 + c */
+
+	return key;
+}
 
-	return (int) (key % modulus);
+int Hash_Key(char *name, int modulus) {
+	return (int) (Hash_String(name) % modulus);
+}
+int Hash_KeyInsensitive(const char *name, int modulus) {
+	return (int) (Hash_StringInsensitive(name) % modulus);
 }
 
 #if 0
@@ -86,263 +126,372 @@ int Hash_KeyInsensitive(char *name, int modulus)
 }
 #endif
 
-void *Hash_Get(hashtable_t *table, char *name)
+// djb2 is weak in the low bits, which pick the group, and in the 7 bits kept in ctrl
+static unsigned int Hash_Mix(unsigned int h)
 {
-	int bucknum = Hash_Key(name, table->numbuckets);
-	bucket_t *buck;
+	h ^= h >> 16;
+	h *= 0x85EBCA6B;
+	h ^= h >> 13;
+	h *= 0xC2B2AE35;
+	h ^= h >> 16;
 
-	buck = table->bucket[bucknum];
+	return h;
+}
 
-	while(buck)
-	{
-		if (!STRCMP(name, buck->keystring))
-			return buck->data;
+static unsigned int Hash_Of(const char *name, hashmode_t mode)
+{
+	unsigned long long p;
+
+	switch (mode) {
+	case HASH_CASE:
+		return Hash_Mix(Hash_String(name));
+	case HASH_NOCASE:
+		return Hash_Mix(Hash_StringInsensitive(name));
+	default:
+		p = (unsigned long long) (size_t) name;
+		return Hash_Mix((unsigned int) (p ^ (p >> 32)));
+	}
+}
 
-		buck = buck->next;
+static qbool Hash_Equal(const char *key, const char *name, hashmode_t mode)
+{
+	switch (mode) {
+	case HASH_CASE:
+		return !STRCMP(name, key);
+	case HASH_NOCASE:
+		return !strcasecmp(name, key);
+	default:
+		return key == name;
 	}
-	return NULL;
 }
-void *Hash_GetInsensitive(hashtable_t *table, const char *name)
+
+// bit i is set when ctrl[i] == c
+static unsigned int Hash_MatchGroup(const unsigned char *ctrl, unsigned char c)
 {
-	int bucknum = Hash_KeyInsensitive(name, table->numbuckets);
-	bucket_t *buck;
+#ifdef HASH_SSE2
+	return (unsigned int) _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) ctrl), _mm_set1_epi8((char) c)));
+#else
+	unsigned int mask = 0;
+	int i;
 
-	buck = table->bucket[bucknum];
+	for (i = 0; i < HASH_GROUP; i++)
+		if (ctrl[i] == c)
+			mask |= 1 << i;
+
+	return mask;
+#endif
+}
+
+// bit i is set when slot i is empty or deleted
+static unsigned int Hash_MatchFree(const unsigned char *ctrl)
+{
+#ifdef HASH_SSE2
+	return (unsigned int) _mm_movemask_epi8(_mm_loadu_si128((const __m128i *) ctrl));
+#else
+	unsigned int mask = 0;
+	int i;
 
-	while(buck)
+	for (i = 0; i < HASH_GROUP; i++)
+		if (ctrl[i] & 0x80)
+			mask |= 1 << i;
+
+	return mask;
+#endif
+}
+
+static int Hash_LowestBit(unsigned int mask)
+{
+#ifdef __GNUC__
+	return __builtin_ctz(mask);
+#else
+	int i;
+
+	for (i = 0; !(mask & 1); i++)
+		mask >>= 1;
+
+	return i;
+#endif
+}
+
+// Groups are probed quadratically, which visits all of them as their number is a
+// power of two. A group with an empty slot was never full so no key went past it.
+static int Hash_FindSlot(hashtable_t *table, unsigned int hash, const char *name, hashmode_t mode)
+{
+	int groupmask = table->size / HASH_GROUP - 1;
+	int group = HASH_H1(hash) & groupmask, stride = 0, slot;
+	const unsigned char *ctrl;
+	unsigned int match;
+
+	for (;;)
 	{
-		if (!strcasecmp(name, buck->keystring))
-			return buck->data;
+		ctrl = table->ctrl + group * HASH_GROUP;
 
-		buck = buck->next;
+		for (match = Hash_MatchGroup(ctrl, HASH_H2(hash)); match; match &= match - 1)
+		{
+			slot = group * HASH_GROUP + Hash_LowestBit(match);
+			if (table->slots[slot].hash == hash && Hash_Equal(table->slots[slot].bucket->keystring, name, mode))
+				return slot;
+		}
+
+		if (Hash_MatchGroup(ctrl, HASH_EMPTY))
+			return -1;
+
+		group = (group + ++stride) & groupmask;
 	}
-	return NULL;
 }
-void *Hash_GetKey(hashtable_t *table, char *key)
+
+static void Hash_FillSlot(hashtable_t *table, unsigned int hash, bucket_t *buck)
+{
+	int groupmask = table->size / HASH_GROUP - 1;
+	int group = HASH_H1(hash) & groupmask, stride = 0, slot;
+	unsigned int match;
+
+	while (!(match = Hash_MatchFree(table->ctrl + group * HASH_GROUP)))
+		group = (group + ++stride) & groupmask;
+
+	slot = group * HASH_GROUP + Hash_LowestBit(match);
+	if (table->ctrl[slot] == HASH_DELETED)
+		table->deleted--;
+	table->ctrl[slot] = HASH_H2(hash);
+	table->slots[slot].hash = hash;
+	table->slots[slot].bucket = buck;
+	table->count++;
+}
+
+static void Hash_Resize(hashtable_t *table, int size)
 {
-	int bucknum = ((long) key) % table->numbuckets;
-	bucket_t *buck;
+	unsigned char *ctrl = table->ctrl;
+	hashslot_t *slots = table->slots;
+	int i, oldsize = table->size;
 
-	buck = table->bucket[bucknum];
+	Hash_Alloc(table, size);
 
-	while(buck)
+	for (i = 0; i < oldsize; i++)
 	{
-		if (buck->keystring == key)
-			return buck->data;
+		if (!(ctrl[i] & 0x80))
+			Hash_FillSlot(table, slots[i].hash, slots[i].bucket);
+	}
 
-		buck = buck->next;
+	Q_free(ctrl);
+	Q_free(slots);
+}
+
+static bucket_t *Hash_Insert(hashtable_t *table, hashmode_t mode, bucket_t *buck)
+{
+	unsigned int hash = Hash_Of(buck->keystring, mode);
+	int slot = Hash_FindSlot(table, hash, buck->keystring, mode);
+
+	if (slot >= 0)
+	{
+		// newest first, like the chains used to be
+		buck->next = table->slots[slot].bucket;
+		table->slots[slot].bucket = buck;
+		return buck;
 	}
-	return NULL;
+
+	// keep at most 7/8 of the slots taken so probes end soon, deleted ones are
+	// dropped by rebuilding at the same size unless it's half full anyway
+	if ((table->count + table->deleted + 1) > table->size / 8 * 7)
+		Hash_Resize(table, (table->count + 1) * 2 > table->size / 8 * 7 ? table->size * 2 : table->size);
+
+	buck->next = NULL;
+	Hash_FillSlot(table, hash, buck);
+
+	return buck;
 }
-void *Hash_GetNext(hashtable_t *table, char *name, void *old)
+
+static bucket_t *Hash_Lookup(hashtable_t *table, const char *name, hashmode_t mode)
+{
+	int slot = Hash_FindSlot(table, Hash_Of(name, mode), name, mode);
+
+	return slot < 0 ? NULL : table->slots[slot].bucket;
+}
+
+// Takes buck out of the slot holding key, which is freed when it was the last entry.
+static void Hash_Unlink(hashtable_t *table, const char *key, hashmode_t mode, bucket_t *buck)
 {
-	int bucknum = Hash_Key(name, table->numbuckets);
-	bucket_t *buck;
+	int slot = Hash_FindSlot(table, Hash_Of(key, mode), key, mode);
+	bucket_t **link;
 
-	buck = table->bucket[bucknum];
+	if (slot < 0)
+		return;
 
-	while(buck)
+	for (link = &table->slots[slot].bucket; *link; link = &(*link)->next)
 	{
-		if (!STRCMP(name, buck->keystring))
+		if (*link == buck)
 		{
-			if (buck->data == old)	//found the old one
-				break;
+			*link = buck->next;
+			break;
 		}
-
-		buck = buck->next;
 	}
-	if (!buck)
-		return NULL;
 
-	buck = buck->next;//don't return old
-	while(buck)
-	{
-		if (!STRCMP(name, buck->keystring))
-			return buck->data;
+	if (table->slots[slot].bucket)
+		return;
 
-		buck = buck->next;
+	table->count--;
+	if (Hash_MatchGroup(table->ctrl + (slot & ~(HASH_GROUP - 1)), HASH_EMPTY))
+	{
+		table->ctrl[slot] = HASH_EMPTY;
+	}
+	else
+	{
+		table->ctrl[slot] = HASH_DELETED;
+		table->deleted++;
 	}
-	return NULL;
 }
-void *Hash_GetNextInsensitive(hashtable_t *table, char *name, void *old)
+
+void *Hash_Get(hashtable_t *table, char *name)
 {
-	int bucknum = Hash_KeyInsensitive(name, table->numbuckets);
-	bucket_t *buck;
+	bucket_t *buck = Hash_Lookup(table, name, HASH_CASE);
 
-	buck = table->bucket[bucknum];
+	return buck ? buck->data : NULL;
+}
+void *Hash_GetInsensitive(hashtable_t *table, const char *name)
+{
+	bucket_t *buck = Hash_Lookup(table, name, HASH_NOCASE);
 
-	while(buck)
-	{
-		if (!STRCMP(name, buck->keystring))
-		{
-			if (buck->data == old)	//found the old one
-				break;
-		}
+	return buck ? buck->data : NULL;
+}
+void *Hash_GetKey(hashtable_t *table, char *key)
+{
+	bucket_t *buck = Hash_Lookup(table, key, HASH_POINTER);
 
+	return buck ? buck->data : NULL;
+}
+// Newest entry of a key added with one of the Insensitive functions, the others
+// with the same key follow through ->next, newest first.
+bucket_t *Hash_GetBucketInsensitive(hashtable_t *table, const char *name)
+{
+	return Hash_Lookup(table, name, HASH_NOCASE);
+}
+static void *Hash_GetNextEx(hashtable_t *table, char *name, void *old, hashmode_t mode)
+{
+	bucket_t *buck = Hash_Lookup(table, name, mode);
+
+	while (buck && buck->data != old)	//find the old one
 		buck = buck->next;
-	}
-	if (!buck)
+
+	if (!buck || !buck->next)	//don't return old
 		return NULL;
 
-	buck = buck->next;//don't return old
-	while(buck)
+	return buck->next->data;
+}
+void *Hash_GetNext(hashtable_t *table, char *name, void *old)
+{
+	return Hash_GetNextEx(table, name, old, HASH_CASE);
+}
+void *Hash_GetNextInsensitive(hashtable_t *table, char *name, void *old)
+{
+	return Hash_GetNextEx(table, name, old, HASH_NOCASE);
+}
+
+// Walks the table, start with *slot at 0. Returns the newest entry of each key,
+// the older ones follow through ->next.
+bucket_t *Hash_NextBucket(hashtable_t *table, int *slot)
+{
+	while (*slot < table->size)
 	{
-		if (!STRCMP(name, buck->keystring))
-			return buck->data;
+		int i = (*slot)++;
 
-		buck = buck->next;
+		if (!(table->ctrl[i] & 0x80))
+			return table->slots[i].bucket;
 	}
+
 	return NULL;
 }
 
 
-void *Hash_Add(hashtable_t *table, char *name, void *data) 
+static void *Hash_AddCopy(hashtable_t *table, char *name, void *data, hashmode_t mode)
 {
-	int bucknum = Hash_Key(name, table->numbuckets);
-
 	bucket_t *buck = (bucket_t *) Q_malloc(sizeof(bucket_t));
 	char *keystring = (char *) Q_malloc(sizeof(char)*(strlen(name)+1)); // Allow room for \0
 	strlcpy(keystring, name, strlen(name) + 1);
 
 	buck->data = data;
 	buck->keystring = keystring;
-	buck->next = table->bucket[bucknum];
-	table->bucket[bucknum] = buck;
 
-	return buck;
+	return Hash_Insert(table, mode, buck);
+}
+void *Hash_Add(hashtable_t *table, char *name, void *data) 
+{
+	return Hash_AddCopy(table, name, data, HASH_CASE);
 }
 void *Hash_AddInsensitive(hashtable_t *table, char *name, void *data) 
 {
-	int bucknum = Hash_KeyInsensitive(name, table->numbuckets);
+	return Hash_AddCopy(table, name, data, HASH_NOCASE);
+}
+void *Hash_AddKey(hashtable_t *table, char *key, void *data, bucket_t *buck)
+{
+	buck->data = data;
+	buck->keystring = key;
 
-	bucket_t *buck = (bucket_t *) Q_malloc(sizeof(bucket_t));
-	char *keystring = (char *) Q_malloc(sizeof(char)*(strlen(name)+1)); // Allow room for \0
-	strlcpy(keystring, name, strlen(name) + 1);
+	return Hash_Insert(table, HASH_POINTER, buck);
+}
 
+// Like Hash_Add, but the caller owns the bucket and the name, which has to stay valid
+// while the bucket is in the table. Don't Hash_Flush tables filled this way.
+void *Hash_AddBucket(hashtable_t *table, char *name, void *data, bucket_t *buck)
+{
 	buck->data = data;
-	buck->keystring = keystring;
-	buck->next = table->bucket[bucknum];
-	table->bucket[bucknum] = buck;
+	buck->keystring = name;
 
-	return buck;
+	return Hash_Insert(table, HASH_CASE, buck);
 }
-void *Hash_AddKey(hashtable_t *table, char *key, void *data, bucket_t *buck)
+void *Hash_AddBucketInsensitive(hashtable_t *table, char *name, void *data, bucket_t *buck)
 {
-	int bucknum = ((long) key) % table->numbuckets;
-
 	buck->data = data;
-	buck->keystring = key;
-	buck->next = table->bucket[bucknum];
-	table->bucket[bucknum] = buck;
+	buck->keystring = name;
 
-	return buck;
+	return Hash_Insert(table, HASH_NOCASE, buck);
+}
+// Unlinks a bucket added with Hash_AddBucketInsensitive, nothing is freed.
+void Hash_RemoveBucketInsensitive(hashtable_t *table, bucket_t *buck)
+{
+	Hash_Unlink(table, buck->keystring, HASH_NOCASE, buck);
 }
 
-void Hash_Remove(hashtable_t *table, char *name)
+static void Hash_RemoveEx(hashtable_t *table, char *name, void *data, qbool anydata, hashmode_t mode)
 {
-	int bucknum = Hash_Key(name, table->numbuckets);
-	bucket_t *buck;	
+	bucket_t *buck = Hash_Lookup(table, name, mode);
 
-	buck = table->bucket[bucknum];
+	while (buck && !anydata && buck->data != data)
+		buck = buck->next;
 
-	if (!STRCMP(name, buck->keystring))
-	{
-		table->bucket[bucknum] = buck->next;
-		Q_free(buck->keystring);
-		Q_free(buck);
+	if (!buck)
 		return;
-	}
-
 
-	while(buck->next)
-	{
-		if (!STRCMP(name, buck->next->keystring))
-		{
-			buck->next = buck->next->next;
-			Q_free(buck->next->keystring);
-			Q_free(buck->next);
-			return;
-		}
+	Hash_Unlink(table, name, mode, buck);
+	Q_free(buck->keystring);
+	Q_free(buck);
+}
 
-		buck = buck->next;
-	}
-	return;
+void Hash_Remove(hashtable_t *table, char *name)
+{
+	Hash_RemoveEx(table, name, NULL, true, HASH_CASE);
 }
 
 void Hash_RemoveData(hashtable_t *table, char *name, void *data)
 {
-	int bucknum = Hash_Key(name, table->numbuckets);
-	bucket_t *buck;	
-
-	buck = table->bucket[bucknum];
-
-	if (buck->data == data)
-		if (!STRCMP(name, buck->keystring))
-		{
-			table->bucket[bucknum] = buck->next;
-			Q_free(buck->keystring);
-			Q_free(buck);
-			return;
-		}
-
-
-	while(buck->next)
-	{
-		if (buck->next->data == data)
-			if (!STRCMP(name, buck->next->keystring))
-			{
-				buck->next = buck->next->next;
-				Q_free(buck->next->keystring);
-				Q_free(buck->next);
-				return;
-			}
-
-		buck = buck->next;
-	}
-	return;
+	Hash_RemoveEx(table, name, data, false, HASH_CASE);
 }
 
 
 void Hash_RemoveKey(hashtable_t *table, char *key)
 {
-	int bucknum = ((long) key) % table->numbuckets;
-	bucket_t *buck;	
-
-	buck = table->bucket[bucknum];
-
-	if (buck->keystring == key)
-	{
-		table->bucket[bucknum] = buck->next;
-		Q_free(buck->keystring);
-		Q_free(buck);
-		return;
-	}
-
-
-	while(buck->next)
-	{
-		if (buck->next->keystring == key)
-		{
-			buck->next = buck->next->next;
-			Q_free(buck->next->keystring);
-			Q_free(buck->next);
-			return;
-		}
-
-		buck = buck->next;
-	}
-	return;
+	Hash_RemoveEx(table, key, NULL, true, HASH_POINTER);
 }
 
 void Hash_Flush(hashtable_t *table) 
 {
 	int i;
-	for (i = 0; i < table->numbuckets; i++)
+	for (i = 0; i < table->size; i++)
 	{
 		bucket_t *bucket, *next;
-		bucket = table->bucket[i];
-		table->bucket[i] = NULL;
-		
+
+		if (table->ctrl[i] & 0x80)
+			continue;
+
+		bucket = table->slots[i].bucket;
 		while (bucket)
 		{
 			next = bucket->next;
@@ -351,22 +500,39 @@ void Hash_Flush(hashtable_t *table)
 			bucket = next;
 		}
 	}
+
+	memset(table->ctrl, HASH_EMPTY, table->size);
+	table->count = 0;
+	table->deleted = 0;
 	return;
 }
 
+// Frees the table itself, empty it first with Hash_Flush unless the buckets are the caller's.
+void Hash_FreeTable(hashtable_t *table)
+{
+	Q_free(table->ctrl);
+	Q_free(table->slots);
+	Q_free(table);
+}
+
 #if 0
 void Hash_BucketStats(hashtable_t *table)
 {
-	int i;
-	bucket_t *buck;	
-	int bucket_count;
+	int i, groupmask = table->size / HASH_GROUP - 1;
+	int histogram[8] = { 0 };
 
-	for (i = 0; i < table->numbuckets; i++) {
-		bucket_count = 0;
-		for (buck = table->bucket[i]; buck; buck = buck->next) {
-			bucket_count++;
-		}
-		printf("table[%d] = %d\n", i, bucket_count);
+	for (i = 0; i < table->size; i++) {
+		int group, stride = 0, probes = 1;
+
+		if (table->ctrl[i] & 0x80)
+			continue;
+		for (group = HASH_H1(table->slots[i].hash) & groupmask; group != i / HASH_GROUP; group = (group + ++stride) & groupmask)
+			probes++;
+		histogram[min(probes, 8) - 1]++;
 	}
+
+	printf("%d slots, %d used, %d deleted\n", table->size, table->count, table->deleted);
+	for (i = 0; i < 8; i++)
+		printf("%d group%s probed: %d\n", i + 1, i ? "s" : "", histogram[i]);
 }
 #endif
@@ -26,16 +26,28 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 typedef struct bucket_s {
 	void *data;
 	char *keystring;
-	struct bucket_s *next;
+	struct bucket_s *next;	// older entry under the same key
 } bucket_t;
 
+// Open addressing, each slot holds the newest entry of one key. A control byte per
+// slot keeps 7 bits of the hash or marks the slot empty or deleted, probes test a
+// group of them at once and only compare the keys whose stored hash is the same.
+typedef struct hashslot_s {
+	unsigned int hash;
+	bucket_t *bucket;
+} hashslot_t;
+
 typedef struct hashtable_s {
-	int numbuckets;
-	bucket_t **bucket;
+	int size;				// slots, a power of two
+	int count;				// slots in use
+	int deleted;
+	unsigned char *ctrl;
+	hashslot_t *slots;
 } hashtable_t;
 
 hashtable_t *Hash_InitTable(int numbucks);
 int Hash_Key(char *name, int modulus);
+int Hash_KeyInsensitive(const char *name, int modulus);
 void *Hash_Get(hashtable_t *table, char *name);
 void *Hash_GetInsensitive(hashtable_t *table, const char *name);
 void *Hash_GetKey(hashtable_t *table, char *key);
@@ -47,10 +59,16 @@ void Hash_Remove(hashtable_t *table, char *name);
 void Hash_RemoveData(hashtable_t *table, char *name, void *data);
 void Hash_RemoveKey(hashtable_t *table, char *key);
 void *Hash_AddKey(hashtable_t *table, char *key, void *data, bucket_t *buck);
+void *Hash_AddBucket(hashtable_t *table, char *name, void *data, bucket_t *buck);
+void *Hash_AddBucketInsensitive(hashtable_t *table, char *name, void *data, bucket_t *buck);
+void Hash_RemoveBucketInsensitive(hashtable_t *table, bucket_t *buck);
+bucket_t *Hash_GetBucketInsensitive(hashtable_t *table, const char *name);
+bucket_t *Hash_NextBucket(hashtable_t *table, int *slot);
 void Hash_Flush(hashtable_t *table);
+void Hash_FreeTable(hashtable_t *table);
 
 #if 0
-/* Print some stats on the bucket distrubution */
+/* Print some stats on the probe lengths */
 void Hash_BucketStats(hashtable_t *table);
 #endif
 
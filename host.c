@@ -55,7 +55,6 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 double		curtime;
 
 static int	host_hunklevel;
-static void	*host_membase;
 
 qbool	host_initialized;	// true if into command execution
 qbool	host_everything_loaded;	// true if OnChange() applied to every var, end of Host_Init()
@@ -416,7 +415,7 @@ void Host_Error (char *error, ...)
 	Host_Abort ();
 }
 
-//memsize is the recommended amount of memory to use for hunk
+//memsize is the recommended amount of memory to use for the cache, the hunk grows as needed
 void Host_InitMemory (int memsize)
 {
 	int t;
@@ -434,8 +433,7 @@ void Host_InitMemory (int memsize)
 		Sys_Error ("Only %4.1f megs of memory reported, can't execute game", memsize / (float)0x100000);
 
 	host_memsize = memsize;
-	host_membase = Q_malloc (host_memsize);
-	Memory_Init (host_membase, host_memsize);
+	Memory_Init (host_memsize);
 }
 
 //Free hunk memory up to host_hunklevel
@@ -661,7 +659,7 @@ void Host_Init (int argc, char **argv, int default_memsize)
 	Hud_262LoadOnFirstStart();
 
 	Com_Printf_State (PRINT_INFO, "Exe: "__DATE__" "__TIME__"\n");
-	Com_Printf_State (PRINT_INFO, "Hunk allocation: %4.1f MB\n", (float) host_memsize / (1024 * 1024));
+	Com_Printf_State (PRINT_INFO, "Cache size: %4.1f MB\n", (float) host_memsize / (1024 * 1024));
 	Com_Printf("\n");
 	Com_Printf("http://ezquake.sourceforge.net\n");
 	Com_Printf("\n");
@@ -22,6 +22,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #endif
 #include "quakedef.h"
 #include "image.h"
+#include "prefetch.h"
 
 #ifdef WITH_PNG
 #include "png.h"
@@ -655,7 +656,7 @@ static void PNG_IO_user_flush_data(png_structp png_ptr) {
 }
 
 
-byte *Image_LoadPNG (vfsfile_t *fin, const char *filename, int matchwidth, int matchheight, int *real_width, *real_height) 
+byte *Image_LoadPNG (vfsfile_t *fin, const char *filename, int matchwidth, int matchheight, int *real_width, int *real_height) 
 {
 	byte header[8], **rowpointers, *data;
 	png_structp png_ptr;
@@ -663,8 +664,11 @@ byte *Image_LoadPNG (vfsfile_t *fin, const char *filename, int matchwidth, int m
 	int y, width, height, bitdepth, colortype, interlace, compression, filter, bytesperpixel;
 	unsigned long rowbytes;
 
-	if (!png_handle)
+	if (!png_handle) {
+		if (fin)
+			VFS_CLOSE(fin);	// we own it, it may be a prefetched file
 		return NULL;
+	}
 
 	if (!fin && !(fin = FS_OpenVFS(filename, "rb", FS_ANY)))
 		return NULL;
@@ -957,6 +961,7 @@ png_data *Image_LoadPNG_All (vfsfile_t *fin, const char *filename, int matchwidt
 	if (!PNG_HasHeader (fin))
 	{
 		Com_DPrintf ("Invalid PNG image %s\n", COM_SkipPath(filename));
+		VFS_CLOSE(fin);
 		return NULL;
 	}
 
@@ -2108,19 +2113,19 @@ badjpeg:
 
 	if (image_width > IMAGE_MAX_DIMENSIONS || image_height > IMAGE_MAX_DIMENSIONS || image_width <= 0 || image_height <= 0)
 	{
-		Com_Printf("Bad actual dimensions %dx%d in jpeg %s\n", image_width, image_height, COM_SkipPath(filename));
+		Prefetch_Printf("Bad actual dimensions %dx%d in jpeg %s\n", image_width, image_height, COM_SkipPath(filename));
 		goto badjpeg;
 	}
 
 	if ((matchwidth && image_width != matchwidth) || (matchheight && image_height != matchheight))
 	{
-		Com_Printf("Bad match dimensions %dx%d vs %dx%d in jpeg %s\n", image_width, image_height, matchwidth, matchheight, COM_SkipPath(filename));
+		Prefetch_Printf("Bad match dimensions %dx%d vs %dx%d in jpeg %s\n", image_width, image_height, matchwidth, matchheight, COM_SkipPath(filename));
 		goto badjpeg; 
 	}
 
 	if (cinfo.output_components!=3)
 	{
-		Com_Printf("Bad number of componants in jpeg %s\n", COM_SkipPath(filename));
+		Prefetch_Printf("Bad number of componants in jpeg %s\n", COM_SkipPath(filename));
 		goto badjpeg;
 	}
 
@@ -2299,7 +2304,7 @@ byte *Image_LoadPCX (vfsfile_t *fin, const char *filename, int matchwidth, int m
 }
 
 // This does't load 32bit pcx, just convert 8bit color buffer to 32bit buffer, so we can make from this texture.
-byte *Image_LoadPCX_As32Bit (vfsfile_t *fin, char *filename, int matchwidth, int matchheight, int *real_width, int *real_height)
+byte *Image_LoadPCX_As32Bit (vfsfile_t *fin, const char *filename, int matchwidth, int matchheight, int *real_width, int *real_height)
 {
 	int image_width, image_height;
 	unsigned *out;
@@ -722,6 +722,107 @@ void MVD_Stats_Cleanup (void){
 	memset(&mvd_cg_info, 0, sizeof(mvd_cg_info_s));
 }
 
+// Demo keyframes keep the stats with the rest of the client state,
+// so seeking back doesn't count the same items and kills twice.
+// Only the mvd_new_info of the players in the game is stored, each one is big.
+// Save and restore return how many bytes of buf they used.
+#define MVD_STATE_CLOCKS 64
+
+typedef struct mvd_stats_state_s {
+	mvd_cg_info_s	cg_info;
+	double			quad_time, pent_time;
+	int				quad_is_active, pent_is_active, quad_mentioned, pent_mentioned;
+	int				powerup_cam_active, cam[4];
+	qbool			was_standby;
+	int				numclocks;
+	struct {
+		int			itemtype;
+		double		clockval;
+	} clocks[MVD_STATE_CLOCKS];
+	mvd_new_info_t	new_info[1];	// mvd_cg_info.pcount of them
+} mvd_stats_state_t;
+
+#define MVD_STATE_SIZE(pcount) ((int) (sizeof(mvd_stats_state_t) + (max(pcount, 1) - 1) * sizeof(mvd_new_info_t)))
+
+int MVD_Stats_StateSize(void)
+{
+	return cls.mvdplayback ? MVD_STATE_SIZE(MAX_CLIENTS) : 0;
+}
+
+int MVD_Stats_SaveState(byte *buf)
+{
+	mvd_stats_state_t *state = (mvd_stats_state_t *) buf;
+	mvd_clock_t *current;
+	int pcount = bound(0, mvd_cg_info.pcount, MAX_CLIENTS);
+
+	if (!cls.mvdplayback)
+		return 0;
+
+	state->cg_info = mvd_cg_info;
+	state->quad_time = quad_time;
+	state->pent_time = pent_time;
+	state->quad_is_active = quad_is_active;
+	state->pent_is_active = pent_is_active;
+	state->quad_mentioned = quad_mentioned;
+	state->pent_mentioned = pent_mentioned;
+	state->powerup_cam_active = powerup_cam_active;
+	state->cam[0] = cam_1;
+	state->cam[1] = cam_2;
+	state->cam[2] = cam_3;
+	state->cam[3] = cam_4;
+	state->was_standby = was_standby;
+
+	// the list is sorted, so if there are too many the ones running out last are dropped
+	for (state->numclocks = 0, current = mvd_clocklist; current && state->numclocks < MVD_STATE_CLOCKS; current = current->next, state->numclocks++) {
+		state->clocks[state->numclocks].itemtype = current->itemtype;
+		state->clocks[state->numclocks].clockval = current->clockval;
+	}
+
+	memcpy(state->new_info, mvd_new_info, pcount * sizeof(mvd_new_info_t));
+
+	return MVD_STATE_SIZE(pcount);
+}
+
+int MVD_Stats_RestoreState(byte *buf)
+{
+	mvd_stats_state_t *state = (mvd_stats_state_t *) buf;
+	mvd_clock_t *newclock;
+	int i, pcount;
+
+	if (!cls.mvdplayback)
+		return 0;
+
+	mvd_cg_info = state->cg_info;
+	quad_time = state->quad_time;
+	pent_time = state->pent_time;
+	quad_is_active = state->quad_is_active;
+	pent_is_active = state->pent_is_active;
+	quad_mentioned = state->quad_mentioned;
+	pent_mentioned = state->pent_mentioned;
+	powerup_cam_active = state->powerup_cam_active;
+	cam_1 = state->cam[0];
+	cam_2 = state->cam[1];
+	cam_3 = state->cam[2];
+	cam_4 = state->cam[3];
+	was_standby = state->was_standby;
+
+	while (mvd_clocklist) {
+		MVD_ClockList_Remove(mvd_clocklist);
+	}
+
+	for (i = 0; i < state->numclocks; i++) {
+		newclock = (mvd_clock_t *) Q_malloc(sizeof (mvd_clock_t));
+		newclock->itemtype = state->clocks[i].itemtype;
+		newclock->clockval = state->clocks[i].clockval;
+		MVD_ClockList_Insert(newclock);
+	}
+
+	pcount = bound(0, mvd_cg_info.pcount, MAX_CLIENTS);
+	memcpy(mvd_new_info, state->new_info, pcount * sizeof(mvd_new_info_t));
+
+	return MVD_STATE_SIZE(pcount);
+}
+
 void MVD_Set_Armor_Stats(int z,int i){
 	switch(z){
 		case GA_INFO:
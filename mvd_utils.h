@@ -27,6 +27,11 @@ void MVD_Screen (void);
 void MVD_Utils_Init(void); 
 void MVD_Mainhook(void);
 void MVD_Stats_Cleanup(void);
+
+// stats state for demo keyframes
+int MVD_Stats_StateSize(void);
+int MVD_Stats_SaveState(byte *buf);
+int MVD_Stats_RestoreState(byte *buf);
 void MVD_ClockList_TopItems_Draw(double time_limit, int style, int x, int y);
 void MVD_ClockList_TopItems_DimensionsGet(double time_limit, int style, int *width, int *height);
 
@@ -19,6 +19,10 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
     $Id: net.c,v 1.19 2007-10-04 13:48:11 dkure Exp $
 */
 
+#ifdef __linux__
+#define _GNU_SOURCE // recvmmsg/sendmmsg
+#endif
+
 #include "quakedef.h"
 #include "server.h"
 
@@ -315,6 +319,131 @@ void NET_ClearLoopback (void)
 	loopbacks[1].send = loopbacks[1].get = 0;
 }
 
+//=============================================================================
+
+#ifdef NET_BATCH
+/*
+Batched server socket I/O: incoming datagrams are drained with a single
+recvmmsg() into a ring which NET_GetPacket then consumes, and datagrams sent
+between NET_BeginServerBatch and NET_FlushServerBatch go out with a single
+sendmmsg() at the end of the frame.
+*/
+
+#define NET_BATCH_SIZE 64
+
+cvar_t sv_batchpackets = {"sv_batchpackets", "1"};
+
+typedef struct {
+	struct mmsghdr		msgs[NET_BATCH_SIZE];
+	struct iovec		iov[NET_BATCH_SIZE];
+	struct sockaddr_storage	addr[NET_BATCH_SIZE];
+	int					count;	// filled slots
+	int					next;	// next slot to hand out (receive ring only)
+} net_batch_t;
+
+static net_batch_t	net_recv_batch;
+static byte			net_recv_data[NET_BATCH_SIZE][MSG_BUF_SIZE];
+
+static net_batch_t	net_send_batch;
+static byte			net_send_data[NET_BATCH_SIZE][MAX_UDP_PACKET];
+static qbool		net_send_batching;
+
+// same contract as recvfrom(): returns datagram length, or -1 with qerrno set
+static int NET_RecvFromBatch (int socket, byte *buf, int bufsize, struct sockaddr_storage *from)
+{
+	net_batch_t *b = &net_recv_batch;
+	int i, ret;
+
+	if (b->next >= b->count) {
+		for (i = 0; i < NET_BATCH_SIZE; i++) {
+			b->iov[i].iov_base = net_recv_data[i];
+			b->iov[i].iov_len = sizeof(net_recv_data[i]);
+			memset (&b->msgs[i], 0, sizeof(b->msgs[i]));
+			b->msgs[i].msg_hdr.msg_iov = &b->iov[i];
+			b->msgs[i].msg_hdr.msg_iovlen = 1;
+			b->msgs[i].msg_hdr.msg_name = &b->addr[i];
+			b->msgs[i].msg_hdr.msg_namelen = sizeof(b->addr[i]);
+		}
+
+		b->next = b->count = 0;
+		ret = recvmmsg (socket, b->msgs, NET_BATCH_SIZE, MSG_DONTWAIT, NULL);
+		if (ret <= 0) {
+			if (ret == 0)
+				errno = EWOULDBLOCK;
+			return -1;
+		}
+
+		b->count = ret;
+	}
+
+	i = b->next++;
+	ret = min(bufsize, (int) b->msgs[i].msg_len);
+	memcpy (buf, net_recv_data[i], ret);
+	memcpy (from, &b->addr[i], sizeof(*from));
+
+	return ret;
+}
+
+static void NET_QueueBatchPacket (int length, void *data, struct sockaddr_storage *to, int tolen)
+{
+	net_batch_t *b = &net_send_batch;
+	int i;
+
+	if (b->count == NET_BATCH_SIZE) {
+		NET_FlushServerBatch ();
+		net_send_batching = true;
+	}
+
+	i = b->count++;
+	memcpy (net_send_data[i], data, length);
+	memcpy (&b->addr[i], to, tolen);
+	b->iov[i].iov_base = net_send_data[i];
+	b->iov[i].iov_len = length;
+	memset (&b->msgs[i], 0, sizeof(b->msgs[i]));
+	b->msgs[i].msg_hdr.msg_iov = &b->iov[i];
+	b->msgs[i].msg_hdr.msg_iovlen = 1;
+	b->msgs[i].msg_hdr.msg_name = &b->addr[i];
+	b->msgs[i].msg_hdr.msg_namelen = tolen;
+}
+
+void NET_BeginServerBatch (void)
+{
+	net_send_batching = (sv_batchpackets.integer && svs.socketip != INVALID_SOCKET);
+}
+
+void NET_FlushServerBatch (void)
+{
+	net_batch_t *b = &net_send_batch;
+	int sent = 0, ret;
+
+	net_send_batching = false;
+
+	while (sent < b->count && svs.socketip != INVALID_SOCKET) {
+		ret = sendmmsg (svs.socketip, b->msgs + sent, b->count - sent, 0);
+		if (ret == -1) {
+			// the datagram at the head failed, drop it like sendto() would
+			if (qerrno != EWOULDBLOCK && qerrno != ECONNREFUSED && qerrno != EADDRNOTAVAIL)
+				Sys_Printf ("NET_FlushServerBatch: sendmmsg: (%i): %s %i\n", qerrno, strerror(qerrno), svs.socketip);
+			sent++;
+			continue;
+		}
+
+		sent += ret;
+	}
+
+	b->count = 0;
+}
+
+static void NET_ClearServerBatch (void)
+{
+	net_recv_batch.count = net_recv_batch.next = 0;
+	net_send_batch.count = 0;
+	net_send_batching = false;
+}
+#endif
+
+//=============================================================================
+
 qbool NET_GetPacketEx (netsrc_t netsrc, qbool delay)
 {
 	int ret, socket, err, i;
@@ -351,6 +480,11 @@ qbool NET_GetPacketEx (netsrc_t netsrc, qbool delay)
 			continue;
 
 		fromlen = sizeof(from);
+#ifdef NET_BATCH
+		if (netsrc == NS_SERVER && (sv_batchpackets.integer || net_recv_batch.next < net_recv_batch.count))
+			ret = NET_RecvFromBatch (socket, net_message_buffer, sizeof(net_message_buffer), &from);
+		else
+#endif
 		ret = recvfrom (socket, (char *)net_message_buffer, sizeof(net_message_buffer), 0, (struct sockaddr *)&from, &fromlen);
 
 		if (ret == -1) {
@@ -660,6 +794,13 @@ void NET_SendPacketEx (netsrc_t netsrc, int length, void *data, netadr_t to, qbo
 	NetadrToSockadr (&to, &addr);
 	size = sizeof(struct sockaddr_in);
 
+#ifdef NET_BATCH
+	if (netsrc == NS_SERVER && net_send_batching && length <= MAX_UDP_PACKET) {
+		NET_QueueBatchPacket (length, data, &addr, size);
+		return;
+	}
+#endif
+
 	ret = sendto (socket, data, length, 0, (struct sockaddr *)&addr, size);
 	if (ret == -1) {
 		if (qerrno == EWOULDBLOCK)
@@ -1018,6 +1159,10 @@ void NET_InitClient(void)
 #ifndef CLIENTONLY
 void NET_CloseServer (void)
 {
+#ifdef NET_BATCH
+	NET_ClearServerBatch ();
+#endif
+
 	if (svs.socketip != INVALID_SOCKET) {
 		closesocket(svs.socketip);
 		svs.socketip = INVALID_SOCKET;
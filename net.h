@@ -140,6 +140,13 @@ qbool	NET_StringToAdr (char *s, netadr_t *a);
 
 int		NET_UDPSVPort (void);
 
+#if defined(__linux__) && !defined(CLIENTONLY)
+#define NET_BATCH // recvmmsg/sendmmsg on the server socket
+extern	cvar_t	sv_batchpackets;
+void	NET_BeginServerBatch (void);
+void	NET_FlushServerBatch (void);
+#endif
+
 //============================================================================
 
 #define OLD_AVG 0.99 // total = oldtotal*OLD_AVG + new*(1-OLD_AVG)
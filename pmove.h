@@ -100,5 +100,6 @@ void PM_CategorizePosition (void);
 qbool PM_TestPlayerPosition (vec3_t point);
 trace_t PM_PlayerTrace (vec3_t start, vec3_t end);
 trace_t PM_TraceLine (vec3_t start, vec3_t end);
+void PM_TraceLineBatch (int count, vec3_t *starts, vec3_t *ends, trace_t *traces);
 
 #endif
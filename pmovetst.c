@@ -198,6 +198,27 @@ trace_t PM_PlayerTrace (vec3_t start, vec3_t end)
 	return total;
 }
 
+/*
+================
+PM_CullLine
+
+True if the line with bounds mins/maxs can't touch the physent, the world
+is never culled.
+================
+*/
+static qbool PM_CullLine (int num, hull_t *hull, vec3_t mins, vec3_t maxs)
+{
+	physent_t *pe = &pmove.physents[num];
+
+	if (!num)
+		return false;
+
+	if (pe->model)
+		return PM_CullTraceBox (mins, maxs, pe->origin, pe->model->mins, pe->model->maxs, hull->clip_mins, hull->clip_maxs);
+
+	return PM_CullTraceBox (mins, maxs, pe->origin, pe->mins, pe->maxs, vec3_origin, vec3_origin);
+}
+
 /*
 ================
 PM_TraceLine
@@ -208,7 +229,7 @@ trace_t PM_TraceLine (vec3_t start, vec3_t end)
 	int i;
 	hull_t *hull;
 	physent_t *pe;
-	vec3_t offset, start_l, end_l;
+	vec3_t offset, start_l, end_l, tracemins, tracemaxs;
 	trace_t trace, total;
 
 	// fill in a default trace
@@ -217,10 +238,21 @@ trace_t PM_TraceLine (vec3_t start, vec3_t end)
 	total.e.entnum = -1;
 	VectorCopy (end, total.endpos);
 
+	PM_TraceBounds (start, end, tracemins, tracemaxs);
+
 	for (i = 0; i < pmove.numphysent; i++) {
 		pe = &pmove.physents[i];
 		// get the clipping hull
-		hull = (pe->model) ? (&pmove.physents[i].model->hulls[0]) : (CM_HullForBox (pe->mins, pe->maxs));
+		if (pe->model) {
+			hull = &pmove.physents[i].model->hulls[0];
+			if (PM_CullLine (i, hull, tracemins, tracemaxs))
+				continue;
+		}
+		else {
+			if (PM_CullLine (i, NULL, tracemins, tracemaxs))
+				continue;
+			hull = CM_HullForBox (pe->mins, pe->maxs);
+		}
 
 		// PM_HullForEntity (ent, mins, maxs, offset);
 		VectorCopy (pe->origin, offset);
@@ -249,3 +281,74 @@ trace_t PM_TraceLine (vec3_t start, vec3_t end)
 
 	return total;
 }
+
+/*
+================
+PM_TraceLineBatch
+
+Gives the same results as calling PM_TraceLine for each line, it's only a
+loop reorder for the weather effects. Each physent is set up once (a box hull
+is built once, not once per line) and then traced against all the lines it
+may touch. Every line is still its own CM_HullTrace: taking lines down the
+clipnodes together, sorted by region, came out slower than tracing them one
+by one.
+================
+*/
+#define PM_TRACEBATCH_RUN	256
+
+void PM_TraceLineBatch (int count, vec3_t *starts, vec3_t *ends, trace_t *traces)
+{
+	vec3_t tracemins[PM_TRACEBATCH_RUN], tracemaxs[PM_TRACEBATCH_RUN];
+	vec3_t start_l, end_l;
+	int i, j, run;
+	hull_t *hull;
+	physent_t *pe;
+	trace_t trace, *total;
+
+	for ( ; count > 0; starts += run, ends += run, traces += run, count -= run) {
+		run = min (count, PM_TRACEBATCH_RUN);
+
+		// fill in default traces
+		for (j = 0; j < run; j++) {
+			total = &traces[j];
+			memset (total, 0, sizeof(trace_t));
+			total->fraction = 1;
+			total->e.entnum = -1;
+			VectorCopy (ends[j], total->endpos);
+
+			PM_TraceBounds (starts[j], ends[j], tracemins[j], tracemaxs[j]);
+		}
+
+		for (i = 0; i < pmove.numphysent; i++) {
+			pe = &pmove.physents[i];
+			// get the clipping hull
+			hull = (pe->model) ? (&pmove.physents[i].model->hulls[0]) : (CM_HullForBox (pe->mins, pe->maxs));
+
+			for (j = 0; j < run; j++) {
+				if (PM_CullLine (i, hull, tracemins[j], tracemaxs[j]))
+					continue;
+
+				VectorSubtract (starts[j], pe->origin, start_l);
+				VectorSubtract (ends[j], pe->origin, end_l);
+
+				// trace a line through the apropriate clipping hull
+				trace = CM_HullTrace (hull, start_l, end_l);
+
+				// fix trace up by the offset
+				VectorAdd (trace.endpos, pe->origin, trace.endpos);
+
+				if (trace.allsolid)
+					trace.startsolid = true;
+				if (trace.startsolid)
+					trace.fraction = 0;
+
+				// did we clip the move?
+				total = &traces[j];
+				if (trace.fraction < total->fraction) {
+					*total = trace;
+					total->e.entnum = i;
+				}
+			}
+		}
+	}
+}
@@ -2812,6 +2812,13 @@ void PF2_setpause(byte* base, unsigned int mask, pr2val_t* stack, pr2val_t*retva
 		SV_TogglePause (NULL, 1);
 }
 
+// a la the EZ_ANTILAG QC extension
+void PF2_setantilag(byte* base, unsigned int mask, pr2val_t* stack, pr2val_t*retval)
+{
+	retval->_int = sv_antilag_requested;
+	sv_antilag_requested = stack[0]._int ? true : false;
+}
+
 #define SETUSERINFO_STAR          (1<<0) // allow set star keys
 
 void PF2_SetUserInfo( byte * base, unsigned int mask, pr2val_t * stack, pr2val_t * retval )
@@ -2991,6 +2998,7 @@ pr2_trapcall_t pr2_API[]=
 		PF2_setpause,		//G_SETPAUSE
 		PF2_SetUserInfo,	//G_SETUSERINFO
 		PF2_MoveToGoal,		//G_MOVETOGOAL
+		PF2_setantilag,		//G_SETANTILAG
     };
 int pr2_numAPI = sizeof(pr2_API)/sizeof(pr2_API[0]);
 
@@ -34,6 +34,8 @@ extern cvar_t sv_enableprofile;
 
 void ED2_PrintEdicts (void);
 void PR2_Profile_f (void);
+void VM_TraceRecord_f (void);
+void VM_TraceBench_f (void);
 void ED2_PrintEdict_f (void);
 void ED_Count (void);
 void PR_CleanLogText_Init();
@@ -47,6 +49,9 @@ void PR2_Init(void)
 #ifdef QVM_PROFILE
 	Cvar_Register(&sv_enableprofile);
 #endif
+#ifdef QVM_JIT
+	Cvar_Register(&vm_jit);
+#endif
 
 	p = COM_CheckParm ("-progtype");
 
@@ -64,6 +69,8 @@ void PR2_Init(void)
 	Cmd_AddCommand ("edicts", ED2_PrintEdicts);
 	Cmd_AddCommand ("edictcount", ED_Count);
 	Cmd_AddCommand ("profile", PR2_Profile_f);
+	Cmd_AddCommand ("vm_trace_record", VM_TraceRecord_f);
+	Cmd_AddCommand ("vm_trace_bench", VM_TraceBench_f);
 	Cmd_AddCommand ("mod", PR2_GameConsoleCommand);
 
 	PR_CleanLogText_Init();
@@ -72,6 +72,12 @@ profile_t* ProfileEnterFunction(int adress)
 symbols_t* QVM_FindName( qvm_t * qvm, int off);
 #endif
 
+#ifdef QVM_JIT
+cvar_t	vm_jit = {"vm_jit", "1"};
+#endif
+
+static void VM_TraceClear( void );
+
 void PR2_Profile_f()
 {
 #ifdef QVM_PROFILE
@@ -94,6 +100,13 @@ void PR2_Profile_f()
 #ifdef QVM_PROFILE
 	if(sv_vm->type != VM_BYTECODE)
 		return;
+#ifdef QVM_JIT
+	if(((qvm_t*)(sv_vm->hInst))->jit)
+	{
+		Con_Printf ("profiling is not supported by compiled bytecode, set vm_jit 0\n");
+		return;
+	}
+#endif
 	num = 0;
 	if(!(int)sv_enableprofile.value)
 	{
@@ -136,8 +149,12 @@ void PR2_Profile_f()
 
 void VM_UnloadQVM( qvm_t * qvm )
 {
-	if(qvm)
-		Q_free( qvm );
+	if(!qvm)
+		return;
+#ifdef QVM_JIT
+	QVM_JIT_Free( qvm );
+#endif
+	Q_free( qvm );
 }
 
 void VM_Unload( vm_t * vm )
@@ -145,6 +162,7 @@ void VM_Unload( vm_t * vm )
 	if ( !vm )
 		return;
 	Con_DPrintf( "VM_Unload \"%s\"\n", vm->name );
+	VM_TraceClear();
 	switch ( vm->type )
 	{
 	case VM_NATIVE:
@@ -218,8 +236,9 @@ void VM_PrintInfo( vm_t * vm)
 		Con_DPrintf("native\n");
 		break;
 	case VM_BYTECODE:
-		Con_DPrintf("bytecode interpreted\n");
-		if((qvm=(qvm_t *)vm->hInst))
+		qvm = (qvm_t *)vm->hInst;
+		Con_DPrintf("bytecode %s\n", (qvm && qvm->jit) ? "compiled" : "interpreted");
+		if(qvm)
 		{
 			Con_DPrintf("     code  length: %8xh\n", qvm->len_cs*sizeof(qvm->cs[0]));
 			Con_DPrintf("instruction count: %8d\n", qvm->len_cs);
@@ -443,6 +462,10 @@ qbool VM_LoadBytecode( vm_t * vm, sys_callex_t syscall1 )
 	}
 
 	LoadMapFile( qvm, vm->name );
+#ifdef QVM_JIT
+	if ( (int)vm_jit.value )
+		QVM_JIT_Compile( qvm );
+#endif
 	vm->type = VM_BYTECODE;
 	vm->hInst = qvm;
 	return true;
@@ -493,9 +516,191 @@ vm_t   *VM_Load( vm_t * vm, vm_type_t type, char *name, sys_call_t syscall1, sys
 int     QVM_Exec( register qvm_t * qvm, int command, int arg0, int arg1, int arg2, int arg3,
                   int arg4, int arg5, int arg6, int arg7, int arg8, int arg9, int arg10, int arg11 );
 
+/*
+  vmMain call trace, recorded by vm_trace_record and replayed through
+  the interpreter and the compiler by vm_trace_bench
+*/
+#define MAX_TRACE_CALLS	100000
+
+typedef struct
+{
+	int				command;
+	int				args[12];
+	globalvars_t	globals;	// engine sets self, other, time etc before each call
+} vm_trace_call_t;
+
+static vm_trace_call_t	*vm_trace;
+static int				vm_trace_num, vm_trace_max;
+static qbool			vm_trace_recording;
+
+static void VM_TraceClear( void )
+{
+	Q_free( vm_trace );
+	vm_trace_num = vm_trace_max = 0;
+	vm_trace_recording = false;
+}
+
+static void VM_TraceCall( int command, int arg0, int arg1, int arg2, int arg3, int arg4, int arg5,
+                          int arg6, int arg7, int arg8, int arg9, int arg10, int arg11 )
+{
+	vm_trace_call_t *c;
+
+	if ( sv.state != ss_active || !pr_global_struct || command == GAME_SHUTDOWN )
+		return;
+
+	c = &vm_trace[vm_trace_num++];
+	c->command = command;
+	c->args[0] = arg0;
+	c->args[1] = arg1;
+	c->args[2] = arg2;
+	c->args[3] = arg3;
+	c->args[4] = arg4;
+	c->args[5] = arg5;
+	c->args[6] = arg6;
+	c->args[7] = arg7;
+	c->args[8] = arg8;
+	c->args[9] = arg9;
+	c->args[10] = arg10;
+	c->args[11] = arg11;
+	memcpy( &c->globals, pr_global_struct, sizeof( globalvars_t ) );
+
+	if ( vm_trace_num >= vm_trace_max )
+	{
+		vm_trace_recording = false;
+		Con_Printf( "vm_trace_record: %d calls recorded\n", vm_trace_num );
+	}
+}
+
+void VM_TraceRecord_f( void )
+{
+	int calls = Cmd_Argc() > 1 ? Q_atoi( Cmd_Argv( 1 ) ) : 1000;
+
+	if ( !sv_vm || sv_vm->type != VM_BYTECODE )
+	{
+		Con_Printf( "vm_trace_record: no bytecode game module loaded\n" );
+		return;
+	}
+
+	VM_TraceClear();
+	vm_trace_max = bound( 1, calls, MAX_TRACE_CALLS );
+	vm_trace = (vm_trace_call_t *) Q_malloc( vm_trace_max * sizeof( vm_trace_call_t ) );
+	vm_trace_recording = true;
+	Con_Printf( "vm_trace_record: recording next %d vmMain calls\n", vm_trace_max );
+}
+
+// bring back data segment and edicts saved before a replay
+static void VM_TraceRestore( qvm_t * qvm, byte *ds, sv_edict_t *sv_edicts, int num_edicts )
+{
+	int i;
+
+	memcpy( qvm->ds, ds, qvm->len_ds );
+	memcpy( sv.sv_edicts, sv_edicts, sizeof( sv.sv_edicts ) );
+	sv.num_edicts = num_edicts;
+
+	// area links point into lists built during the replay, relink from scratch
+	for ( i = 0; i < MAX_EDICTS; i++ )
+		sv.sv_edicts[i].area.prev = sv.sv_edicts[i].area.next = NULL;
+	SV_ClearWorld();
+	for ( i = 1; i < sv.num_edicts; i++ )
+	{
+		if ( !sv.sv_edicts[i].free )
+			SV_LinkEdict( EDICT_NUM( i ), false );
+	}
+}
+
+static double VM_TraceReplay( qvm_t * qvm, qbool jit )
+{
+	vm_trace_call_t *c;
+	double start = Sys_DoubleTime();
+
+	for ( c = vm_trace; c < vm_trace + vm_trace_num; c++ )
+	{
+		memcpy( pr_global_struct, &c->globals, sizeof( globalvars_t ) );
+#ifdef QVM_JIT
+		if ( jit )
+		{
+			QVM_JIT_Exec( qvm, c->command, c->args[0], c->args[1], c->args[2], c->args[3], c->args[4], c->args[5],
+			              c->args[6], c->args[7], c->args[8], c->args[9], c->args[10], c->args[11] );
+			continue;
+		}
+#endif
+		QVM_Exec( qvm, c->command, c->args[0], c->args[1], c->args[2], c->args[3], c->args[4], c->args[5],
+		          c->args[6], c->args[7], c->args[8], c->args[9], c->args[10], c->args[11] );
+	}
+
+	return Sys_DoubleTime() - start;
+}
+
+void VM_TraceBench_f( void )
+{
+	qvm_t *qvm;
+	byte *ds;
+	sv_edict_t *sv_edicts;
+	int num_edicts, passes, engine, i;
+	double time[2];
+
+	if ( !sv_vm || sv_vm->type != VM_BYTECODE )
+	{
+		Con_Printf( "vm_trace_bench: no bytecode game module loaded\n" );
+		return;
+	}
+	if ( vm_trace_recording || !vm_trace_num )
+	{
+		Con_Printf( "vm_trace_bench: record a trace with vm_trace_record first\n" );
+		return;
+	}
+
+	qvm = (qvm_t *) sv_vm->hInst;
+	passes = bound( 1, Cmd_Argc() > 1 ? Q_atoi( Cmd_Argv( 1 ) ) : 1, 1000 );
+
+#ifdef QVM_JIT
+	if ( !qvm->jit && !QVM_JIT_Compile( qvm ) )
+		Con_Printf( "vm_trace_bench: compiler unavailable, timing interpreter only\n" );
+#endif
+
+	// the replay changes game state, each pass starts from the same snapshot
+	ds = (byte *) Q_malloc( qvm->len_ds );
+	sv_edicts = (sv_edict_t *) Q_malloc( sizeof( sv.sv_edicts ) );
+	memcpy( ds, qvm->ds, qvm->len_ds );
+	memcpy( sv_edicts, sv.sv_edicts, sizeof( sv.sv_edicts ) );
+	num_edicts = sv.num_edicts;
+
+	time[0] = time[1] = 0;
+	for ( engine = 0; engine < 2; engine++ )
+	{
+		if ( engine == 1 && !qvm->jit )
+			break;
+
+		for ( i = 0; i < passes; i++ )
+		{
+			time[engine] += VM_TraceReplay( qvm, engine == 1 );
+			VM_TraceRestore( qvm, ds, sv_edicts, num_edicts );
+		}
+	}
+
+	// keep what vm_jit asks for
+#ifdef QVM_JIT
+	if ( !(int)vm_jit.value )
+		QVM_JIT_Free( qvm );
+#endif
+
+	Q_free( ds );
+	Q_free( sv_edicts );
+
+	Con_Printf( "%d calls x %d passes\n", vm_trace_num, passes );
+	Con_Printf( "interpreter: %10.0f ns/call\n", time[0] * 1e9 / ( vm_trace_num * passes ) );
+	if ( time[1] > 0 )
+	{
+		Con_Printf( "compiled   : %10.0f ns/call\n", time[1] * 1e9 / ( vm_trace_num * passes ) );
+		Con_Printf( "speedup    : %10.2fx\n", time[0] / time[1] );
+	}
+}
+
 int VM_Call( vm_t * vm, int command, int arg0, int arg1, int arg2, int arg3, int arg4, int arg5,
              int arg6, int arg7, int arg8, int arg9, int arg10, int arg11 )
 {
+	qvm_t *qvm;
+
 	if ( !vm )
 		Sys_Error( "VM_Call with NULL vm" );
 
@@ -504,7 +709,15 @@ int VM_Call( vm_t * vm, int command, int arg0, int arg1, int arg2, int arg3, int
 	case VM_NATIVE:
 		return vm->vmMain( command, arg0, arg1, arg2, arg3, arg4, arg5, arg6, arg7, arg8, arg9, arg10, arg11 );
 	case VM_BYTECODE:
-		return QVM_Exec( (qvm_t*) vm->hInst, command, arg0, arg1, arg2, arg3, arg4, arg5, arg6, arg7, arg8, arg9, arg10,
+		qvm = (qvm_t*) vm->hInst;
+		if ( vm_trace_recording && !qvm->reenter )
+			VM_TraceCall( command, arg0, arg1, arg2, arg3, arg4, arg5, arg6, arg7, arg8, arg9, arg10, arg11 );
+#ifdef QVM_JIT
+		if ( qvm->jit )
+			return QVM_JIT_Exec( qvm, command, arg0, arg1, arg2, arg3, arg4, arg5, arg6, arg7, arg8, arg9, arg10,
+			                     arg11 );
+#endif
+		return QVM_Exec( qvm, command, arg0, arg1, arg2, arg3, arg4, arg5, arg6, arg7, arg8, arg9, arg10,
 		                 arg11 );
 	case VM_NONE:
 		Sys_Error( "VM_Call with VM_NONE type vm" );
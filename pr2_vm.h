@@ -28,6 +28,11 @@
 #define QVM_DATA_PROTECTION
 #define QVM_PROFILE
 
+// compile bytecode to native code at load time, see pr2_vm_jit.c
+#if defined(__x86_64__) && !defined(_WIN32)
+#define QVM_JIT
+#endif
+
 #ifdef _WIN32
 #define EXPORT_FN __cdecl
 #else
@@ -228,6 +233,8 @@ typedef struct {
 	int	reenter;
 	symbols_t* sym_info;
 	sys_callex_t syscall;
+
+	struct qvm_jit_s *jit;	// native code, NULL if interpreted
 } qvm_t;
 
 
@@ -271,6 +278,16 @@ vm_t* VM_Load(vm_t *vm, vm_type_t type, char *name,sys_call_t syscall,sys_callex
 extern int VM_Call(vm_t *vm, int /*command*/, int /*arg0*/, int , int , int , int , int , 
 				int , int , int , int , int , int /*arg11*/);
 void  QVM_StackTrace( qvm_t * qvm );
+void QVM_RunError( qvm_t * qvm, char *error, ... );
+int trap_Call( qvm_t * qvm, int apinum );
 void VM_PrintInfo( vm_t * vm);
 
+#ifdef QVM_JIT
+extern cvar_t vm_jit;
+qbool QVM_JIT_Compile( qvm_t * qvm );
+void QVM_JIT_Free( qvm_t * qvm );
+int QVM_JIT_Exec( qvm_t * qvm, int command, int arg0, int arg1, int arg2, int arg3,
+                  int arg4, int arg5, int arg6, int arg7, int arg8, int arg9, int arg10, int arg11 );
+#endif
+
 #endif /* !__PR2_VM_H__ */
@@ -0,0 +1,1083 @@
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+/*
+  x86-64 compiler for Quake3 compatible virtual machine
+
+  The code segment is translated once at load time. Register usage inside
+  compiled code:
+
+	rbx	data segment base
+	rbp	last valid opStack slot
+	r12	pointer to opStack top (opStack[SP])
+	r14	LP (zero extended)
+	r15	qvm_t
+
+  Every QVM function is a native function: OP_ENTER adjusts rsp so the body
+  always runs with a 16 byte aligned stack and can call C directly.
+
+  Data segment accesses and OP_ENTER/OP_LEAVE stack moves are checked the same
+  way QVM_DATA_PROTECTION/SAFE_QVM do in QVM_Exec. The opStack is verified
+  statically: the depth at every instruction is known at compile time, so a
+  single bound check on function entry replaces the per instruction checks.
+  Runaway loop protection and profiling are only available in the interpreter.
+*/
+
+#ifdef USE_PR2
+
+#include "qwsvdef.h"
+
+#ifdef QVM_JIT
+
+#include <sys/mman.h>
+
+#define JIT_MAX_INSTRUCTION_SIZE	96
+
+// qvm_t.jit
+typedef struct qvm_jit_s
+{
+	byte	*code;			// read only, executable
+	int		code_size;
+	void	**calltab;		// native address of every OP_ENTER, bad call stub elsewhere
+	void	**jumptab;		// native address of every valid OP_JUMP landing, bad jump stub elsewhere
+	int		(*entry) (qvm_t *qvm, int *opstack, int *opstack_end, int LP, byte *ds, void *func);
+} qvm_jit_t;
+
+// per instruction flags
+#define JF_TARGET		1	// target of constant branch
+#define JF_SKIP			2	// fused into previous instruction
+#define JF_BAD			4	// opStack inconsistent, compiled as error
+
+#define DEPTH_UNKNOWN	-1
+
+typedef enum
+{
+	JIT_ERR_BREAK,
+	JIT_ERR_DATA,
+	JIT_ERR_STACK_OVERFLOW,
+	JIT_ERR_STACK_UNDERFLOW,
+	JIT_ERR_OPSTACK,
+	JIT_ERR_CALL,
+	JIT_ERR_JUMP
+} jit_error_t;
+
+typedef struct
+{
+	qvm_t	*qvm;
+	byte	*buf;			// NULL while sizing
+	int		pos;
+
+	int		*instr_ofs;
+	int		*depth;			// opStack depth before instruction, relative to function entry
+	int		*maxdepth;		// for OP_ENTER instructions
+	int		*func_end;		// for OP_ENTER instructions
+	byte	*flags;
+
+	int		fault_ofs;
+	int		badcall_ofs;
+	int		badjump_ofs;
+} jitstate_t;
+
+/*
+  Runtime helpers called from compiled code
+*/
+
+static void QVM_JIT_Fault( qvm_t * qvm, int pc, int code )
+{
+	static char *errors[] = {
+		"OP_BREAK",
+		"data access out of range",
+		"QVM Stack overflow",
+		"QVM Stack underflow",
+		"QVM opStack overflow",
+		"QVM bad call",
+		"QVM bad jump"
+	};
+
+	qvm->PC = pc + 1;
+	QVM_RunError( qvm, "%s at %8x\n", ( code >= 0 && code <= JIT_ERR_JUMP ) ? errors[code] : "QVM unknown error", pc );
+}
+
+static void QVM_JIT_BlockCopy( qvm_t * qvm, int off1, int off2, int len )
+{
+	if ( (off1 & (~qvm->ds_mask) ) || (off2 & (~qvm->ds_mask) )
+	        || ((off1 + len) & (~qvm->ds_mask) )
+	        || ((off2 + len) & (~qvm->ds_mask) ))
+		QVM_RunError( qvm, "block copy out of range %8x\n", off1 );
+	memmove( qvm->ds + off1, qvm->ds + off2, len );
+}
+
+/*
+  Emitter
+*/
+
+static void Emit1( jitstate_t *st, int v )
+{
+	if ( st->buf )
+		st->buf[st->pos] = v & 0xff;
+	st->pos++;
+}
+
+static void Emit4( jitstate_t *st, int v )
+{
+	Emit1( st, v );
+	Emit1( st, v >> 8 );
+	Emit1( st, v >> 16 );
+	Emit1( st, v >> 24 );
+}
+
+static void Emit8( jitstate_t *st, quintptr_t v )
+{
+	Emit4( st, (int) (v & 0xffffffff) );
+	Emit4( st, (int) (v >> 32) );
+}
+
+// hex bytes separated by spaces, e.g. "41 8B 04 24"
+static void EmitString( jitstate_t *st, const char *s )
+{
+	int c, v;
+
+	while ( *s )
+	{
+		v = 0;
+		while ( ( c = *s ) && c != ' ' )
+		{
+			v = ( v << 4 ) | ( c <= '9' ? c - '0' : ( c | 0x20 ) - 'a' + 10 );
+			s++;
+		}
+		Emit1( st, v );
+		while ( *s == ' ' )
+			s++;
+	}
+}
+
+static void EmitRel32( jitstate_t *st, int target )
+{
+	Emit4( st, target - ( st->pos + 4 ) );
+}
+
+// placeholder for forward rel32, resolved with PatchRel32
+static int EmitForward( jitstate_t *st )
+{
+	int at = st->pos;
+
+	Emit4( st, 0 );
+	return at;
+}
+
+static void PatchRel32( jitstate_t *st, int at )
+{
+	int rel = st->pos - ( at + 4 );
+
+	if ( !st->buf )
+		return;
+	st->buf[at] = rel & 0xff;
+	st->buf[at + 1] = ( rel >> 8 ) & 0xff;
+	st->buf[at + 2] = ( rel >> 16 ) & 0xff;
+	st->buf[at + 3] = ( rel >> 24 ) & 0xff;
+}
+
+static void EmitCallC( jitstate_t *st, void *func )
+{
+	EmitString( st, "48 B8" );			// mov rax, func
+	Emit8( st, (quintptr_t) func );
+	EmitString( st, "FF D0" );			// call rax
+}
+
+static void EmitFault( jitstate_t *st, jit_error_t code, int pc )
+{
+	Emit1( st, 0xBE );					// mov esi, pc
+	Emit4( st, pc );
+	Emit1( st, 0xBA );					// mov edx, code
+	Emit4( st, code );
+	Emit1( st, 0xE9 );					// jmp fault
+	EmitRel32( st, st->fault_ofs );
+}
+
+// short conditional jump over the fault stub when the check passes
+static void EmitCheck( jitstate_t *st, int jcc_ok, jit_error_t code, int pc )
+{
+	Emit1( st, jcc_ok );
+	Emit1( st, 15 );
+	EmitFault( st, code, pc );
+}
+
+#define JCC_JZ	0x74
+#define JCC_JB	0x72
+#define JCC_JBE	0x76
+#define JCC_JGE	0x7D
+
+// eax = data segment offset, fault if outside of ds
+static void EmitDataCheck( jitstate_t *st, int pc )
+{
+	Emit1( st, 0xA9 );					// test eax, ~ds_mask
+	Emit4( st, ~st->qvm->ds_mask );
+	EmitCheck( st, JCC_JZ, JIT_ERR_DATA, pc );
+}
+
+static void EmitPushEax( jitstate_t *st )
+{
+	EmitString( st, "49 83 C4 04" );	// add r12, 4
+	EmitString( st, "41 89 04 24" );	// mov [r12], eax
+}
+
+static void EmitPushConst( jitstate_t *st, int v )
+{
+	EmitString( st, "49 83 C4 04" );	// add r12, 4
+	EmitString( st, "41 C7 04 24" );	// mov dword [r12], v
+	Emit4( st, v );
+}
+
+// top of opStack to eax and pop
+static void EmitPopEax( jitstate_t *st )
+{
+	EmitString( st, "41 8B 04 24" );	// mov eax, [r12]
+	EmitString( st, "49 83 EC 04" );	// sub r12, 4
+}
+
+// eax = apinum
+static void EmitSyscall( jitstate_t *st )
+{
+	EmitString( st, "45 89 B7" );		// mov [r15 + LP], r14d
+	Emit4( st, (int) (qintptr_t) &((qvm_t *) 0)->LP );
+	EmitString( st, "4C 89 FF" );		// mov rdi, r15
+	EmitString( st, "89 C6" );			// mov esi, eax
+	EmitCallC( st, (void *) trap_Call );
+	EmitPushEax( st );
+}
+
+// store return address where OP_LEAVE of the interpreter would read it
+static void EmitStoreReturn( jitstate_t *st, int retpc )
+{
+	EmitString( st, "42 C7 04 33" );	// mov dword [rbx + r14], retpc
+	Emit4( st, retpc );
+}
+
+static void EmitStubs( jitstate_t *st )
+{
+	// int entry( qvm, opstack, opstack_end, LP, ds, func )
+	EmitString( st, "53 55 41 54 41 55 41 56 41 57" );	// push rbx, rbp, r12-r15
+	EmitString( st, "48 83 EC 08" );	// sub rsp, 8
+	EmitString( st, "49 89 FF" );		// mov r15, rdi
+	EmitString( st, "49 89 F4" );		// mov r12, rsi
+	EmitString( st, "48 89 D5" );		// mov rbp, rdx
+	EmitString( st, "41 89 CE" );		// mov r14d, ecx
+	EmitString( st, "4C 89 C3" );		// mov rbx, r8
+	EmitString( st, "41 FF D1" );		// call r9
+	EmitString( st, "41 8B 04 24" );	// mov eax, [r12]
+	EmitString( st, "48 83 C4 08" );	// add rsp, 8
+	EmitString( st, "41 5F 41 5E 41 5D 41 5C 5D 5B" );	// pop r15-r12, rbp, rbx
+	EmitString( st, "C3" );				// ret
+
+	// esi = pc, edx = code
+	st->fault_ofs = st->pos;
+	EmitString( st, "45 89 B7" );		// mov [r15 + LP], r14d
+	Emit4( st, (int) (qintptr_t) &((qvm_t *) 0)->LP );
+	EmitString( st, "4C 89 FF" );		// mov rdi, r15
+	EmitCallC( st, (void *) QVM_JIT_Fault );
+	EmitString( st, "CC" );				// int3, never returns
+
+	// entered with call, esi = pc
+	st->badcall_ofs = st->pos;
+	EmitString( st, "48 83 EC 08" );	// sub rsp, 8
+	Emit1( st, 0xBA );					// mov edx, JIT_ERR_CALL
+	Emit4( st, JIT_ERR_CALL );
+	Emit1( st, 0xE9 );
+	EmitRel32( st, st->fault_ofs );
+
+	// entered with jmp, esi = pc
+	st->badjump_ofs = st->pos;
+	Emit1( st, 0xBA );					// mov edx, JIT_ERR_JUMP
+	Emit4( st, JIT_ERR_JUMP );
+	Emit1( st, 0xE9 );
+	EmitRel32( st, st->fault_ofs );
+}
+
+/*
+  Analysis
+*/
+
+static int JIT_StackDelta( opcode_t op )
+{
+	switch ( op )
+	{
+	case OP_PUSH:
+	case OP_CONST:
+	case OP_LOCAL:
+		return 1;
+
+	case OP_POP:
+	case OP_JUMP:
+	case OP_ARG:
+	case OP_ADD:
+	case OP_SUB:
+	case OP_DIVI:
+	case OP_DIVU:
+	case OP_MODI:
+	case OP_MODU:
+	case OP_MULI:
+	case OP_MULU:
+	case OP_BAND:
+	case OP_BOR:
+	case OP_BXOR:
+	case OP_LSH:
+	case OP_RSHI:
+	case OP_RSHU:
+	case OP_ADDF:
+	case OP_SUBF:
+	case OP_DIVF:
+	case OP_MULF:
+		return -1;
+
+	case OP_EQ:
+	case OP_NE:
+	case OP_LTI:
+	case OP_LEI:
+	case OP_GTI:
+	case OP_GEI:
+	case OP_LTU:
+	case OP_LEU:
+	case OP_GTU:
+	case OP_GEU:
+	case OP_EQF:
+	case OP_NEF:
+	case OP_LTF:
+	case OP_LEF:
+	case OP_GTF:
+	case OP_GEF:
+	case OP_STORE1:
+	case OP_STORE2:
+	case OP_STORE4:
+	case OP_BLOCK_COPY:
+		return -2;
+
+	default:
+		return 0;	// OP_CALL pops the address, callee pushes the result
+	}
+}
+
+static qbool JIT_IsBranch( opcode_t op )
+{
+	return op >= OP_EQ && op <= OP_GEF;
+}
+
+static qbool JIT_CanFuse( opcode_t op, opcode_t next )
+{
+	if ( op == OP_CONST )
+		return next == OP_CALL || next == OP_JUMP || next == OP_LOAD1 || next == OP_LOAD2 || next == OP_LOAD4
+		    || next == OP_STORE1 || next == OP_STORE2 || next == OP_STORE4;
+	if ( op == OP_LOCAL )
+		return next == OP_LOAD4;
+	return false;
+}
+
+// record expected depth at branch target, false if it contradicts what is already known
+static qbool JIT_BranchTo( jitstate_t *st, int start, int end, int target, int depth )
+{
+	if ( target <= start || target >= end )
+		return false;
+	if ( st->depth[target] == DEPTH_UNKNOWN )
+		st->depth[target] = depth;
+	return st->depth[target] == depth;
+}
+
+static qbool JIT_Analyze( jitstate_t *st )
+{
+	qvm_t *qvm = st->qvm;
+	qvm_instruction_t *cs = qvm->cs;
+	int i, d, after, start, maxd;
+
+	if ( cs[0].opcode != OP_ENTER )
+		return false;
+
+	// function bounds and constant branch targets
+	start = 0;
+	for ( i = 0; i < qvm->len_cs; i++ )
+	{
+		st->depth[i] = DEPTH_UNKNOWN;
+
+		if ( cs[i].opcode > OP_CVFI )
+		{
+			Con_DPrintf( "QVM_JIT: invalid opcode %2.2x at %8x\n", cs[i].opcode, i );
+			return false;
+		}
+
+		if ( cs[i].opcode == OP_ENTER )
+		{
+			if ( cs[i].parm._int < 0 )
+				return false;
+			st->func_end[start] = i;
+			start = i;
+		}
+
+		if ( JIT_IsBranch( cs[i].opcode ) && (unsigned) cs[i].parm._int < (unsigned) qvm->len_cs )
+			st->flags[cs[i].parm._int] |= JF_TARGET;
+
+		if ( cs[i].opcode == OP_CONST && i + 1 < qvm->len_cs && cs[i + 1].opcode == OP_JUMP
+		        && (unsigned) cs[i].parm._int < (unsigned) qvm->len_cs )
+			st->flags[cs[i].parm._int] |= JF_TARGET;
+	}
+	st->func_end[start] = qvm->len_cs;
+
+	for ( i = 0; i + 1 < qvm->len_cs; i++ )
+	{
+		if ( JIT_CanFuse( cs[i].opcode, cs[i + 1].opcode ) && !( st->flags[i + 1] & JF_TARGET ) )
+		{
+			st->flags[i + 1] |= JF_SKIP;
+			i++;
+		}
+	}
+
+	// opStack depth, lcc keeps it empty at every label
+	start = 0;
+	maxd = 0;
+	d = 0;
+	for ( i = 0; i < qvm->len_cs; i++ )
+	{
+		if ( cs[i].opcode == OP_ENTER )
+		{
+			st->maxdepth[start] = maxd;
+			start = i;
+			maxd = 0;
+			d = 0;
+		}
+		else if ( d == DEPTH_UNKNOWN )
+		{
+			d = ( st->depth[i] == DEPTH_UNKNOWN ) ? 0 : st->depth[i];
+		}
+		else if ( st->depth[i] != DEPTH_UNKNOWN && st->depth[i] != d )
+		{
+			st->flags[i] |= JF_BAD;
+		}
+		st->depth[i] = d;
+
+		after = d + JIT_StackDelta( cs[i].opcode );
+		if ( after < 0 )
+		{
+			st->flags[i] |= JF_BAD;
+			d = DEPTH_UNKNOWN;
+			continue;
+		}
+		maxd = max( maxd, after );
+
+		switch ( cs[i].opcode )
+		{
+		case OP_LEAVE:
+			if ( d != 1 )
+				st->flags[i] |= JF_BAD;
+			after = DEPTH_UNKNOWN;
+			break;
+
+		case OP_JUMP:
+			if ( st->flags[i] & JF_SKIP )
+			{
+				if ( !JIT_BranchTo( st, start, st->func_end[start], cs[i - 1].parm._int, after ) )
+					st->flags[i] |= JF_BAD;
+			}
+			else if ( after != 0 )
+			{
+				st->flags[i] |= JF_BAD;
+			}
+			after = DEPTH_UNKNOWN;
+			break;
+
+		default:
+			if ( JIT_IsBranch( cs[i].opcode ) && !JIT_BranchTo( st, start, st->func_end[start], cs[i].parm._int, after ) )
+				st->flags[i] |= JF_BAD;
+			break;
+		}
+
+		d = after;
+	}
+	st->maxdepth[start] = maxd;
+
+	return true;
+}
+
+/*
+  Code generation
+*/
+
+static void JIT_CompileInstruction( jitstate_t *st, int i, int start )
+{
+	qvm_t *qvm = st->qvm;
+	qvm_instruction_t *cs = qvm->cs;
+	int parm = cs[i].parm._int;
+	int next, at, at2;
+
+	if ( st->flags[i] & JF_BAD )
+	{
+		EmitFault( st, JIT_ERR_OPSTACK, i );
+		return;
+	}
+
+	// fused pairs
+	if ( i + 1 < qvm->len_cs && ( st->flags[i + 1] & JF_SKIP ) )
+	{
+		next = cs[i + 1].opcode;
+
+		if ( st->flags[i + 1] & JF_BAD )
+		{
+			EmitFault( st, next == OP_JUMP ? JIT_ERR_JUMP : JIT_ERR_OPSTACK, i + 1 );
+			return;
+		}
+
+		if ( cs[i].opcode == OP_LOCAL )
+		{
+			// OP_LOCAL + OP_LOAD4
+			EmitString( st, "41 8D 86" );				// lea eax, [r14 + parm]
+			Emit4( st, parm );
+			EmitDataCheck( st, i + 1 );
+			EmitString( st, "8B 04 03" );				// mov eax, [rbx + rax]
+			EmitPushEax( st );
+			return;
+		}
+
+		switch ( next )
+		{
+		case OP_CALL:
+			EmitStoreReturn( st, i + 2 );
+			if ( parm < 0 )
+			{
+				Emit1( st, 0xB8 );						// mov eax, ~parm
+				Emit4( st, ~parm );
+				EmitSyscall( st );
+			}
+			else if ( parm < qvm->len_cs && cs[parm].opcode == OP_ENTER )
+			{
+				Emit1( st, 0xE8 );						// call func
+				EmitRel32( st, st->instr_ofs[parm] );
+			}
+			else
+			{
+				EmitFault( st, JIT_ERR_CALL, i + 1 );
+			}
+			return;
+
+		case OP_JUMP:
+			Emit1( st, 0xE9 );							// jmp target
+			EmitRel32( st, st->instr_ofs[parm] );
+			return;
+
+		case OP_LOAD1:
+		case OP_LOAD2:
+		case OP_LOAD4:
+			if ( parm & ~qvm->ds_mask )
+			{
+				EmitFault( st, JIT_ERR_DATA, i + 1 );
+				return;
+			}
+			if ( next == OP_LOAD1 )
+				EmitString( st, "0F BE 83" );			// movsx eax, byte [rbx + parm]
+			else if ( next == OP_LOAD2 )
+				EmitString( st, "0F BF 83" );			// movsx eax, word [rbx + parm]
+			else
+				EmitString( st, "8B 83" );				// mov eax, [rbx + parm]
+			Emit4( st, parm );
+			EmitPushEax( st );
+			return;
+
+		default:	// OP_STORE1, OP_STORE2, OP_STORE4
+			EmitPopEax( st );							// address
+			EmitDataCheck( st, i + 1 );
+			if ( next == OP_STORE1 )
+			{
+				EmitString( st, "C6 04 03" );			// mov byte [rbx + rax], parm
+				Emit1( st, parm );
+			}
+			else if ( next == OP_STORE2 )
+			{
+				EmitString( st, "66 C7 04 03" );		// mov word [rbx + rax], parm
+				Emit1( st, parm );
+				Emit1( st, parm >> 8 );
+			}
+			else
+			{
+				EmitString( st, "C7 04 03" );			// mov dword [rbx + rax], parm
+				Emit4( st, parm );
+			}
+			return;
+		}
+	}
+
+	switch ( cs[i].opcode )
+	{
+	case OP_UNDEF:
+	case OP_BREAK:
+		EmitFault( st, JIT_ERR_BREAK, i );
+		break;
+
+	case OP_IGNORE:
+		break;
+
+	case OP_ENTER:
+		EmitString( st, "48 83 EC 08" );				// sub rsp, 8
+		EmitString( st, "41 81 EE" );					// sub r14d, parm
+		Emit4( st, parm );
+		EmitString( st, "41 81 FE" );					// cmp r14d, len_ds - len_ss
+		Emit4( st, qvm->len_ds - qvm->len_ss );
+		EmitCheck( st, JCC_JGE, JIT_ERR_STACK_OVERFLOW, i );
+		EmitString( st, "42 C7 44 33 04" );				// mov dword [rbx + r14 + 4], parm
+		Emit4( st, parm );
+		if ( st->maxdepth[i] > OPSTACKSIZE )
+		{
+			EmitFault( st, JIT_ERR_OPSTACK, i );
+			break;
+		}
+		EmitString( st, "49 8D 84 24" );				// lea rax, [r12 + maxdepth * 4]
+		Emit4( st, st->maxdepth[i] * 4 );
+		EmitString( st, "48 39 E8" );					// cmp rax, rbp
+		EmitCheck( st, JCC_JBE, JIT_ERR_OPSTACK, i );
+		break;
+
+	case OP_LEAVE:
+		EmitString( st, "41 81 C6" );					// add r14d, parm
+		Emit4( st, parm );
+		EmitString( st, "41 81 FE" );					// cmp r14d, len_ds - 4
+		Emit4( st, qvm->len_ds - (int) sizeof( int ) );
+		EmitCheck( st, JCC_JBE, JIT_ERR_STACK_UNDERFLOW, i );
+		EmitString( st, "48 83 C4 08" );				// add rsp, 8
+		EmitString( st, "C3" );							// ret
+		break;
+
+	case OP_CALL:
+		EmitPopEax( st );
+		EmitStoreReturn( st, i + 1 );
+		EmitString( st, "85 C0" );						// test eax, eax
+		EmitString( st, "0F 88" );						// js syscall
+		at = EmitForward( st );
+		Emit1( st, 0x3D );								// cmp eax, len_cs
+		Emit4( st, qvm->len_cs );
+		EmitCheck( st, JCC_JB, JIT_ERR_CALL, i );
+		Emit1( st, 0xBE );								// mov esi, pc
+		Emit4( st, i );
+		EmitString( st, "48 B9" );						// mov rcx, calltab
+		Emit8( st, st->buf ? (quintptr_t) qvm->jit->calltab : 0 );
+		EmitString( st, "FF 14 C1" );					// call [rcx + rax * 8]
+		Emit1( st, 0xE9 );								// jmp done
+		at2 = EmitForward( st );
+		PatchRel32( st, at );
+		EmitString( st, "F7 D0" );						// syscall: not eax
+		EmitSyscall( st );
+		PatchRel32( st, at2 );
+		break;
+
+	case OP_PUSH:
+		EmitString( st, "49 83 C4 04" );				// add r12, 4
+		break;
+
+	case OP_POP:
+		EmitString( st, "49 83 EC 04" );				// sub r12, 4
+		break;
+
+	case OP_CONST:
+		EmitPushConst( st, parm );
+		break;
+
+	case OP_LOCAL:
+		EmitString( st, "41 8D 86" );					// lea eax, [r14 + parm]
+		Emit4( st, parm );
+		EmitPushEax( st );
+		break;
+
+	case OP_JUMP:
+		EmitPopEax( st );
+		EmitString( st, "8D 88" );						// lea ecx, [rax - start]
+		Emit4( st, -start );
+		EmitString( st, "81 F9" );						// cmp ecx, end - start
+		Emit4( st, st->func_end[start] - start );
+		EmitCheck( st, JCC_JB, JIT_ERR_JUMP, i );
+		Emit1( st, 0xBE );								// mov esi, pc
+		Emit4( st, i );
+		EmitString( st, "48 B9" );						// mov rcx, jumptab
+		Emit8( st, st->buf ? (quintptr_t) qvm->jit->jumptab : 0 );
+		EmitString( st, "FF 24 C1" );					// jmp [rcx + rax * 8]
+		break;
+
+	case OP_EQ:
+	case OP_NE:
+	case OP_LTI:
+	case OP_LEI:
+	case OP_GTI:
+	case OP_GEI:
+	case OP_LTU:
+	case OP_LEU:
+	case OP_GTU:
+	case OP_GEU:
+		{
+			static const byte jcc[] = { 0x84, 0x85, 0x8C, 0x8E, 0x8F, 0x8D, 0x82, 0x86, 0x87, 0x83 };
+
+			EmitString( st, "49 83 EC 08" );			// sub r12, 8
+			EmitString( st, "41 8B 44 24 04" );			// mov eax, [r12 + 4]
+			EmitString( st, "41 3B 44 24 08" );			// cmp eax, [r12 + 8]
+			Emit1( st, 0x0F );							// jcc target
+			Emit1( st, jcc[cs[i].opcode - OP_EQ] );
+			EmitRel32( st, st->instr_ofs[parm] );
+		}
+		break;
+
+	case OP_EQF:
+	case OP_NEF:
+	case OP_LTF:
+	case OP_LEF:
+	case OP_GTF:
+	case OP_GEF:
+		EmitString( st, "49 83 EC 08" );				// sub r12, 8
+		EmitString( st, "F3 41 0F 10 44 24 04" );		// movss xmm0, [r12 + 4]
+		EmitString( st, "F3 41 0F 10 4C 24 08" );		// movss xmm1, [r12 + 8]
+		switch ( cs[i].opcode )
+		{
+		case OP_EQF:
+			EmitString( st, "0F 2E C1" );				// ucomiss xmm0, xmm1
+			EmitString( st, "7A 06 0F 84" );			// jp skip, je target
+			break;
+		case OP_NEF:
+			EmitString( st, "0F 2E C1" );				// ucomiss xmm0, xmm1
+			EmitString( st, "0F 8A" );					// jp target
+			EmitRel32( st, st->instr_ofs[parm] );
+			EmitString( st, "0F 85" );					// jne target
+			break;
+		case OP_LTF:
+			EmitString( st, "0F 2E C8" );				// ucomiss xmm1, xmm0
+			EmitString( st, "0F 87" );					// ja target
+			break;
+		case OP_LEF:
+			EmitString( st, "0F 2E C8" );				// ucomiss xmm1, xmm0
+			EmitString( st, "0F 83" );					// jae target
+			break;
+		case OP_GTF:
+			EmitString( st, "0F 2E C1" );				// ucomiss xmm0, xmm1
+			EmitString( st, "0F 87" );					// ja target
+			break;
+		default:
+			EmitString( st, "0F 2E C1" );				// ucomiss xmm0, xmm1
+			EmitString( st, "0F 83" );					// jae target
+			break;
+		}
+		EmitRel32( st, st->instr_ofs[parm] );
+		break;
+
+	case OP_LOAD1:
+	case OP_LOAD2:
+	case OP_LOAD4:
+		EmitString( st, "41 8B 04 24" );				// mov eax, [r12]
+		EmitDataCheck( st, i );
+		if ( cs[i].opcode == OP_LOAD1 )
+			EmitString( st, "0F BE 04 03" );			// movsx eax, byte [rbx + rax]
+		else if ( cs[i].opcode == OP_LOAD2 )
+			EmitString( st, "0F BF 04 03" );			// movsx eax, word [rbx + rax]
+		else
+			EmitString( st, "8B 04 03" );				// mov eax, [rbx + rax]
+		EmitString( st, "41 89 04 24" );				// mov [r12], eax
+		break;
+
+	case OP_STORE1:
+	case OP_STORE2:
+	case OP_STORE4:
+		EmitString( st, "41 8B 44 24 FC" );				// mov eax, [r12 - 4]
+		EmitDataCheck( st, i );
+		EmitString( st, "41 8B 0C 24" );				// mov ecx, [r12]
+		if ( cs[i].opcode == OP_STORE1 )
+			EmitString( st, "88 0C 03" );				// mov [rbx + rax], cl
+		else if ( cs[i].opcode == OP_STORE2 )
+			EmitString( st, "66 89 0C 03" );			// mov [rbx + rax], cx
+		else
+			EmitString( st, "89 0C 03" );				// mov [rbx + rax], ecx
+		EmitString( st, "49 83 EC 08" );				// sub r12, 8
+		break;
+
+	case OP_ARG:
+		EmitString( st, "41 8D 86" );					// lea eax, [r14 + parm]
+		Emit4( st, parm );
+		EmitDataCheck( st, i );
+		EmitString( st, "41 8B 0C 24" );				// mov ecx, [r12]
+		EmitString( st, "49 83 EC 04" );				// sub r12, 4
+		EmitString( st, "89 0C 03" );					// mov [rbx + rax], ecx
+		break;
+
+	case OP_BLOCK_COPY:
+		EmitString( st, "41 8B 74 24 FC" );				// mov esi, [r12 - 4]
+		EmitString( st, "41 8B 14 24" );				// mov edx, [r12]
+		EmitString( st, "49 83 EC 08" );				// sub r12, 8
+		Emit1( st, 0xB9 );								// mov ecx, parm
+		Emit4( st, parm );
+		EmitString( st, "45 89 B7" );					// mov [r15 + LP], r14d
+		Emit4( st, (int) (qintptr_t) &((qvm_t *) 0)->LP );
+		EmitString( st, "4C 89 FF" );					// mov rdi, r15
+		EmitCallC( st, (void *) QVM_JIT_BlockCopy );
+		break;
+
+	case OP_SEX8:
+		EmitString( st, "41 0F BE 04 24" );				// movsx eax, byte [r12]
+		EmitString( st, "41 89 04 24" );				// mov [r12], eax
+		break;
+
+	case OP_SEX16:
+		EmitString( st, "41 0F BF 04 24" );				// movsx eax, word [r12]
+		EmitString( st, "41 89 04 24" );				// mov [r12], eax
+		break;
+
+	case OP_NEGI:
+		EmitString( st, "41 F7 1C 24" );				// neg dword [r12]
+		break;
+
+	case OP_BCOM:
+		EmitString( st, "41 F7 14 24" );				// not dword [r12]
+		break;
+
+	case OP_ADD:
+	case OP_SUB:
+	case OP_BAND:
+	case OP_BOR:
+	case OP_BXOR:
+		EmitPopEax( st );
+		switch ( cs[i].opcode )
+		{
+		case OP_ADD:	EmitString( st, "41 01 04 24" ); break;	// add [r12], eax
+		case OP_SUB:	EmitString( st, "41 29 04 24" ); break;	// sub [r12], eax
+		case OP_BAND:	EmitString( st, "41 21 04 24" ); break;	// and [r12], eax
+		case OP_BOR:	EmitString( st, "41 09 04 24" ); break;	// or [r12], eax
+		default:		EmitString( st, "41 31 04 24" ); break;	// xor [r12], eax
+		}
+		break;
+
+	case OP_MULI:
+	case OP_MULU:
+		EmitString( st, "41 8B 44 24 FC" );				// mov eax, [r12 - 4]
+		EmitString( st, "41 0F AF 04 24" );				// imul eax, [r12]
+		EmitString( st, "49 83 EC 04" );				// sub r12, 4
+		EmitString( st, "41 89 04 24" );				// mov [r12], eax
+		break;
+
+	case OP_DIVI:
+	case OP_DIVU:
+	case OP_MODI:
+	case OP_MODU:
+		EmitString( st, "41 8B 44 24 FC" );				// mov eax, [r12 - 4]
+		if ( cs[i].opcode == OP_DIVI || cs[i].opcode == OP_MODI )
+			EmitString( st, "99 41 F7 3C 24" );			// cdq, idiv dword [r12]
+		else
+			EmitString( st, "31 D2 41 F7 34 24" );		// xor edx, edx, div dword [r12]
+		EmitString( st, "49 83 EC 04" );				// sub r12, 4
+		if ( cs[i].opcode == OP_DIVI || cs[i].opcode == OP_DIVU )
+			EmitString( st, "41 89 04 24" );			// mov [r12], eax
+		else
+			EmitString( st, "41 89 14 24" );			// mov [r12], edx
+		break;
+
+	case OP_LSH:
+	case OP_RSHI:
+	case OP_RSHU:
+		EmitString( st, "41 8B 0C 24" );				// mov ecx, [r12]
+		EmitString( st, "49 83 EC 04" );				// sub r12, 4
+		if ( cs[i].opcode == OP_LSH )
+			EmitString( st, "41 D3 24 24" );			// shl dword [r12], cl
+		else if ( cs[i].opcode == OP_RSHI )
+			EmitString( st, "41 D3 3C 24" );			// sar dword [r12], cl
+		else
+			EmitString( st, "41 D3 2C 24" );			// shr dword [r12], cl
+		break;
+
+	case OP_NEGF:
+		EmitString( st, "41 81 34 24 00 00 00 80" );	// xor dword [r12], 0x80000000
+		break;
+
+	case OP_ADDF:
+	case OP_SUBF:
+	case OP_DIVF:
+	case OP_MULF:
+		EmitString( st, "F3 41 0F 10 44 24 FC" );		// movss xmm0, [r12 - 4]
+		switch ( cs[i].opcode )
+		{
+		case OP_ADDF:	EmitString( st, "F3 41 0F 58 04 24" ); break;	// addss xmm0, [r12]
+		case OP_SUBF:	EmitString( st, "F3 41 0F 5C 04 24" ); break;	// subss xmm0, [r12]
+		case OP_DIVF:	EmitString( st, "F3 41 0F 5E 04 24" ); break;	// divss xmm0, [r12]
+		default:		EmitString( st, "F3 41 0F 59 04 24" ); break;	// mulss xmm0, [r12]
+		}
+		EmitString( st, "49 83 EC 04" );				// sub r12, 4
+		EmitString( st, "F3 41 0F 11 04 24" );			// movss [r12], xmm0
+		break;
+
+	case OP_CVIF:
+		EmitString( st, "F3 41 0F 2A 04 24" );			// cvtsi2ss xmm0, dword [r12]
+		EmitString( st, "F3 41 0F 11 04 24" );			// movss [r12], xmm0
+		break;
+
+	case OP_CVFI:
+		EmitString( st, "F3 41 0F 2C 04 24" );			// cvttss2si eax, dword [r12]
+		EmitString( st, "41 89 04 24" );				// mov [r12], eax
+		break;
+	}
+}
+
+static void JIT_Generate( jitstate_t *st )
+{
+	int i, start = 0;
+
+	st->pos = 0;
+	EmitStubs( st );
+
+	for ( i = 0; i < st->qvm->len_cs; i++ )
+	{
+		if ( st->qvm->cs[i].opcode == OP_ENTER )
+			start = i;
+
+		if ( st->buf && st->instr_ofs[i] != st->pos )
+			Sys_Error( "QVM_JIT: instruction %d moved between passes", i );
+		st->instr_ofs[i] = st->pos;
+
+		if ( st->flags[i] & JF_SKIP )
+			continue;
+
+		JIT_CompileInstruction( st, i, start );
+	}
+}
+
+void QVM_JIT_Free( qvm_t * qvm )
+{
+	qvm_jit_t *jit = qvm->jit;
+
+	if ( !jit )
+		return;
+
+	if ( jit->code )
+		munmap( jit->code, jit->code_size );
+	Q_free( jit->calltab );
+	Q_free( jit->jumptab );
+	Q_free( qvm->jit );
+}
+
+qbool QVM_JIT_Compile( qvm_t * qvm )
+{
+	jitstate_t st;
+	qvm_jit_t *jit;
+	int i, n = qvm->len_cs;
+	qbool ok = false;
+	double start = Sys_DoubleTime();
+
+	QVM_JIT_Free( qvm );
+
+	memset( &st, 0, sizeof( st ) );
+	st.qvm = qvm;
+	st.instr_ofs = (int *) Q_malloc( n * sizeof( int ) );
+	st.depth = (int *) Q_malloc( n * sizeof( int ) );
+	st.maxdepth = (int *) Q_malloc( n * sizeof( int ) );
+	st.func_end = (int *) Q_malloc( n * sizeof( int ) );
+	st.flags = (byte *) Q_malloc( n );
+
+	if ( !JIT_Analyze( &st ) )
+	{
+		Con_Printf( "QVM_JIT: unsupported bytecode, using interpreter\n" );
+		goto done;
+	}
+
+	jit = qvm->jit = (qvm_jit_t *) Q_malloc( sizeof( qvm_jit_t ) );
+	jit->calltab = (void **) Q_malloc( n * sizeof( void * ) );
+	jit->jumptab = (void **) Q_malloc( n * sizeof( void * ) );
+
+	// sizing pass, then the real one with all offsets known
+	JIT_Generate( &st );
+	if ( st.pos > n * JIT_MAX_INSTRUCTION_SIZE + 4096 )
+		Sys_Error( "QVM_JIT: code size %d out of bounds", st.pos );
+
+	jit->code_size = st.pos;
+	jit->code = (byte *) mmap( NULL, jit->code_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+	if ( jit->code == (byte *) MAP_FAILED )
+	{
+		jit->code = NULL;
+		Con_Printf( "QVM_JIT: can't allocate %d bytes, using interpreter\n", jit->code_size );
+		QVM_JIT_Free( qvm );
+		goto done;
+	}
+
+	st.buf = jit->code;
+	JIT_Generate( &st );
+
+	for ( i = 0; i < n; i++ )
+	{
+		jit->calltab[i] = jit->code + ( qvm->cs[i].opcode == OP_ENTER ? st.instr_ofs[i] : st.badcall_ofs );
+		jit->jumptab[i] = jit->code + ( st.depth[i] == 0 && qvm->cs[i].opcode != OP_ENTER && !( st.flags[i] & JF_SKIP )
+		                                ? st.instr_ofs[i] : st.badjump_ofs );
+	}
+
+	if ( mprotect( jit->code, jit->code_size, PROT_READ | PROT_EXEC ) )
+	{
+		Con_Printf( "QVM_JIT: can't make code executable, using interpreter\n" );
+		QVM_JIT_Free( qvm );
+		goto done;
+	}
+
+	jit->entry = (int (*)(qvm_t *, int *, int *, int, byte *, void *)) jit->code;
+	ok = true;
+
+	Con_DPrintf( "QVM_JIT: %d instructions compiled to %d bytes in %.3f sec\n", n, jit->code_size, Sys_DoubleTime() - start );
+
+done:
+	Q_free( st.instr_ofs );
+	Q_free( st.depth );
+	Q_free( st.maxdepth );
+	Q_free( st.func_end );
+	Q_free( st.flags );
+	return ok;
+}
+
+int QVM_JIT_Exec( qvm_t * qvm, int command, int arg0, int arg1, int arg2, int arg3,
+                  int arg4, int arg5, int arg6, int arg7, int arg8, int arg9, int arg10, int arg11 )
+{
+	int opStack[OPSTACKSIZE + 1];
+	int savePC, saveSP, saveLP, ret;
+	int *args;
+
+	savePC = qvm->PC;
+	saveSP = qvm->SP;
+	saveLP = qvm->LP;
+
+	if ( !qvm->reenter )
+		qvm->LP = qvm->len_ds - sizeof(int);
+	if ( qvm->reenter++ > MAX_vmMain_Call )
+		QVM_RunError( qvm, "QVM_Exec MAX_vmMain_Call reached");
+
+	qvm->LP -= 14 * sizeof(int);
+
+	args = (int *) ( qvm->ds + qvm->LP );
+	args[0]  = 0;	// return addres;
+	args[1]  = 14 * sizeof(int);
+	args[2]  = command;
+	args[3]  = arg0;
+	args[4]  = arg1;
+	args[5]  = arg2;
+	args[6]  = arg3;
+	args[7]  = arg4;
+	args[8]  = arg5;
+	args[9]  = arg6;
+	args[10] = arg7;
+	args[11] = arg8;
+	args[12] = arg9;
+	args[13] = arg10;
+	args[14] = arg11;
+
+	opStack[0] = 0;
+	ret = qvm->jit->entry( qvm, opStack, opStack + OPSTACKSIZE, qvm->LP, qvm->ds, qvm->jit->calltab[0] );
+
+	qvm->PC = savePC;
+	qvm->SP = saveSP;
+	qvm->LP = saveLP;
+	qvm->reenter--;
+	return ret;
+}
+
+#endif /* QVM_JIT */
+
+#endif /* USE_PR2 */
@@ -3101,6 +3101,16 @@ void PF_setpause (void)
 		SV_TogglePause (NULL, 1);
 }
 
+// EZ_ANTILAG
+// float(float enable) setantilag = #533;
+// with sv_antilag 2, the traces of the player whose move is being run are
+// only lag compensated between setantilag(1) and setantilag(0)
+void PF_setantilag (void)
+{
+	G_FLOAT(OFS_RETURN) = sv_antilag_requested;
+	sv_antilag_requested = G_FLOAT(OFS_PARM0) ? true : false;
+}
+
 
 /*
 ==============
@@ -3119,6 +3129,7 @@ static void PF_checkextension (void)
 		"DP_QC_SINCOSSQRTPOW",      // http://wiki.quakesrc.org/index.php/DP_QC_SINCOSSQRTPOW
 		"DP_QC_TRACEBOX",			// http://wiki.quakesrc.org/index.php/DP_QC_TRACEBOX
 		"DP_REGISTERCVAR",			// http://wiki.quakesrc.org/index.php/DP_REGISTERCVAR
+		"EZ_ANTILAG",
 		"FTE_CALLTIMEOFDAY",        // http://wiki.quakesrc.org/index.php/FTE_CALLTIMEOFDAY
 		"QSG_CVARSTRING",			// http://wiki.quakesrc.org/index.php/QSG_CVARSTRING
 		"ZQ_CLIENTCOMMAND",			// http://wiki.quakesrc.org/index.php/ZQ_CLIENTCOMMAND
@@ -3315,6 +3326,7 @@ static struct { int num; builtin_t func; } ext_builtins[] =
 {448, PF_cvar_string},	// string(string varname) cvar_string
 {531,PF_setpause},		//void(float pause) setpause
 {532,PF_precache_vwep_model},	// float(string model) precache_vwep_model = #532;
+{533,PF_setantilag},	// float(float enable) setantilag = #533;
 };
 
 #define num_ext_builtins (sizeof(ext_builtins)/sizeof(ext_builtins[0]))
@@ -0,0 +1,248 @@
+/*
+Copyright (C) 2026 ezQuake team
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  
+
+See the included (GNU.txt) GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#include <SDL_thread.h>
+#include "quakedef.h"
+#include "prefetch.h"
+
+#define MAX_PREFETCH_THREADS	8
+#define MAX_PREFETCH_BYTES		(64 * 1024 * 1024)	// file data waiting to be decoded or taken
+
+enum { PF_QUEUED, PF_RUNNING, PF_DONE };
+
+cvar_t cl_loadthreads = {"cl_loadthreads", "2"};
+
+static SDL_mutex *prefetch_mutex;
+static SDL_cond *prefetch_wake;		// new job queued
+static SDL_cond *prefetch_done;		// job finished
+static int prefetch_numthreads;
+
+static prefetch_t *prefetch_jobs;	// all jobs, newest first
+static int prefetch_bytes;
+
+static Q_THREADLOCAL prefetch_t *prefetch_current;	// job this thread is running
+
+static void Prefetch_Run(prefetch_t *job)
+{
+	prefetch_current = job;
+	job->run(job);
+	job->file = NULL;
+	prefetch_current = NULL;
+}
+
+void Prefetch_Printf(const char *fmt, ...)
+{
+	va_list argptr;
+	char msg[256];
+	int len;
+
+	va_start(argptr, fmt);
+	vsnprintf(msg, sizeof(msg), fmt, argptr);
+	va_end(argptr);
+
+	if (!prefetch_current) {
+		Com_Printf("%s", msg);
+		return;
+	}
+
+	len = strlen(prefetch_current->error);
+	strlcpy(prefetch_current->error + len, msg, sizeof(prefetch_current->error) - len);
+}
+
+// oldest queued job, must hold the mutex
+static prefetch_t *Prefetch_NextQueued(void)
+{
+	prefetch_t *job, *found = NULL;
+
+	for (job = prefetch_jobs; job; job = job->next) {
+		if (job->state == PF_QUEUED)
+			found = job;
+	}
+
+	return found;
+}
+
+static int Prefetch_Thread(void *unused)
+{
+	prefetch_t *job;
+
+	SDL_LockMutex(prefetch_mutex);
+	while (1) {
+		if (!(job = Prefetch_NextQueued())) {
+			SDL_CondWait(prefetch_wake, prefetch_mutex);
+			continue;
+		}
+
+		job->state = PF_RUNNING;
+		SDL_UnlockMutex(prefetch_mutex);
+
+		Prefetch_Run(job);
+
+		SDL_LockMutex(prefetch_mutex);
+		job->state = PF_DONE;
+		SDL_CondBroadcast(prefetch_done);
+	}
+
+	return 0;
+}
+
+// workers are started on demand and never stopped
+static int Prefetch_StartThreads(int count)
+{
+	count = bound(0, count, MAX_PREFETCH_THREADS);
+
+	if (!prefetch_mutex && count) {
+		prefetch_mutex = SDL_CreateMutex();
+		prefetch_wake = SDL_CreateCond();
+		prefetch_done = SDL_CreateCond();
+
+		if (!prefetch_mutex || !prefetch_wake || !prefetch_done) {
+			Com_Printf("WARNING: cl_loadthreads: can't create mutex\n");
+			Cvar_SetValue(&cl_loadthreads, 0);
+			return 0;
+		}
+	}
+
+	while (prefetch_numthreads < count) {
+		if (!SDL_CreateThread(Prefetch_Thread, "prefetch", NULL)) {
+			Com_Printf("WARNING: cl_loadthreads: can't create thread\n");
+			Cvar_SetValue(&cl_loadthreads, prefetch_numthreads);
+			break;
+		}
+		prefetch_numthreads++;
+	}
+
+	return prefetch_numthreads;
+}
+
+// image decoders print their complaints with developer set, keep those on the main thread
+qbool Prefetch_Active(void)
+{
+	return cl_loadthreads.integer > 0 && !developer.integer && prefetch_bytes < MAX_PREFETCH_BYTES;
+}
+
+qbool Prefetch_Add(const char *name, void (*run)(prefetch_t *job), void *param, byte *file, int filelen)
+{
+	prefetch_t *job;
+
+	if (!Prefetch_Active() || !Prefetch_StartThreads(cl_loadthreads.integer)) {
+		Q_free(file);
+		Q_free(param);
+		return false;
+	}
+
+	job = Q_calloc(1, sizeof(*job));
+	strlcpy(job->name, name, sizeof(job->name));
+	job->run = run;
+	job->param = param;
+	job->file = file;
+	job->filelen = filelen;
+	job->state = PF_QUEUED;
+
+	SDL_LockMutex(prefetch_mutex);
+	job->next = prefetch_jobs;
+	prefetch_jobs = job;
+	prefetch_bytes += filelen;
+	SDL_CondSignal(prefetch_wake);
+	SDL_UnlockMutex(prefetch_mutex);
+
+	return true;
+}
+
+prefetch_t *Prefetch_Take(const char *name)
+{
+	prefetch_t *job, **prev;
+
+	if (!prefetch_jobs)
+		return NULL;
+
+	SDL_LockMutex(prefetch_mutex);
+	for (prev = &prefetch_jobs; (job = *prev); prev = &job->next) {
+		if (!strcmp(job->name, name))
+			break;
+	}
+
+	if (!job) {
+		SDL_UnlockMutex(prefetch_mutex);
+		return NULL;
+	}
+
+	*prev = job->next;
+	prefetch_bytes -= job->filelen;
+
+	if (job->state == PF_QUEUED) {
+		// no worker got to it yet, quicker to do it here than to wait
+		SDL_UnlockMutex(prefetch_mutex);
+		Prefetch_Run(job);
+	}
+	else {
+		while (job->state != PF_DONE)
+			SDL_CondWait(prefetch_done, prefetch_mutex);
+		SDL_UnlockMutex(prefetch_mutex);
+	}
+
+	if (job->error[0])
+		Com_Printf("%s", job->error);
+
+	return job;
+}
+
+void Prefetch_Free(prefetch_t *job)
+{
+	Q_free(job->file);
+	Q_free(job->data);
+	Q_free(job->param);
+	Q_free(job);
+}
+
+void Prefetch_Flush(void)
+{
+	prefetch_t *job, *next;
+
+	if (!prefetch_jobs)
+		return;
+
+	SDL_LockMutex(prefetch_mutex);
+	for (job = prefetch_jobs; job; job = job->next) {
+		if (job->state == PF_QUEUED)
+			job->state = PF_DONE; // just drop it, the file is freed with the job
+	}
+	for (job = prefetch_jobs; job; job = job->next) {
+		while (job->state != PF_DONE)
+			SDL_CondWait(prefetch_done, prefetch_mutex);
+	}
+
+	job = prefetch_jobs;
+	prefetch_jobs = NULL;
+	prefetch_bytes = 0;
+	SDL_UnlockMutex(prefetch_mutex);
+
+	for ( ; job; job = next) {
+		next = job->next;
+		Prefetch_Free(job);
+	}
+}
+
+void Prefetch_Init(void)
+{
+	Cvar_SetCurrentGroup(CVAR_GROUP_SYSTEM_SETTINGS);
+	Cvar_Register(&cl_loadthreads);
+	Cvar_ResetCurrentGroup();
+}
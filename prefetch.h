@@ -0,0 +1,65 @@
+/*
+Copyright (C) 2026 ezQuake team
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  
+
+See the included (GNU.txt) GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+// Background decoding of assets during map load.
+//
+// The file system is not thread safe, so files are read on the main thread when
+// a job is added, workers only turn the file contents into pixels/samples. Loaders
+// look for a finished job under the same name before doing the work themselves.
+
+#ifndef __PREFETCH_H__
+#define __PREFETCH_H__
+
+typedef struct prefetch_s {
+	char		name[MAX_OSPATH];		// file the job was made from
+	void		(*run)(struct prefetch_s *job);	// called on a worker, must free file
+	void		*param;					// Q_malloc'ed, freed with the job
+
+	byte		*file;
+	int			filelen;
+
+	byte		*data;					// result, Q_malloc'ed, NULL if decoding failed
+	int			width, height;			// image size or data length
+	char		error[256];				// what the decoder printed, see Prefetch_Printf
+
+	int			state;
+	struct prefetch_s *next;
+} prefetch_t;
+
+void Prefetch_Init(void);
+
+// false if prefetching is off, or enough data is waiting already
+qbool Prefetch_Active(void);
+
+// takes ownership of file and param, even when it returns false
+qbool Prefetch_Add(const char *name, void (*run)(prefetch_t *job), void *param, byte *file, int filelen);
+
+// finished job for name or NULL, runs or waits for it if needed. Free with Prefetch_Free
+prefetch_t *Prefetch_Take(const char *name);
+void Prefetch_Free(prefetch_t *job);
+
+// drop everything nobody asked for
+void Prefetch_Flush(void);
+
+// for decoders: Com_Printf on the main thread, on a worker the message is kept with
+// the job and printed by Prefetch_Take
+void Prefetch_Printf(const char *fmt, ...);
+
+#endif // __PREFETCH_H__
@@ -56,6 +56,10 @@ typedef struct sv_edict_s
 	int			num_leafs;
 	short		leafnums[MAX_ENT_LEAFS];
 
+	int			num_leafwords;				// leafnums folded into 32 bit pvs words, for word-wise pvs checks
+	int			leafwords[MAX_ENT_LEAFS];	// word index in the pvs
+	unsigned int	leafbits[MAX_ENT_LEAFS];	// leaf bits within that word, in memory byte order
+
 	entity_state_t	baseline;
 
 	float		freetime;		// sv.time when the object was freed
@@ -67,6 +67,13 @@ typedef unsigned char byte;
 #define IS_SLASH(c) ((c) == '/')
 #endif
 
+// a variable every thread has its own copy of
+#ifdef _MSC_VER
+#define Q_THREADLOCAL __declspec(thread)
+#else
+#define Q_THREADLOCAL __thread
+#endif
+
 #ifndef min
 #define min(a,b) ((a) < (b) ? (a) : (b))
 #endif
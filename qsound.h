@@ -90,6 +90,7 @@ void S_Update (vec3_t origin, vec3_t v_forward, vec3_t v_right, vec3_t v_up);
 void S_ExtraUpdate (void);
 
 sfx_t *S_PrecacheSound (char *sample);
+void S_PrefetchSound (char *sample);
 void S_PaintChannels(int endtime);
 
 /////////////////////////////////
@@ -107,6 +108,7 @@ void SNDDMA_Submit(void);
 void S_LocalSound (char *s);
 void S_LocalSoundWithVol(char *sound, float volume);
 sfxcache_t *S_LoadSound (sfx_t *s);
+void S_PrefetchSfx (sfx_t *s);
 
 void SND_InitScaletable (void);
 int SND_Rate(int rate);
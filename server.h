@@ -161,6 +161,17 @@ typedef struct
 	packet_entities_t	entities;
 } client_frame_t;
 
+// lag compensation: where the player was at the end of each server frame
+#define	MAX_ANTILAG_POSITIONS	64		// must be power of two
+
+typedef struct
+{
+	double			localtime;			// realtime of the frame the position was sent in
+	vec3_t			origin;
+	vec3_t			mins, maxs;
+	qbool			solid;
+} antilag_position_t;
+
 #define MAX_BACK_BUFFERS	128
 #define MAX_STUFFTEXT		256
 #define	CLIENT_LOGIN_LEN	16
@@ -232,6 +243,9 @@ typedef struct client_s
 
 	client_frame_t	frames[UPDATE_BACKUP];		// updates can be deltad from here
 
+	antilag_position_t	antilag_positions[MAX_ANTILAG_POSITIONS];
+	int				antilag_position_next;
+
 	vfsfile_t		*download;			// file being downloaded
 
 #ifdef PROTOCOL_VERSION_FTE
@@ -374,6 +388,19 @@ typedef enum {DEST_NONE, DEST_FILE, DEST_BUFFEREDFILE, DEST_STREAM} desttype_t;
 
 #define MAX_PROXY_INBUFFER		4096 /* qqshka: too small??? */
 
+// MVD data for QTV streams is stored once in a list of shared chunks,
+// each stream dest only keeps its read position in that list
+#define MVD_STREAM_CHUNK_SIZE	16384
+
+typedef struct mvdchunk_s
+{
+	struct mvddest_s	*target;	// NULL if chunk is for all streams, otherwise data for this dest only
+	int					used;
+	int					refs;		// number of stream dests which read position is in this chunk
+	struct mvdchunk_s	*next;
+	byte				data[MVD_STREAM_CHUNK_SIZE];
+} mvdchunk_t;
+
 typedef struct mvddest_s
 {
 	qbool error; //disables writers, quit ASAP.
@@ -393,6 +420,8 @@ typedef struct mvddest_s
 	unsigned int totalsize;
 
 // { used by QTV
+	mvdchunk_t		*chunk; // read position in the shared stream data, cacheused is amount of pending bytes
+	int				chunkpos;
 	double			io_time; // when last IO occur on socket, so we can timeout this dest
 	int				id; // dest id, used by QTV only
 	netadr_t		na;
@@ -786,6 +815,7 @@ void SV_BeginRedirect (redirect_t rd);
 void SV_EndRedirect (void);
 
 void SV_Multicast (vec3_t origin, int to);
+unsigned int SV_MulticastClients (vec3_t origin, int to);
 void SV_StartParticle (vec3_t org, vec3_t dir, int color, int count,
 					   int replacement_te, int replacement_count);
 void SV_StartSound (edict_t *entity, int channel, char *sample, int volume,
@@ -870,6 +900,7 @@ mvddest_t	*DestByName (char *name);
 void		DestClose (mvddest_t *d, qbool destroyfiles);
 
 int DemoWriteDest (void *data, int len, mvddest_t *d);
+int MVD_StreamWrite (void *data, int len, mvddest_t *target);
 
 extern demo_t	demo; // server demo struct
 
@@ -23,6 +23,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "quakedef.h"
 #include "qsound.h"
 #include "utils.h"
+#include "prefetch.h"
 #define SELF_SOUND 0xFFEFFFFF // [EZH] Fan told me 0xFFEFFFFF is damn cool value for it :P
 
 #ifdef _WIN32
@@ -317,6 +318,23 @@ sfx_t *S_PrecacheSound (char *name)
 	return sfx;
 }
 
+// Gets the sound converting in the background ahead of S_PrecacheSound.
+void S_PrefetchSound (char *name)
+{
+	sfx_t *sfx;
+
+	if (!snd_initialized || !snd_started || s_nosound.value || !s_precache.value)
+		return;
+
+	if (name == NULL || name[0] == 0 || !Prefetch_Active())
+		return;
+
+	if (!(sfx = S_FindName (name)) || Cache_Check (&sfx->cache))
+		return;
+
+	S_PrefetchSfx (sfx);
+}
+
 //=============================================================================
 
 // picks a channel based on priorities, empty slots, number of channels
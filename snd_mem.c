@@ -23,6 +23,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "quakedef.h"
 #include "fmod.h"
 #include "qsound.h"
+#include "prefetch.h"
 
 #define LINEARUPSCALE(in, inrate, insamps, out, outrate, outlshift, outrshift) \
 	{ \
@@ -534,41 +535,31 @@ void SND_ResampleStream (void *in, int inrate, int inwidth, int inchannels, int
 #endif
 }
 
-/*
-================
-ResampleSfx
-================
-*/
-void ResampleSfx (sfx_t *sfx, int inrate, int inchannels, int inwidth, int insamps, int inloopstart, byte *data)
+static int SND_SfxWidth (int inwidth)
 {
-	extern cvar_t s_linearresample;
-	double scale;
-	sfxcache_t	*sc;
-	int len;
-	int outsamps;
-	int outwidth;
-	int outchannels = 1; // inchannels;
-
-	scale = shm->format.speed / (double)inrate;
-	outsamps = insamps * scale;
 	if (s_loadas8bit.integer < 0)
-		outwidth = 2;
+		return 2;
 	else if (s_loadas8bit.integer)
-		outwidth = 1;
+		return 1;
 	else
-		outwidth = inwidth;
-	len = outsamps * outwidth * outchannels;
+		return inwidth;
+}
 
-	sc = Cache_Alloc (&sfx->cache, len + sizeof(sfxcache_t), sfx->name);
-	if (!sc)
-	{
-		return;
-	}
+// length of insamps at inrate once resampled to outrate
+static int SND_SfxSamples (int inrate, int insamps, int outrate)
+{
+	return insamps * (outrate / (double)inrate);
+}
+
+static void SND_FillSfxCache (sfxcache_t *sc, int outrate, int outwidth, int resampstyle,
+							  int inrate, int inchannels, int inwidth, int insamps, int inloopstart, byte *data)
+{
+	double scale = outrate / (double)inrate;
 
-	sc->format.channels = outchannels;
+	sc->format.channels = 1; // inchannels;
 	sc->format.width = outwidth;
-	sc->format.speed = shm->format.speed;
-	sc->total_length = outsamps;
+	sc->format.speed = outrate;
+	sc->total_length = SND_SfxSamples (inrate, insamps, outrate);
 	if (inloopstart == -1)
 		sc->loopstart = inloopstart;
 	else
@@ -583,7 +574,29 @@ void ResampleSfx (sfx_t *sfx, int inrate, int inchannels, int inwidth, int insam
 		sc->format.speed, 
 		sc->format.width, 
 		sc->format.channels, 
-		s_linearresample.integer);
+		resampstyle);
+}
+
+/*
+================
+ResampleSfx
+================
+*/
+void ResampleSfx (sfx_t *sfx, int inrate, int inchannels, int inwidth, int insamps, int inloopstart, byte *data)
+{
+	extern cvar_t s_linearresample;
+	sfxcache_t	*sc;
+	int outwidth = SND_SfxWidth (inwidth);
+	int len = SND_SfxSamples (inrate, insamps, shm->format.speed) * outwidth;
+
+	sc = Cache_Alloc (&sfx->cache, len + sizeof(sfxcache_t), sfx->name);
+	if (!sc)
+	{
+		return;
+	}
+
+	SND_FillSfxCache (sc, shm->format.speed, outwidth, s_linearresample.integer,
+		inrate, inchannels, inwidth, insamps, inloopstart, data);
 }
 
 /*
@@ -765,12 +778,72 @@ static void COM_CharBias (signed char *c, int size)
 }
 
 #ifndef WITH_OGG_VORBIS
+typedef struct {
+	wavinfo_t	info;
+	int			outrate, outwidth, resampstyle;
+} sfxprefetch_t;
+
+static void S_DecodeSfx (prefetch_t *job)
+{
+	sfxprefetch_t *p = (sfxprefetch_t *) job->param;
+	byte *data = job->file + p->info.dataofs;
+	int len;
+
+	if (p->info.width == 1)
+		COM_CharBias((signed char*)data, p->info.samples * p->info.channels);
+	else if (p->info.width == 2)
+		COM_SwapLittleShortBlock((short *)data, p->info.samples * p->info.channels);
+
+	len = SND_SfxSamples (p->info.rate, p->info.samples, p->outrate) * p->outwidth + sizeof(sfxcache_t);
+	job->data = Q_malloc (len);
+	job->width = len;
+
+	SND_FillSfxCache ((sfxcache_t *) job->data, p->outrate, p->outwidth, p->resampstyle,
+		p->info.rate, p->info.channels, p->info.width, p->info.samples, p->info.loopstart, data);
+
+	Q_free(job->file);
+}
+
+// Reads and parses the file here, the conversion is done on a worker thread
+// and copied into the cache by S_LoadSound.
+void S_PrefetchSfx (sfx_t *s)
+{
+	extern cvar_t s_linearresample;
+	char namebuffer[256];
+	sfxprefetch_t *p;
+	byte *data;
+	int filesize;
+
+	snprintf (namebuffer, sizeof (namebuffer), "sound/%s", s->name);
+
+	if (!(data = FS_LoadHeapFile (namebuffer, &filesize)))
+		return;
+
+	FMod_CheckModel(namebuffer, data, filesize);
+
+	p = Q_malloc (sizeof(*p));
+	p->info = GetWavinfo (s->name, data, filesize);
+	p->outrate = shm->format.speed;
+	p->outwidth = SND_SfxWidth (p->info.width);
+	p->resampstyle = s_linearresample.integer;
+
+	// let S_LoadSound complain
+	if (p->info.channels < 1 || p->info.channels > 2) {
+		Q_free(p);
+		Q_free(data);
+		return;
+	}
+
+	Prefetch_Add (namebuffer, S_DecodeSfx, p, data, filesize);
+}
+
 sfxcache_t *S_LoadSound (sfx_t *s)
 {
 	char namebuffer[256];
 	unsigned char *data;
 	sfxcache_t *sc;
 	wavinfo_t info;
+	prefetch_t *job;
 	int filesize;
 
 	// see if still in memory
@@ -780,6 +853,14 @@ sfxcache_t *S_LoadSound (sfx_t *s)
 	// load it in
 	snprintf (namebuffer, sizeof (namebuffer), "sound/%s", s->name);
 
+	if ((job = Prefetch_Take (namebuffer))) {
+		if (job->data && (sc = Cache_Alloc (&s->cache, job->width, s->name)))
+			memcpy (sc, job->data, job->width);
+		Prefetch_Free (job);
+		if (sc)
+			return sc;
+	}
+
 	if (!(data = FS_LoadTempFile (namebuffer, &filesize))) {
 		Com_Printf ("Couldn't load %s\n", namebuffer);
 		return NULL;
@@ -804,6 +885,10 @@ sfxcache_t *S_LoadSound (sfx_t *s)
 
 	return Cache_Check(&s->cache);
 }
+#else
+void S_PrefetchSfx (sfx_t *s)
+{
+}
 #endif // WITH_OGG_VORBIS
 
 int SND_Rate(int rate)
@@ -115,10 +115,197 @@ mvddest_t *DestByName (char *name)
 	return NULL;
 }
 
+/*
+====================
+MVD stream chunks
+
+All QTV streams receive the same data, so it is kept once in a list of chunks,
+every stream dest has a read position in it and sends straight from the chunks.
+Data for a single stream (initial gamestate) goes into chunks targeted at that dest.
+====================
+*/
+
+#define MVD_STREAM_MAX_IOV	64
+
+static mvdchunk_t	*mvd_chunks_head, *mvd_chunks_tail;
+
+static mvdchunk_t *MVD_StreamNewChunk (mvddest_t *target)
+{
+	mvdchunk_t *c = (mvdchunk_t *) Q_malloc (sizeof(mvdchunk_t));
+
+	c->target = target;
+
+	if (mvd_chunks_tail)
+		mvd_chunks_tail->next = c;
+	else
+		mvd_chunks_head = c;
+	mvd_chunks_tail = c;
+
+	return c;
+}
+
+// free chunks which no stream is going to read anymore
+static void MVD_StreamFreeChunks (void)
+{
+	mvdchunk_t *c;
+
+	while (mvd_chunks_head && !mvd_chunks_head->refs)
+	{
+		c = mvd_chunks_head;
+		mvd_chunks_head = c->next;
+		if (c == mvd_chunks_tail)
+			mvd_chunks_tail = NULL;
+		Q_free(c);
+	}
+}
+
+// new stream starts reading at the end of the current data
+static void MVD_StreamAttach (mvddest_t *d)
+{
+	if (!mvd_chunks_tail)
+		MVD_StreamNewChunk(NULL);
+
+	d->chunk = mvd_chunks_tail;
+	d->chunkpos = mvd_chunks_tail->used;
+	d->chunk->refs++;
+	d->cacheused = 0;
+}
+
+static void MVD_StreamDetach (mvddest_t *d)
+{
+	if (!d->chunk)
+		return;
+
+	d->chunk->refs--;
+	d->chunk = NULL;
+	d->cacheused = 0;
+
+	MVD_StreamFreeChunks();
+}
+
+// broadcast to all streams if target is NULL
+int MVD_StreamWrite (void *data, int len, mvddest_t *target)
+{
+	mvddest_t *d;
+	mvdchunk_t *c;
+	qbool written = false;
+	int left, n;
+
+	if (len <= 0)
+		return 0;
+
+	for (d = demo.dest; d; d = d->nextdest)
+	{
+		if (d->desttype != DEST_STREAM || !d->chunk || d->error)
+			continue;
+		if (target && target != d)
+			continue;
+
+		if (d->cacheused + len > d->maxcachesize)
+		{
+			Sys_Printf("DemoWriteDest: cache overflow %d > %d\n", d->cacheused + len, d->maxcachesize);
+			d->error = true;
+			continue;
+		}
+
+		d->cacheused += len;
+		d->totalsize += len;
+		written = true;
+	}
+
+	if (!written)
+		return 0;
+
+	for (left = len; left > 0; left -= n)
+	{
+		c = mvd_chunks_tail;
+		if (!c || c->target != target || c->used == MVD_STREAM_CHUNK_SIZE)
+			c = MVD_StreamNewChunk(target);
+
+		n = min(left, MVD_STREAM_CHUNK_SIZE - c->used);
+		memcpy(c->data + c->used, data, n);
+		c->used += n;
+		data = (byte *) data + n;
+	}
+
+	return len;
+}
+
+// move read position forward by len bytes, skipping chunks of other streams
+static void MVD_StreamAdvance (mvddest_t *d, int len)
+{
+	mvdchunk_t *c = d->chunk;
+	qbool ours;
+	int n;
+
+	d->cacheused -= len;
+
+	for (;;)
+	{
+		ours = (!c->target || c->target == d);
+
+		if (ours)
+		{
+			n = min(len, c->used - d->chunkpos);
+			d->chunkpos += n;
+			len -= n;
+		}
+
+		// stay on the last chunk, it may be appended to
+		if (!c->next || (ours && d->chunkpos < c->used))
+			break;
+
+		c->refs--;
+		c = c->next;
+		c->refs++;
+		d->chunkpos = 0;
+	}
+
+	d->chunk = c;
+
+	MVD_StreamFreeChunks();
+}
+
+// send as much of the pending data as socket accepts, returns send() style result
+static int MVD_StreamSend (mvddest_t *d)
+{
+	mvdchunk_t *c;
+	int pos;
+#ifdef _WIN32
+	for (c = d->chunk, pos = d->chunkpos; c; c = c->next, pos = 0)
+	{
+		if ((!c->target || c->target == d) && c->used > pos)
+			return send(d->socket, (char *) c->data + pos, c->used - pos, 0);
+	}
+
+	return 0;
+#else
+	struct iovec iov[MVD_STREAM_MAX_IOV];
+	int cnt = 0;
+
+	for (c = d->chunk, pos = d->chunkpos; c && cnt < MVD_STREAM_MAX_IOV; c = c->next, pos = 0)
+	{
+		if ((!c->target || c->target == d) && c->used > pos)
+		{
+			iov[cnt].iov_base = c->data + pos;
+			iov[cnt].iov_len = c->used - pos;
+			cnt++;
+		}
+	}
+
+	if (!cnt)
+		return 0;
+
+	return writev(d->socket, iov, cnt);
+#endif
+}
+
 void DestClose (mvddest_t *d, qbool destroyfiles)
 {
 	char path[MAX_OSPATH];
 
+	if (d->desttype == DEST_STREAM)
+		MVD_StreamDetach(d);
 	if (d->cache)
 		Q_free(d->cache);
 	if (d->file)
@@ -198,7 +385,7 @@ void DestFlush (qbool compleate)
 
 			if (d->cacheused && !d->error)
 			{
-				len = send(d->socket, d->cache, d->cacheused, 0);
+				len = MVD_StreamSend(d);
 
 				if (len == 0) //client died
 				{
@@ -207,9 +394,8 @@ void DestFlush (qbool compleate)
 					// so 0 is legal or what?
 				}
 				else if (len > 0) //we put some data through
-				{ //move up the buffer
-					d->cacheused -= len;
-					memmove(d->cache, d->cache+len, d->cacheused);
+				{ //move up the read position
+					MVD_StreamAdvance(d, len);
 
 					d->io_time = Sys_DoubleTime(); // update IO activity
 				}
@@ -222,6 +408,11 @@ void DestFlush (qbool compleate)
 					}
 				}
 			}
+			else if (d->chunk && !d->error)
+			{
+				// nothing pending, just catch up so chunks of other streams can be freed
+				MVD_StreamAdvance(d, 0);
+			}
 			break;
 
 		case DEST_NONE:
@@ -294,6 +485,9 @@ int DemoWriteDest (void *data, int len, mvddest_t *d)
 	if (d->error)
 		return 0;
 
+	if (d->desttype == DEST_STREAM)
+		return MVD_StreamWrite(data, len, d);
+
 	d->totalsize += len;
 
 	switch(d->desttype)
@@ -309,7 +503,6 @@ int DemoWriteDest (void *data, int len, mvddest_t *d)
 
 			break;
 		case DEST_BUFFEREDFILE:	//these write to a cache, which is flushed later
-		case DEST_STREAM:
 			if (d->cacheused + len > d->maxcachesize)
 			{
 				Sys_Printf("DemoWriteDest: cache overflow %d > %d\n", d->cacheused + len, d->maxcachesize);
@@ -330,13 +523,25 @@ int DemoWriteDest (void *data, int len, mvddest_t *d)
 static void DemoWrite (void *data, int len) //broadcast to all proxies/mvds
 {
 	mvddest_t *d;
+	qbool streams = false;
+
 	for (d = demo.dest; d; d = d->nextdest)
 	{
 		if (singledest && singledest != d)
 			continue;
 
+		// streams share one copy of broadcasted data
+		if (d->desttype == DEST_STREAM && !singledest)
+		{
+			streams = true;
+			continue;
+		}
+
 		DemoWriteDest(data, len, d);
 	}
+
+	if (streams)
+		MVD_StreamWrite(data, len, NULL);
 }
 
 /*
@@ -1124,6 +1329,9 @@ qbool SV_MVD_Record (mvddest_t *dest, qbool mapchange)
 		dest->nextdest = demo.dest;
 		demo.dest = dest;
 
+		if (dest->desttype == DEST_STREAM)
+			MVD_StreamAttach(dest);
+
 		SV_MVD_SendInitialGamestate(dest);
 	}
 
@@ -56,8 +56,7 @@ static mvddest_t *SV_InitStream (int socket1, netadr_t na, char *userinfo)
 
 	dst->desttype = DEST_STREAM;
 	dst->socket = socket1;
-	dst->maxcachesize = 65536;	//is this too small?
-	dst->cache = (char *) Q_malloc(dst->maxcachesize);
+	dst->maxcachesize = 65536;	//is this too small? limit of pending data, data itself is in shared stream chunks
 	dst->io_time = Sys_DoubleTime();
 	dst->id = ++lastdest;
 	dst->na = na;
@@ -1300,7 +1299,6 @@ void DemoWriteQTVTimePad (int msecs)	//broadcast to all proxies
 //broadcast to all proxies
 void DemoWriteQTV (sizebuf_t *msg)
 {
-	mvddest_t		*d;
 	sizebuf_t		mvdheader;
 	byte			mvdheader_buf[6];
 
@@ -1313,14 +1311,8 @@ void DemoWriteQTV (sizebuf_t *msg)
 	//length
 	MSG_WriteLong (&mvdheader, msg->cursize);
 
-	for (d = demo.dest; d; d = d->nextdest)
-	{
-		if (d->desttype == DEST_STREAM)
-		{
-			DemoWriteDest(mvdheader.data, mvdheader.cursize, d);
-			DemoWriteDest(msg->data, msg->cursize, d);
-		}
-	}
+	MVD_StreamWrite(mvdheader.data, mvdheader.cursize, NULL);
+	MVD_StreamWrite(msg->data, msg->cursize, NULL);
 }
 
 void Qtv_List_f(void)
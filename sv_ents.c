@@ -27,16 +27,25 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 // because there can be a lot of nails, there is a special
 // network protocol for them
 #define MAX_NAILS 32
-static edict_t *nails[MAX_NAILS];
-static int numnails;
-static int nailcount = 0;
+
+// state of the message SV_WriteEntitiesToClient is building, kept out of
+// statics so messages for several clients can be built concurrently
+typedef struct
+{
+	edict_t		*nails[MAX_NAILS];
+	int			numnails;
+	qbool		disable_updates;		// disables sending entities to the client
+	unsigned int	pvs[MAX_MAP_LEAFS/32];	// word aligned for SV_EdictInPVS
+} ents_context_t;
+
+static int nailcount = 0; // recorder only
 
 extern	int sv_nailmodel, sv_supernailmodel, sv_playermodel;
 
 cvar_t	sv_nailhack	= {"sv_nailhack", "1"};
 
 
-static qbool SV_AddNailUpdate (edict_t *ent)
+static qbool SV_AddNailUpdate (ents_context_t *ctx, edict_t *ent)
 {
 	if ((int)sv_nailhack.value)
 		return false;
@@ -47,22 +56,22 @@ static qbool SV_AddNailUpdate (edict_t *ent)
 	if (msg_coordsize != 2)
 		return false; // Do not allow nailhack in case of sv_bigcoords.
 
-	if (numnails == MAX_NAILS)
+	if (ctx->numnails == MAX_NAILS)
 		return true;
 
-	nails[numnails] = ent;
-	numnails++;
+	ctx->nails[ctx->numnails] = ent;
+	ctx->numnails++;
 	return true;
 }
 
-static void SV_EmitNailUpdate (sizebuf_t *msg, qbool recorder)
+static void SV_EmitNailUpdate (ents_context_t *ctx, sizebuf_t *msg, qbool recorder)
 {
 	int x, y, z, p, yaw, n, i;
 	byte bits[6]; // [48 bits] xyzpy 12 12 12 4 8
 	edict_t *ent;
 
 
-	if (!numnails)
+	if (!ctx->numnails)
 		return;
 
 	if (recorder)
@@ -70,11 +79,11 @@ static void SV_EmitNailUpdate (sizebuf_t *msg, qbool recorder)
 	else
 		MSG_WriteByte (msg, svc_nails);
 
-	MSG_WriteByte (msg, numnails);
+	MSG_WriteByte (msg, ctx->numnails);
 
-	for (n=0 ; n<numnails ; n++)
+	for (n=0 ; n<ctx->numnails ; n++)
 	{
-		ent = nails[n];
+		ent = ctx->nails[n];
 		if (recorder)
 		{
 			if (!ent->v.colormap)
@@ -298,6 +307,24 @@ static int TranslateEffects (edict_t *ent)
 	return fx;
 }
 
+/*
+=============
+SV_EdictInPVS
+
+Tests the pvs words the entity touches, see SV_LinkToLeafs.
+=============
+*/
+static qbool SV_EdictInPVS (edict_t *ent, unsigned int *pvs)
+{
+	int i;
+
+	for (i = 0; i < ent->e->num_leafwords; i++)
+		if (pvs[ent->e->leafwords[i]] & ent->e->leafbits[i])
+			return true;
+
+	return false;
+}
+
 /*
 =============
 SV_WritePlayersToClient
@@ -308,11 +335,10 @@ SV_WritePlayersToClient
 
 #define ISUNDERWATER(x) ((x) == CONTENTS_WATER || (x) == CONTENTS_SLIME || (x) == CONTENTS_LAVA)
 
-static qbool disable_updates; // disables sending entities to the client
 
 
 int SV_PMTypeForClient (client_t *cl);
-static void SV_WritePlayersToClient (client_t *client, edict_t *clent, byte *pvs, sizebuf_t *msg)
+static void SV_WritePlayersToClient (ents_context_t *ctx, client_t *client, edict_t *clent, sizebuf_t *msg)
 {
 	int msec, pflags, pm_type = 0, pm_code = 0, i, j;
 	demo_frame_t *demo_frame;
@@ -391,14 +417,11 @@ static void SV_WritePlayersToClient (client_t *client, edict_t *clent, byte *pvs
 				continue;
 
 			// ignore if not touching a PV leaf
-			for (i=0 ; i < ent->e->num_leafs ; i++)
-				if (pvs[ent->e->leafnums[i] >> 3] & (1 << (ent->e->leafnums[i]&7) ))
-					break;
-			if (i == ent->e->num_leafs)
+			if (!SV_EdictInPVS (ent, ctx->pvs))
 				continue; // not visable
 		}
 
-		if (disable_updates && client != cl)
+		if (ctx->disable_updates && client != cl)
 		{ // Vladis
 			continue;
 		}
@@ -625,19 +648,20 @@ void SV_WriteEntitiesToClient (client_t *client, sizebuf_t *msg, qbool recorder)
 	client_t *cl;
 	edict_t *ent;
 	vec3_t org;
-	byte *pvs;
 	int hideent;
+	ents_context_t ctx;
 
 	// this is the frame we are creating
 	frame = &client->frames[client->netchan.incoming_sequence & UPDATE_MASK];
 
+	ctx.numnails = 0;
+
 	// find the client's PVS
 	clent = client->edict;
-	pvs = NULL;
 	if (!recorder)
 	{
 		VectorAdd (clent->v.origin, clent->v.view_ofs, org);
-		pvs = CM_FatPVS (org);
+		CM_BuildFatPVS (org, (byte *) ctx.pvs, false);
 		if (client->fteprotocolextensions & FTE_PEXT_256PACKETENTITIES)
 			max_packet_entities = 256;
 		else
@@ -647,6 +671,10 @@ void SV_WriteEntitiesToClient (client_t *client, sizebuf_t *msg, qbool recorder)
 	{
 		max_packet_entities = MAX_MVD_PACKET_ENTITIES;
 
+		// the demo sees everything any player sees. This is built once per
+		// demo frame and the result is shared by all MVD and QTV dests.
+		// With nobody in the game nothing is visible.
+		memset (ctx.pvs, 0, sizeof(ctx.pvs));
 		for (i=0, cl=svs.clients ; i<MAX_CLIENTS ; i++,cl++)
 		{
 			if (cl->state != cs_spawned)
@@ -656,40 +684,32 @@ void SV_WriteEntitiesToClient (client_t *client, sizebuf_t *msg, qbool recorder)
 				continue;
 
 			VectorAdd (cl->edict->v.origin, cl->edict->v.view_ofs, org);
-
-			// disconnect --> "is it correct?"
-			//if (pvs == NULL)
-				pvs = CM_FatPVS (org);
-			//else
-				//	SV_AddToFatPVS (org, sv.worldmodel->nodes, false);
-			// <-- disconnect
+			CM_BuildFatPVS (org, (byte *) ctx.pvs, true);
 		}
 	}
 	if (clent && client->disable_updates_stop > realtime)
 	{ // Vladis
 		int where = TruePointContents(clent->v.origin); // server flash should not work underwater
-		disable_updates = !ISUNDERWATER(where);
+		ctx.disable_updates = !ISUNDERWATER(where);
 	}
 	else
 	{
-		disable_updates = false;
+		ctx.disable_updates = false;
 	}
 
 	// send over the players in the PVS
-	SV_WritePlayersToClient (client, clent, pvs, msg);
+	SV_WritePlayersToClient (&ctx, client, clent, msg);
 
 	// put other visible entities into either a packet_entities or a nails message
 	pack = &frame->entities;
 	pack->num_entities = 0;
 
-	numnails = 0;
-
 	if (fofs_hideentity)
 		hideent = ((eval_t *)((byte *)&(clent)->v + fofs_hideentity))->_int / pr_edict_size;
 	else
 		hideent = 0;
 
-	if (!disable_updates)
+	if (!ctx.disable_updates)
 	{// Vladis, server flash
 
 		// QW protocol can only handle 512 entities. Any entity with number >= 512 will be invisible
@@ -722,18 +742,14 @@ void SV_WriteEntitiesToClient (client_t *client, sizebuf_t *msg, qbool recorder)
 			if (!(int)sv_demoNoVis.value || !recorder)
 			{
 				// ignore if not touching a PV leaf
-				for (i=0 ; i < ent->e->num_leafs ; i++)
-					if (pvs[ent->e->leafnums[i] >> 3] & (1 << (ent->e->leafnums[i]&7) ))
-						break;
-
-				if (i == ent->e->num_leafs)
+				if (!SV_EdictInPVS (ent, ctx.pvs))
 					continue;		// not visible
 
 				if (sv_cullentities.value && SV_InvisibleToClient(clent, ent))
 					continue;
 			}
 
-			if (SV_AddNailUpdate (ent))
+			if (SV_AddNailUpdate (&ctx, ent))
 				continue; // added to the special update list
 
 			// add to the packetentities
@@ -760,7 +776,7 @@ void SV_WriteEntitiesToClient (client_t *client, sizebuf_t *msg, qbool recorder)
 	SV_EmitPacketEntities (client, pack, msg);
 
 	// now add the specialized nail update
-	SV_EmitNailUpdate (msg, recorder);
+	SV_EmitNailUpdate (&ctx, msg, recorder);
 
 	// Translate NQ progs' EF_MUZZLEFLASH to svc_muzzleflash
 	if (pr_nqprogs)
@@ -770,11 +786,6 @@ void SV_WriteEntitiesToClient (client_t *client, sizebuf_t *msg, qbool recorder)
 		if (!ent->v.modelindex || !*PR_GetString(ent->v.model))
 			continue;
 
-		// ignore if not touching a PV leaf
-		for (i=0 ; i < ent->e->num_leafs ; i++)
-			if (pvs[ent->e->leafnums[i] >> 3] & (1 << (ent->e->leafnums[i]&7) ))
-				break;
-
 		if ((int)ent->v.effects & EF_MUZZLEFLASH) {
 			ent->v.effects = (int)ent->v.effects & ~EF_MUZZLEFLASH;
 			MSG_WriteByte (msg, svc_muzzleflash);
@@ -1058,6 +1058,86 @@ qbool CheckReConnect( netadr_t adr, int qport )
 	return true;
 }
 
+/*
+==============================================================================
+
+CLIENT ADDRESS HASH
+
+Client slots are indexed by (ip, qport) so SV_ReadPackets does not have to
+compare every slot for each incoming packet. A slot is (re)linked when a
+connection is set up and stays linked after the client is dropped; lookups
+skip free slots and check the address, so stale links are harmless.
+
+==============================================================================
+*/
+
+#define	CLIENT_HASH_SIZE	64	// must be a power of two
+
+static int	sv_clienthash[CLIENT_HASH_SIZE];		// slot + 1 of first client in bucket, 0 = empty
+static int	sv_clienthash_next[MAX_CLIENTS];		// slot + 1 of next client in bucket
+static int	sv_clienthash_bucket[MAX_CLIENTS];	// bucket + 1 the slot is linked into, 0 = none
+
+static unsigned int SV_ClientHashKey (netadr_t *adr, int qport)
+{
+	unsigned int ip = (adr->type == NA_LOOPBACK) ? 0 : *(unsigned int *)adr->ip;
+
+	return ((ip ^ (unsigned int)qport) * 2654435761u) >> 26; // top log2(CLIENT_HASH_SIZE) bits
+}
+
+static void SV_ClientHashUnlink (int slot)
+{
+	int *link;
+
+	if (!sv_clienthash_bucket[slot])
+		return;
+
+	for (link = &sv_clienthash[sv_clienthash_bucket[slot] - 1]; *link; link = &sv_clienthash_next[*link - 1])
+	{
+		if (*link == slot + 1)
+		{
+			*link = sv_clienthash_next[slot];
+			break;
+		}
+	}
+
+	sv_clienthash_next[slot] = 0;
+	sv_clienthash_bucket[slot] = 0;
+}
+
+static void SV_ClientHashLink (client_t *cl)
+{
+	int slot = cl - svs.clients;
+	unsigned int h = SV_ClientHashKey (&cl->netchan.remote_address, cl->netchan.qport);
+
+	SV_ClientHashUnlink (slot);
+
+	sv_clienthash_next[slot] = sv_clienthash[h];
+	sv_clienthash[h] = slot + 1;
+	sv_clienthash_bucket[slot] = h + 1;
+}
+
+static client_t *SV_ClientForAddress (netadr_t *adr, int qport)
+{
+	client_t *cl;
+	int i;
+
+	for (i = sv_clienthash[SV_ClientHashKey (adr, qport)]; i; i = sv_clienthash_next[i - 1])
+	{
+		cl = &svs.clients[i - 1];
+
+		if (cl->state == cs_free)
+			continue;
+		if (cl->netchan.qport != qport)
+			continue;
+		if (!NET_CompareBaseAdr (*adr, cl->netchan.remote_address))
+			continue;
+
+		return cl;
+	}
+
+	return NULL;
+}
+
 /*
 ==================
 SVC_DirectConnect
@@ -1260,6 +1340,7 @@ static void SVC_DirectConnect (void)
 	Netchan_OutOfBandPrint (NS_SERVER, adr, "%c", S2C_CONNECTION);
 
 	Netchan_Setup (NS_SERVER, &newcl->netchan, adr, qport);
+	SV_ClientHashLink (newcl);
 
 	newcl->state = cs_preconnected;
 
@@ -1860,6 +1941,24 @@ If 0, then only addresses matching the list will be allowed.  This lets you easi
 ipfilter_t	ipfilters[MAX_IPFILTERS];
 int		numipfilters;
 
+// Ban filters are indexed by mask: StringToFilter only produces whole octet
+// masks, so there are at most 16 distinct ones, and for each of them the
+// compare values live in one open addressing table.
+#define	IPFILTER_MAX_MASKS	16
+#define	IPFILTER_HASH_SIZE	(MAX_IPFILTERS * 2)	// must be a power of two
+
+typedef struct
+{
+	unsigned	mask;
+	unsigned	compare;
+	qbool		used;
+} ipfilter_hash_t;
+
+static unsigned			ipfilter_masks[IPFILTER_MAX_MASKS];
+static int				numipfiltermasks;
+static ipfilter_hash_t	ipfilter_hash[IPFILTER_HASH_SIZE];
+static qbool			ipfilters_changed = true;
+
 ipfilter_t	ipvip[MAX_IPFILTERS];
 int		numipvips;
 
@@ -2092,6 +2191,7 @@ static void SV_AddIP_f (void)
 	}
 
 	ipfilters[i] = f;
+	ipfilters_changed = true;
 }
 
 /*
@@ -2117,6 +2217,7 @@ static void SV_RemoveIP_f (void)
 			for (j=i+1 ; j<numipfilters ; j++)
 				ipfilters[j-1] = ipfilters[j];
 			numipfilters--;
+			ipfilters_changed = true;
 			Con_Printf ("Removed.\n");
 			return;
 		}
@@ -2217,6 +2318,74 @@ void SV_SendBan (void)
 	NET_SendPacket (NS_SERVER, strlen(data), data, net_from);
 }
 
+/*
+=================
+SV_BuildIPFilterIndex
+=================
+*/
+static unsigned SV_IPFilterHashKey (unsigned mask, unsigned compare)
+{
+	unsigned h = (compare ^ (mask * 0x9e3779b9u)) * 2654435761u;
+
+	return (h ^ (h >> 16)) & (IPFILTER_HASH_SIZE - 1);
+}
+
+static void SV_BuildIPFilterIndex (void)
+{
+	unsigned h;
+	int i, j;
+
+	memset (ipfilter_hash, 0, sizeof(ipfilter_hash));
+	numipfiltermasks = 0;
+
+	for (i = 0; i < numipfilters; i++)
+	{
+		if (ipfilters[i].type != ipft_ban)
+			continue;
+
+		for (j = 0; j < numipfiltermasks; j++)
+			if (ipfilter_masks[j] == ipfilters[i].mask)
+				break;
+
+		if (j == numipfiltermasks)
+		{
+			if (numipfiltermasks == IPFILTER_MAX_MASKS)
+				Sys_Error ("SV_BuildIPFilterIndex: too many filter masks");
+			ipfilter_masks[numipfiltermasks++] = ipfilters[i].mask;
+		}
+
+		for (h = SV_IPFilterHashKey (ipfilters[i].mask, ipfilters[i].compare); ipfilter_hash[h].used; h = (h + 1) & (IPFILTER_HASH_SIZE - 1))
+			if (ipfilter_hash[h].mask == ipfilters[i].mask && ipfilter_hash[h].compare == ipfilters[i].compare)
+				break;
+
+		ipfilter_hash[h].mask = ipfilters[i].mask;
+		ipfilter_hash[h].compare = ipfilters[i].compare;
+		ipfilter_hash[h].used = true;
+	}
+
+	ipfilters_changed = false;
+}
+
+static qbool SV_IPBanned (unsigned in)
+{
+	unsigned h, compare;
+	int i;
+
+	if (ipfilters_changed)
+		SV_BuildIPFilterIndex ();
+
+	for (i = 0; i < numipfiltermasks; i++)
+	{
+		compare = in & ipfilter_masks[i];
+
+		for (h = SV_IPFilterHashKey (ipfilter_masks[i], compare); ipfilter_hash[h].used; h = (h + 1) & (IPFILTER_HASH_SIZE - 1))
+			if (ipfilter_hash[h].mask == ipfilter_masks[i] && ipfilter_hash[h].compare == compare)
+				return true;
+	}
+
+	return false;
+}
+
 /*
 =================
 SV_FilterPacket
@@ -2224,16 +2393,85 @@ SV_FilterPacket
 */
 qbool SV_FilterPacket (void)
 {
-	int		i;
-	unsigned	in;
+	if (SV_IPBanned (*(unsigned *)net_from.ip))
+		return (int)filterban.value;
 
-	in = *(unsigned *)net_from.ip;
+	return !(int)filterban.value;
+}
 
-	for (i=0 ; i<numipfilters ; i++)
-		if ( ipfilters[i].type == ipft_ban && (in & ipfilters[i].mask) == ipfilters[i].compare )
-			return (int)filterban.value;
+/*
+=================
+SV_PacketBench_f
 
-	return !(int)filterban.value;
+Classifies synthetic packet sources with the ban filter and client indexes
+and with a linear scan of the same lists.
+=================
+*/
+static void SV_PacketBench_f (void)
+{
+	int i, j, count, banned[2] = {0, 0}, found[2] = {0, 0};
+	unsigned seed = 12345;
+	double t0, t1, t2;
+	netadr_t *from;
+	client_t *cl;
+	int *qports;
+
+	count = (Cmd_Argc() > 1) ? Q_atoi (Cmd_Argv (1)) : 1000000;
+	count = bound (1, count, 10000000);
+
+	// half of the packets claim to come from a client slot, connected or not
+	from = (netadr_t *) Q_malloc (count * sizeof(*from));
+	qports = (int *) Q_malloc (count * sizeof(*qports));
+	for (i = 0; i < count; i++)
+	{
+		seed = seed * 1103515245 + 12345;
+		j = (seed >> 16) % (2 * MAX_CLIENTS);
+		if (j < MAX_CLIENTS && svs.clients[j].state != cs_free)
+		{
+			from[i] = svs.clients[j].netchan.remote_address;
+			qports[i] = svs.clients[j].netchan.qport;
+		}
+		else
+		{
+			from[i].type = NA_IP;
+			*(unsigned *)from[i].ip = seed;
+			from[i].port = 0;
+			qports[i] = seed & 0xffff;
+		}
+	}
+
+	t0 = Sys_DoubleTime ();
+	for (i = 0; i < count; i++)
+	{
+		if (SV_IPBanned (*(unsigned *)from[i].ip))
+			banned[0]++;
+		if (SV_ClientForAddress (&from[i], qports[i]))
+			found[0]++;
+	}
+	t1 = Sys_DoubleTime ();
+
+	for (i = 0; i < count; i++)
+	{
+		for (j = 0; j < numipfilters; j++)
+			if (ipfilters[j].type == ipft_ban && (*(unsigned *)from[i].ip & ipfilters[j].mask) == ipfilters[j].compare)
+				break;
+		if (j < numipfilters)
+			banned[1]++;
+
+		for (j = 0, cl = svs.clients; j < MAX_CLIENTS; j++, cl++)
+			if (cl->state != cs_free && NET_CompareBaseAdr (from[i], cl->netchan.remote_address) && cl->netchan.qport == qports[i])
+				break;
+		if (j < MAX_CLIENTS)
+			found[1]++;
+	}
+	t2 = Sys_DoubleTime ();
+
+	Q_free (qports);
+	Q_free (from);
+
+	Con_Printf ("%i packets, %i ip filters in %i masks\n", count, numipfilters, numipfiltermasks);
+	Con_Printf ("indexed: %6.1f ns/packet, %i banned, %i from clients\n", (t1 - t0) * 1e9 / count, banned[0], found[0]);
+	Con_Printf ("linear:  %6.1f ns/packet, %i banned, %i from clients\n", (t2 - t1) * 1e9 / count, banned[1], found[1]);
 }
 
 // { server internal BAN support
@@ -2322,6 +2560,7 @@ void SV_RemoveBansIPFilter (int i)
 		ipfilters[i] = ipfilters[i + 1];
 
 	numipfilters--;
+	ipfilters_changed = true;
 }
 
 void SV_CleanBansIPList (void)
@@ -2869,26 +3108,15 @@ static void SV_ReadPackets (void)
 		qport = MSG_ReadShort () & 0xffff;
 
 		// check which client sent this packet
-		for (i=0, cl=svs.clients ; i<MAX_CLIENTS ; i++,cl++)
-		{
-			if (cl->state == cs_free)
-				continue;
-			if (!NET_CompareBaseAdr (net_from, cl->netchan.remote_address))
-				continue;
-			if (cl->netchan.qport != qport)
-				continue;
-			if (cl->netchan.remote_address.port != net_from.port)
-			{
-				Con_DPrintf ("SV_ReadPackets: fixing up a translated port\n");
-				cl->netchan.remote_address.port = net_from.port;
-			}
+		if (!(cl = SV_ClientForAddress (&net_from, qport)))
+			continue;
 
-			break;
+		if (cl->netchan.remote_address.port != net_from.port)
+		{
+			Con_DPrintf ("SV_ReadPackets: fixing up a translated port\n");
+			cl->netchan.remote_address.port = net_from.port;
 		}
 
-		if (i == MAX_CLIENTS)
-			continue;
-
 		// ok, we know who sent this packet, but do we need to delay executing it?
 		if (cl->delay > 0)
 		{
@@ -3123,6 +3351,11 @@ void SV_Frame (double time1)
 	start = Sys_DoubleTime ();
 	svs.stats.idle += start - end;
 
+#ifdef NET_BATCH
+	// collect outgoing datagrams, they are sent with one syscall at the end of the frame
+	NET_BeginServerBatch ();
+#endif
+
 	// keep the random time dependent
 	rand ();
 
@@ -3162,7 +3395,10 @@ void SV_Frame (double time1)
 
 	// move autonomous things around if enough time has passed
 	if (!sv.paused)
+	{
 		SV_Physics ();
+		SV_AntilagRecord ();
+	}
 	else
 		PausedTic ();
 
@@ -3179,6 +3415,10 @@ void SV_Frame (double time1)
 	// send a heartbeat to the master if needed
 	Master_Heartbeat ();
 
+#ifdef NET_BATCH
+	NET_FlushServerBatch ();
+#endif
+
 	// collect timing statistics
 	end = Sys_DoubleTime ();
 	svs.stats.active += end-start;
@@ -3215,6 +3455,7 @@ void SV_InitLocal (void)
 	extern	cvar_t	sv_friction;
 	extern	cvar_t	sv_waterfriction;
 	extern	cvar_t	sv_nailhack;
+	extern	cvar_t	sv_threads;
 
 	extern	cvar_t	pm_airstep;
 	extern	cvar_t	pm_pground;
@@ -3252,6 +3493,9 @@ void SV_InitLocal (void)
 	Cvar_Register (&frag_log_type);
 	Cvar_Register (&qconsole_log_say);
 	Cvar_Register (&sv_use_dns);
+#ifdef NET_BATCH
+	Cvar_Register (&sv_batchpackets);
+#endif
 #if 0 // FIXME
 	for (i = 0, len = 1; i < com_argc; i++)
 		len += strlen(com_argv[i]) + 1;
@@ -3273,6 +3517,10 @@ void SV_InitLocal (void)
 	Cvar_Register (&vip_values);
 
 	Cvar_Register (&sv_nailhack);
+	Cvar_Register (&sv_threads);
+	Cvar_Register (&sv_areagrid);
+	Cvar_Register (&sv_antilag);
+	Cvar_Register (&sv_antilag_maxunlag);
 
 	Cvar_Register (&sv_mintic);
 	Cvar_Register (&sv_maxtic);
@@ -3370,6 +3618,7 @@ void SV_InitLocal (void)
 	Cmd_AddCommand ("removeip", SV_RemoveIP_f);
 	Cmd_AddCommand ("listip", SV_ListIP_f);
 	Cmd_AddCommand ("writeip", SV_WriteIP_f);
+	Cmd_AddCommand ("sv_packetbench", SV_PacketBench_f);
 	Cmd_AddCommand ("vip_addip", SV_AddIPVIP_f);
 	Cmd_AddCommand ("vip_removeip", SV_RemoveIPVIP_f);
 	Cmd_AddCommand ("vip_listip", SV_ListIPVIP_f);
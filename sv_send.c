@@ -369,45 +369,64 @@ void SV_BroadcastCommand (char *fmt, ...)
 }
 
 
+// View leaf of each client from the last multicast, looked up again only once the
+// client has moved, there are many multicasts per frame and few moves.
+static struct {
+	vec3_t	vieworg;
+	int		leafnum;
+	int		spawncount;
+} sv_viewleafs[MAX_CLIENTS];
+
+#if MAX_CLIENTS > 32
+#error "SV_MulticastClients needs a wider mask"
+#endif
+
+static int SV_ClientViewLeafnum (client_t *client, const vec3_t vieworg)
+{
+	int j = client - svs.clients;
+
+	if (sv_viewleafs[j].spawncount != svs.spawncount || !VectorCompare (sv_viewleafs[j].vieworg, vieworg))
+	{
+		VectorCopy (vieworg, sv_viewleafs[j].vieworg);
+		sv_viewleafs[j].leafnum = CM_Leafnum (CM_PointInLeaf (vieworg));
+		sv_viewleafs[j].spawncount = svs.spawncount;
+	}
+
+	return sv_viewleafs[j].leafnum;
+}
+
 /*
 =================
-SV_Multicast
+SV_MulticastClients
 
-Sends the contents of sv.multicast to a subset of the clients,
-then clears sv.multicast.
-
-MULTICAST_ALL	same as broadcast
-MULTICAST_PVS	send to clients potentially visible from org
-MULTICAST_PHS	send to clients potentially hearable from org
+Returns the spawned clients a multicast from origin reaches,
+bit j is set for svs.clients[j].
 =================
 */
-void SV_Multicast (vec3_t origin, int to)
+unsigned int SV_MulticastClients (vec3_t origin, int to)
 {
 	client_t	*client;
 	byte		*mask;
 	int		leafnum;
 	int		j;
-	qbool		reliable;
-	vec3_t		vieworg;
-
-	reliable = false;
+	unsigned int	clients = 0;
+	qbool		phs = false;
+	vec3_t		vieworg, delta;
 
 	switch (to)
 	{
 	case MULTICAST_ALL_R:
-		reliable = true;	// intentional fallthrough
 	case MULTICAST_ALL:
 		mask = NULL;		// everything
 		break;
 
 	case MULTICAST_PHS_R:
-		reliable = true;	// intentional fallthrough
 	case MULTICAST_PHS:
 		mask = CM_LeafPHS (CM_PointInLeaf(origin));
+		phs = true;
 		break;
 
 	case MULTICAST_PVS_R:
-		reliable = true;	// intentional fallthrough
 	case MULTICAST_PVS:
 		mask = CM_LeafPVS (CM_PointInLeaf (origin));
 		break;
@@ -417,26 +436,30 @@ void SV_Multicast (vec3_t origin, int to)
 		SV_Error ("SV_Multicast: bad to:%i", to);
 	}
 
-	// send the data to all relevent clients
 	for (j = 0, client = svs.clients; j < MAX_CLIENTS; j++, client++)
 	{
 		if (client->state != cs_spawned)
 			continue;
 
 		if (!mask)
-			goto inrange; // multicast to all
+		{
+			clients |= 1u << j; // multicast to all
+			continue;
+		}
 
 		VectorAdd (client->edict->v.origin, client->edict->v.view_ofs, vieworg);
 
-		if (to == MULTICAST_PHS_R || to == MULTICAST_PHS)
+		if (phs)
 		{
-			vec3_t delta;
 			VectorSubtract(origin, vieworg, delta);
-			if (VectorLength(delta) <= 1024)
-				goto inrange;
+			if (DotProduct(delta, delta) <= 1024 * 1024)
+			{
+				clients |= 1u << j;
+				continue;
+			}
 		}
 
-		leafnum = CM_Leafnum(CM_PointInLeaf(vieworg));
+		leafnum = SV_ClientViewLeafnum (client, vieworg);
 		if (leafnum)
 		{
 			// -1 is because pvs rows are 1 based, not 0 based like leafs
@@ -448,7 +471,23 @@ void SV_Multicast (vec3_t origin, int to)
 			}
 		}
 
-inrange:
+		clients |= 1u << j;
+	}
+
+	return clients;
+}
+
+// Sends the contents of sv.multicast to the clients and the mvd, then clears sv.multicast.
+static void SV_SendMulticast (unsigned int clients, qbool reliable)
+{
+	client_t	*client;
+	int		j;
+
+	for (j = 0, client = svs.clients; clients; j++, client++, clients >>= 1)
+	{
+		if (!(clients & 1))
+			continue;
+
 		if (reliable)
 		{
 			ClientReliableCheckBlock(client, sv.multicast.cursize);
@@ -475,6 +514,25 @@ inrange:
 	SZ_Clear (&sv.multicast);
 }
 
+/*
+=================
+SV_Multicast
+
+Sends the contents of sv.multicast to a subset of the clients,
+then clears sv.multicast.
+
+MULTICAST_ALL	same as broadcast
+MULTICAST_PVS	send to clients potentially visible from org
+MULTICAST_PHS	send to clients potentially hearable from org
+=================
+*/
+void SV_Multicast (vec3_t origin, int to)
+{
+	qbool reliable = (to == MULTICAST_ALL_R || to == MULTICAST_PHS_R || to == MULTICAST_PVS_R);
+
+	SV_SendMulticast (SV_MulticastClients (origin, to), reliable);
+}
+
 
 void SV_StartParticle (vec3_t org, vec3_t dir, int color, int count,
 					   int replacement_te, int replacement_count)
@@ -547,6 +605,7 @@ void SV_StartSound (edict_t *entity, int channel, char *sample, int volume,
 	vec3_t	origin;
 	qbool	use_phs;
 	qbool	reliable = false;
+	unsigned int	clients;
 
 	if (volume < 0 || volume > 255)
 		SV_Error ("SV_StartSound: volume = %i", volume);
@@ -602,6 +661,14 @@ void SV_StartSound (edict_t *entity, int channel, char *sample, int volume,
 		VectorCopy (entity->v.origin, origin);
 	}
 
+	// nobody would hear it
+	if (use_phs)
+		clients = SV_MulticastClients (origin, MULTICAST_PHS);
+	else
+		clients = SV_MulticastClients (origin, MULTICAST_ALL);
+	if (!clients && !sv.mvdrecording)
+		return;
+
 	MSG_WriteByte (&sv.multicast, svc_sound);
 	MSG_WriteShort (&sv.multicast, channel);
 	if (channel & SND_VOLUME)
@@ -612,10 +679,7 @@ void SV_StartSound (edict_t *entity, int channel, char *sample, int volume,
 	for (i=0 ; i<3 ; i++)
 		MSG_WriteCoord (&sv.multicast, origin[i]);
 
-	if (use_phs)
-		SV_Multicast (origin, reliable ? MULTICAST_PHS_R : MULTICAST_PHS);
-	else
-		SV_Multicast (origin, reliable ? MULTICAST_ALL_R : MULTICAST_ALL);
+	SV_SendMulticast (clients, reliable);
 }
 
 
@@ -811,63 +875,192 @@ void SV_UpdateClientStats (client_t *client)
 		}
 }
 
+/*
+==============================================================================
+
+CLIENT DATAGRAMS
+
+A datagram is built in three steps: the client specific data, the entities
+in the PVS and finally the multicast data, stats and the transmit. The
+entities step only reads the world, so with sv_threads it runs on worker
+threads for all clients at once. The other steps stay on the main thread, in
+client order.
+
+==============================================================================
+*/
+
+#define	MAX_SEND_THREADS	8
+
+cvar_t	sv_threads = {"sv_threads", "0"};
+
+typedef struct
+{
+	sizebuf_t	msg;
+	byte		buf[MAX_DATAGRAM];
+} client_datagram_t;
+
+static client_datagram_t	sv_datagrams[MAX_CLIENTS];
+static client_t				*sv_sendlist[MAX_CLIENTS];	// clients that get a datagram this frame
+static int					sv_numsend;
+
+static int		sv_numthreads;		// workers started
+static int		sv_activethreads;	// workers used for this frame
+static sem_t	sv_thread_start[MAX_SEND_THREADS];
+static sem_t	sv_thread_done;
+
 /*
 =======================
-SV_SendClientDatagram
+SV_BeginClientDatagram
 =======================
 */
-void SV_SendClientDatagram (client_t *client, int client_num)
+static void SV_BeginClientDatagram (client_t *client)
 {
-	byte		buf[MAX_DATAGRAM];
-	sizebuf_t	msg;
-	//	packet_t	*pack;
+	sizebuf_t *msg = &sv_datagrams[client - svs.clients].msg;
+
+	msg->data = sv_datagrams[client - svs.clients].buf;
+	msg->maxsize = sizeof(sv_datagrams[0].buf);
+	msg->cursize = 0;
+	msg->allowoverflow = true;
+	msg->overflowed = false;
+
+	// add the client specific data to the datagram
+	SV_WriteClientdataToMessage (client, msg);
+
+	sv_sendlist[sv_numsend++] = client;
+}
 
-	msg.data = buf;
-	msg.maxsize = sizeof(buf);
-	msg.cursize = 0;
-	msg.allowoverflow = true;
-	msg.overflowed = false;
+/*
+=======================
+SV_WriteClientEntities
 
-	// for faster downloading skip half the frames
-	/*if (client->download && client->netchan.outgoing_sequence & 1)
+Builds the entities part for every step'th client of the send list.
+=======================
+*/
+static void SV_WriteClientEntities (int first, int step)
+{
+	client_t *client;
+	int i;
+
+	for (i = first; i < sv_numsend; i += step)
 	{
-		// we're sending fake invalid delta update, so that client won't update screen
-		MSG_WriteByte (&msg, svc_deltapacketentities);
-		MSG_WriteByte (&msg, 0);
-		MSG_WriteShort (&msg, 0);
+		client = sv_sendlist[i];
 
-		Netchan_Transmit (&client->netchan, msg.cursize, buf);
+		// send over all the objects that are in the PVS
+		// this will include clients, a packetentities, and
+		// possibly a nails update
+		SV_WriteEntitiesToClient (client, &sv_datagrams[client - svs.clients].msg, false);
 	}
-	*/
-
-	// add the client specific data to the datagram
-	SV_WriteClientdataToMessage (client, &msg);
+}
 
-	// send over all the objects that are in the PVS
-	// this will include clients, a packetentities, and
-	// possibly a nails update
-	SV_WriteEntitiesToClient (client, &msg, false);
+/*
+=======================
+SV_FinishClientDatagram
+=======================
+*/
+static void SV_FinishClientDatagram (client_t *client)
+{
+	sizebuf_t *msg = &sv_datagrams[client - svs.clients].msg;
 
 	// copy the accumulated multicast datagram
 	// for this client out to the message
 	if (client->datagram.overflowed)
 		Con_Printf ("WARNING: datagram overflowed for %s\n", client->name);
 	else
-		SZ_Write (&msg, client->datagram.data, client->datagram.cursize);
+		SZ_Write (msg, client->datagram.data, client->datagram.cursize);
 	SZ_Clear (&client->datagram);
 
 	// send deltas over reliable stream
 	if (Netchan_CanReliable (&client->netchan))
 		SV_UpdateClientStats (client);
 
-	if (msg.overflowed)
+	if (msg->overflowed)
 	{
 		Con_Printf ("WARNING: msg overflowed for %s\n", client->name);
-		SZ_Clear (&msg);
+		SZ_Clear (msg);
 	}
 
 	// send the datagram
-	Netchan_Transmit (&client->netchan, msg.cursize, buf);
+	Netchan_Transmit (&client->netchan, msg->cursize, msg->data);
+}
+
+static DWORD WINAPI SV_SendThread (void *param)
+{
+	int n = (int)(intptr_t) param;
+
+	while (1)
+	{
+		Sys_SemWait (&sv_thread_start[n]);
+		SV_WriteClientEntities (n + 1, sv_activethreads + 1);
+		Sys_SemPost (&sv_thread_done);
+	}
+
+	return 0;
+}
+
+/*
+=======================
+SV_StartSendThreads
+
+Workers are started on demand and never stopped, lowering sv_threads just
+leaves some of them idle.
+=======================
+*/
+static int SV_StartSendThreads (int count)
+{
+	count = bound (0, count, MAX_SEND_THREADS);
+
+	if (!sv_numthreads && count)
+	{
+		if (Sys_SemInit (&sv_thread_done, 0, MAX_SEND_THREADS))
+		{
+			Con_Printf ("WARNING: sv_threads: can't create semaphore\n");
+			Cvar_SetValue (&sv_threads, 0);
+			return 0;
+		}
+	}
+
+	while (sv_numthreads < count)
+	{
+		if (Sys_SemInit (&sv_thread_start[sv_numthreads], 0, 1)
+			|| !Sys_CreateThread (SV_SendThread, (void *)(intptr_t) sv_numthreads))
+		{
+			Con_Printf ("WARNING: sv_threads: can't create thread\n");
+			Cvar_SetValue (&sv_threads, sv_numthreads);
+			break;
+		}
+		sv_numthreads++;
+	}
+
+	return min (count, sv_numthreads);
+}
+
+/*
+=======================
+SV_SendClientDatagrams
+=======================
+*/
+static void SV_SendClientDatagrams (void)
+{
+	int i;
+
+	// NQ progs' muzzleflash translation writes to the entities, build those on this thread
+	if (sv_numsend > 1 && (int)sv_threads.value > 0 && !pr_nqprogs)
+		sv_activethreads = SV_StartSendThreads ((int)sv_threads.value);
+	else
+		sv_activethreads = 0;
+
+	for (i = 0; i < sv_activethreads; i++)
+		Sys_SemPost (&sv_thread_start[i]);
+
+	SV_WriteClientEntities (0, sv_activethreads + 1);
+
+	for (i = 0; i < sv_activethreads; i++)
+		Sys_SemWait (&sv_thread_done);
+
+	for (i = 0; i < sv_numsend; i++)
+		SV_FinishClientDatagram (sv_sendlist[i]);
+
+	sv_numsend = 0;
 }
 
 /*
@@ -1088,12 +1281,14 @@ void SV_SendClientMessages (void)
 		}
 
 		if (c->state == cs_spawned)
-			SV_SendClientDatagram (c, i);
+			SV_BeginClientDatagram (c);
 		else {
 			Netchan_Transmit (&c->netchan, c->datagram.cursize, c->datagram.data);	// just update reliable
 			c->datagram.cursize = 0;
 		}
 	}
+
+	SV_SendClientDatagrams ();
 }
 
 void SV_MVDPings (void)
@@ -2940,12 +2940,11 @@ AddLinksToPmove
 
 ====================
 */
-static void AddLinksToPmove ( areanode_t *node )
+static void AddLinksToPmove (void)
 {
-	link_t		*l, *next;
-	edict_t		*check;
+	edict_t		*touchlist[MAX_EDICTS], *check;
 	int 		pl;
-	int 		i;
+	int 		i, numtouch;
 	physent_t	*pe;
 	vec3_t		pmove_mins, pmove_maxs;
 
@@ -2957,11 +2956,12 @@ static void AddLinksToPmove ( areanode_t *node )
 
 	pl = EDICT_TO_PROG(sv_player);
 
+	numtouch = SV_AreaEdicts (pmove_mins, pmove_maxs, touchlist, MAX_EDICTS, AREA_SOLID);
+
 	// touch linked edicts
-	for (l = node->solid_edicts.next ; l != &node->solid_edicts ; l = next)
+	for (i = 0; i < numtouch; i++)
 	{
-		next = l->next;
-		check = EDICT_FROM_AREA(l);
+		check = touchlist[i];
 
 		if (check->v.owner == pl)
 			continue;		// player's own missile
@@ -2972,12 +2972,6 @@ static void AddLinksToPmove ( areanode_t *node )
 			if (check == sv_player)
 				continue;
 
-			for (i=0 ; i<3 ; i++)
-				if (check->v.absmin[i] > pmove_maxs[i]
-				|| check->v.absmax[i] < pmove_mins[i])
-					break;
-			if (i != 3)
-				continue;
 			if (pmove.numphysent == MAX_PHYSENTS)
 				return;
 			pe = &pmove.physents[pmove.numphysent];
@@ -3000,15 +2994,6 @@ static void AddLinksToPmove ( areanode_t *node )
 			}
 		}
 	}
-
-	// recurse down both sides
-	if (node->axis == -1)
-		return;
-
-	if ( pmove_maxs[node->axis] > node->dist )
-		AddLinksToPmove ( node->children[0] );
-	if ( pmove_mins[node->axis] < node->dist )
-		AddLinksToPmove ( node->children[1] );
 }
 
 int SV_PMTypeForClient (client_t *cl)
@@ -3215,7 +3200,7 @@ FIXME
 	// build physent list
 	pmove.numphysent = 1;
 	pmove.physents[0].model = sv.worldmodel;
-	AddLinksToPmove ( sv_areanodes );
+	AddLinksToPmove ();
 
 	// fill in movevars
 	movevars.entgravity = sv_client->entgravity;
@@ -3347,6 +3332,7 @@ static void SV_ExecuteClientMove (client_t *cl, usercmd_t oldest, usercmd_t oldc
 		return;
 
 	SV_PreRunCmd();
+	SV_AntilagBegin (cl);
 
 	net_drop = cl->netchan.dropped;
 	if (net_drop < 20)
@@ -3364,6 +3350,7 @@ static void SV_ExecuteClientMove (client_t *cl, usercmd_t oldest, usercmd_t oldc
 	SV_RunCmd (&newcmd, false);
 	
 	SV_PostRunCmd();
+	SV_AntilagEnd ();
 }
 
 /*
@@ -40,6 +40,7 @@ typedef struct
 	trace_t		trace;
 	int			type;
 	edict_t		*passedict;
+	qbool		antilag;		// clip against rewound player positions
 } moveclip_t;
 
 
@@ -184,6 +185,106 @@ areanode_t *SV_CreateAreaNode (int depth, vec3_t mins, vec3_t maxs)
 	return anode;
 }
 
+/*
+===============================================================================
+
+LOOSE GRIDS
+
+With sv_areagrid 1 edicts are kept in a few loose grids over the map instead
+of the area node tree.  An edict goes in the cell of the finest grid that
+holds its center and is at least as big as the edict, so a cell's edicts
+never stick out more than half a cell.  A query looks at the cells whose
+boxes grown by half a cell touch it.  Large edicts end up in a coarse grid
+instead of in a list that is walked by every query, and anything too big
+for the coarsest grid or off the map goes in sv_areaoverflow.
+
+===============================================================================
+*/
+
+cvar_t	sv_areagrid = {"sv_areagrid", "0"};
+
+#define	AREAGRID_LEVELS		3
+#define	AREAGRID_SIZE		64		// cells across the finest grid
+#define	AREAGRID_SCALE		4		// each grid's cells are this much bigger than the one below
+#define	AREAGRID_MINCELL	128		// smallest cell size
+#define	AREAGRID_CELLS		(64*64 + 16*16 + 4*4)	// all the levels
+
+typedef struct
+{
+	link_t	trigger_edicts;
+	link_t	solid_edicts;
+} areacell_t;
+
+typedef struct
+{
+	float		cellsize;
+	int			size[2];
+	areacell_t	*cells;
+} arealevel_t;
+
+static qbool		sv_areagrid_active;		// sv_areagrid when the world was cleared
+static vec3_t		sv_areagrid_origin;
+static arealevel_t	sv_arealevels[AREAGRID_LEVELS];
+static areacell_t	sv_areacells[AREAGRID_CELLS];
+static areacell_t	sv_areaoverflow;
+
+static void SV_CreateAreaGrid (vec3_t mins, vec3_t maxs)
+{
+	arealevel_t	*level;
+	areacell_t	*cells = sv_areacells;
+	float		cellsize;
+	int			i, j, maxsize = AREAGRID_SIZE;
+
+	VectorCopy (mins, sv_areagrid_origin);
+
+	cellsize = max (maxs[0] - mins[0], maxs[1] - mins[1]) / AREAGRID_SIZE;
+	cellsize = max (cellsize, AREAGRID_MINCELL);
+
+	for (i = 0, level = sv_arealevels; i < AREAGRID_LEVELS; i++, level++)
+	{
+		level->cellsize = cellsize;
+		for (j = 0; j < 2; j++)
+			level->size[j] = bound (1, (int) ceil ((maxs[j] - mins[j]) / cellsize), maxsize);
+		level->cells = cells;
+		cells += level->size[0] * level->size[1];
+
+		cellsize *= AREAGRID_SCALE;
+		maxsize /= AREAGRID_SCALE;
+	}
+
+	for (cells--; cells >= sv_areacells; cells--)
+	{
+		ClearLink (&cells->trigger_edicts);
+		ClearLink (&cells->solid_edicts);
+	}
+	ClearLink (&sv_areaoverflow.trigger_edicts);
+	ClearLink (&sv_areaoverflow.solid_edicts);
+}
+
+static areacell_t *SV_AreaCellForBox (vec3_t mins, vec3_t maxs)
+{
+	arealevel_t	*level;
+	float		size;
+	int			i, x, y;
+
+	size = max (maxs[0] - mins[0], maxs[1] - mins[1]);
+
+	for (i = 0, level = sv_arealevels; i < AREAGRID_LEVELS; i++, level++)
+	{
+		if (size > level->cellsize)
+			continue;	// would stick out too far
+
+		x = (int) floor ((0.5 * (mins[0] + maxs[0]) - sv_areagrid_origin[0]) / level->cellsize);
+		y = (int) floor ((0.5 * (mins[1] + maxs[1]) - sv_areagrid_origin[1]) / level->cellsize);
+		if (x < 0 || y < 0 || x >= level->size[0] || y >= level->size[1])
+			break;		// off the map
+
+		return &level->cells[y * level->size[0] + x];
+	}
+
+	return &sv_areaoverflow;
+}
+
 /*
 ===============
 SV_ClearWorld
@@ -194,6 +295,9 @@ void SV_ClearWorld (void)
 	memset (sv_areanodes, 0, sizeof(sv_areanodes));
 	sv_numareanodes = 0;
 	SV_CreateAreaNode (0, sv.worldmodel->mins, sv.worldmodel->maxs);
+
+	SV_CreateAreaGrid (sv.worldmodel->mins, sv.worldmodel->maxs);
+	sv_areagrid_active = ((int) sv_areagrid.value != 0);
 }
 
 
@@ -210,6 +314,81 @@ void SV_UnlinkEdict (edict_t *ent)
 	ent->e->area.prev = ent->e->area.next = NULL;
 }
 
+/*
+====================
+SV_AreaEdictsInList
+
+Adds the edicts of one list that touch mins/maxs, returns the new count.
+====================
+*/
+static int SV_AreaEdictsInList (link_t *start, vec3_t mins, vec3_t maxs, edict_t **edicts, int count, int max_edicts)
+{
+	link_t		*l;
+	edict_t		*touch;
+
+	for (l = start->next ; l != start ; l = l->next)
+	{
+		touch = EDICT_FROM_AREA(l);
+		if (touch->v.solid == SOLID_NOT)
+			continue;
+		if (mins[0] > touch->v.absmax[0]
+					 || mins[1] > touch->v.absmax[1]
+					 || mins[2] > touch->v.absmax[2]
+					 || maxs[0] < touch->v.absmin[0]
+					 || maxs[1] < touch->v.absmin[1]
+					 || maxs[2] < touch->v.absmin[2])
+			continue;
+
+		if (count == max_edicts)
+			return count;
+		edicts[count++] = touch;
+	}
+
+	return count;
+}
+
+/*
+====================
+SV_GridAreaEdicts
+====================
+*/
+static int SV_GridAreaEdicts (vec3_t mins, vec3_t maxs, edict_t **edicts, int max_edicts, int area)
+{
+	arealevel_t	*level;
+	areacell_t	*cell;
+	float		loose;
+	int			i, x, y, x0, x1, y0, y1, count = 0;
+
+	for (i = 0, level = sv_arealevels; i < AREAGRID_LEVELS; i++, level++)
+	{
+		loose = 0.5 * level->cellsize;
+		x0 = (int) floor ((mins[0] - loose - sv_areagrid_origin[0]) / level->cellsize);
+		x1 = (int) floor ((maxs[0] + loose - sv_areagrid_origin[0]) / level->cellsize);
+		y0 = (int) floor ((mins[1] - loose - sv_areagrid_origin[1]) / level->cellsize);
+		y1 = (int) floor ((maxs[1] + loose - sv_areagrid_origin[1]) / level->cellsize);
+		x0 = max (x0, 0);
+		y0 = max (y0, 0);
+		x1 = min (x1, level->size[0] - 1);
+		y1 = min (y1, level->size[1] - 1);
+
+		for (y = y0; y <= y1; y++)
+		{
+			for (x = x0; x <= x1; x++)
+			{
+				cell = &level->cells[y * level->size[0] + x];
+				count = SV_AreaEdictsInList (area == AREA_SOLID ? &cell->solid_edicts : &cell->trigger_edicts,
+						mins, maxs, edicts, count, max_edicts);
+				if (count == max_edicts)
+					return count;
+			}
+		}
+	}
+
+	cell = &sv_areaoverflow;
+	return SV_AreaEdictsInList (area == AREA_SOLID ? &cell->solid_edicts : &cell->trigger_edicts,
+			mins, maxs, edicts, count, max_edicts);
+}
+
 /*
 ====================
 SV_AreaEdicts
@@ -217,11 +396,13 @@ SV_AreaEdicts
 */
 int SV_AreaEdicts (vec3_t mins, vec3_t maxs, edict_t **edicts, int max_edicts, int area)
 {
-	link_t		*l, *start;
-	edict_t		*touch;
+	link_t		*start;
 	int			stackdepth = 0, count = 0;
 	areanode_t	*localstack[AREA_NODES], *node = sv_areanodes;
 
+	if (sv_areagrid_active)
+		return SV_GridAreaEdicts (mins, maxs, edicts, max_edicts, area);
+
 // touch linked edicts
 	while (1)
 	{
@@ -230,23 +411,9 @@ int SV_AreaEdicts (vec3_t mins, vec3_t maxs, edict_t **edicts, int max_edicts, i
 		else
 			start = &node->trigger_edicts;
 
-		for (l = start->next ; l != start ; l = l->next)
-		{
-			touch = EDICT_FROM_AREA(l);
-			if (touch->v.solid == SOLID_NOT)
-				continue;
-			if (mins[0] > touch->v.absmax[0]
-						 || mins[1] > touch->v.absmax[1]
-						 || mins[2] > touch->v.absmax[2]
-						 || maxs[0] < touch->v.absmin[0]
-						 || maxs[1] < touch->v.absmin[1]
-						 || maxs[2] < touch->v.absmin[2])
-				continue;
-
-			if (count == max_edicts)
-				return count;
-			edicts[count++] = touch;
-		}
+		count = SV_AreaEdictsInList (start, mins, maxs, edicts, count, max_edicts);
+		if (count == max_edicts)
+			return count;
 
 		if (node->axis == -1)
 			goto checkstack;		// terminal node
@@ -325,13 +492,34 @@ SV_LinkToLeafs
 */
 void SV_LinkToLeafs (edict_t *ent)
 {
-	int	i, leafnums[MAX_ENT_LEAFS];
+	int	i, j, leaf, word, leafnums[MAX_ENT_LEAFS];
+	unsigned int bits;
 
 	ent->e->num_leafs = CM_FindTouchedLeafs (ent->v.absmin, ent->v.absmax, leafnums,
 					      MAX_ENT_LEAFS, 0, NULL);
+	ent->e->num_leafwords = 0;
 	for (i = 0; i < ent->e->num_leafs; i++) {
 		// ent->e->leafnums are real leafnum minus one (for pvs checks)
-		ent->e->leafnums[i] = leafnums[i] - 1;
+		ent->e->leafnums[i] = leaf = leafnums[i] - 1;
+		if (leaf < 0)
+			continue;
+
+		// the same leaf bit as pvs[leaf >> 3] & (1 << (leaf & 7)), but in a 32 bit word
+		word = leaf >> 5;
+		bits = 0;
+		((byte *)&bits)[(leaf >> 3) & 3] = 1 << (leaf & 7);
+
+		for (j = 0; j < ent->e->num_leafwords; j++) {
+			if (ent->e->leafwords[j] == word)
+				break;
+		}
+
+		if (j == ent->e->num_leafwords) {
+			ent->e->leafwords[j] = word;
+			ent->e->leafbits[j] = 0;
+			ent->e->num_leafwords++;
+		}
+		ent->e->leafbits[j] |= bits;
 	}
 }
 
@@ -345,6 +533,8 @@ SV_LinkEdict
 void SV_LinkEdict (edict_t *ent, qbool touch_triggers)
 {
 	areanode_t	*node;
+	areacell_t	*cell;
+	link_t		*list;
 	
 	if (ent->e->area.prev)
 		SV_UnlinkEdict (ent);	// unlink from old position
@@ -385,31 +575,36 @@ void SV_LinkEdict (edict_t *ent, qbool touch_triggers)
 	if (ent->v.modelindex)
 		SV_LinkToLeafs (ent);
 	else
-		ent->e->num_leafs = 0;
+		ent->e->num_leafs = ent->e->num_leafwords = 0;
 
 	if (ent->v.solid == SOLID_NOT)
 		return;
 
-// find the first node that the ent's box crosses
-	node = sv_areanodes;
-	while (1)
+	if (sv_areagrid_active)
 	{
-		if (node->axis == -1)
-			break;
-		if (ent->v.absmin[node->axis] > node->dist)
-			node = node->children[0];
-		else if (ent->v.absmax[node->axis] < node->dist)
-			node = node->children[1];
-		else
-			break;		// crosses the node
+		cell = SV_AreaCellForBox (ent->v.absmin, ent->v.absmax);
+		list = (ent->v.solid == SOLID_TRIGGER) ? &cell->trigger_edicts : &cell->solid_edicts;
+	}
+	else
+	{
+// find the first node that the ent's box crosses
+		node = sv_areanodes;
+		while (1)
+		{
+			if (node->axis == -1)
+				break;
+			if (ent->v.absmin[node->axis] > node->dist)
+				node = node->children[0];
+			else if (ent->v.absmax[node->axis] < node->dist)
+				node = node->children[1];
+			else
+				break;		// crosses the node
+		}
+		list = (ent->v.solid == SOLID_TRIGGER) ? &node->trigger_edicts : &node->solid_edicts;
 	}
 	
 // link it in	
-
-	if (ent->v.solid == SOLID_TRIGGER)
-		InsertLinkBefore (&ent->e->area, &node->trigger_edicts);
-	else
-		InsertLinkBefore (&ent->e->area, &node->solid_edicts);
+	InsertLinkBefore (&ent->e->area, list);
 	
 // if touch_triggers, touch all entities at this node and decend for more
 	if (touch_triggers)
@@ -499,6 +694,232 @@ trace_t SV_ClipMoveToEntity (edict_t *ent, vec3_t start, vec3_t mins, vec3_t max
 
 //===========================================================================
 
+/*
+===============================================================================
+
+LAG COMPENSATION
+
+Every frame the position of each player is stored in a small ring in client_t.
+While a client's move is being run, traces issued by its progs code are done
+against the other players where that client saw them.  Rewound players are not
+relinked, SV_ClipToLinks just skips them and their old boxes are clipped
+separately, so rewinding costs a ring lookup per player and command.
+
+===============================================================================
+*/
+
+cvar_t	sv_antilag = {"sv_antilag", "0"};			// 1 = always, 2 = only when the mod asks with setantilag
+cvar_t	sv_antilag_maxunlag = {"sv_antilag_maxunlag", "0.3"};
+
+typedef struct
+{
+	qbool		rewound;		// don't clip against the current position
+	qbool		solid;			// clip against the position below instead
+	vec3_t		origin, mins, maxs;
+	vec3_t		absmin, absmax;
+} antilag_rewind_t;
+
+static antilag_rewind_t	sv_antilag_rewind[MAX_CLIENTS];
+
+// only players the mod still has as ordinary solid boxes are rewound, anything else
+// (dead, triggers, ...) is left to the normal code, SV_ClipToEdict can't take triggers
+#define SV_ANTILAG_SOLID(ent) ((ent)->v.solid == SOLID_BBOX || (ent)->v.solid == SOLID_SLIDEBOX)
+static edict_t			*sv_antilag_shooter;	// rewinding is done for traces that ignore this edict
+qbool					sv_antilag_requested;	// set by the mod with setantilag, used when sv_antilag is 2
+
+/*
+================
+SV_AntilagRecord
+
+Called after physics, the positions are stamped with the realtime the frame
+is sent out at, which is what frames[].senttime holds.
+================
+*/
+void SV_AntilagRecord (void)
+{
+	client_t *cl;
+	edict_t *ent;
+	antilag_position_t *pos;
+	int i;
+
+	for (i = 0, cl = svs.clients; i < MAX_CLIENTS; i++, cl++)
+	{
+		if (cl->state != cs_spawned || cl->spectator)
+			continue;
+
+		ent = cl->edict;
+		pos = &cl->antilag_positions[cl->antilag_position_next & (MAX_ANTILAG_POSITIONS - 1)];
+		cl->antilag_position_next++;
+
+		pos->localtime = realtime;
+		VectorCopy (ent->v.origin, pos->origin);
+		VectorCopy (ent->v.mins, pos->mins);
+		VectorCopy (ent->v.maxs, pos->maxs);
+		pos->solid = ent->v.solid != SOLID_NOT && ent->v.solid != SOLID_TRIGGER;
+	}
+}
+
+/*
+================
+SV_AntilagPosition
+
+Finds where cl was at time t, interpolating between the two recorded frames
+around it.  Returns false when there is nothing to rewind to.
+================
+*/
+static qbool SV_AntilagPosition (client_t *cl, double t, antilag_rewind_t *rw)
+{
+	antilag_position_t *older, *newer, *pos;
+	vec3_t delta;
+	float frac;
+	int i;
+
+	newer = NULL;
+	for (i = 1; i <= MAX_ANTILAG_POSITIONS && i <= cl->antilag_position_next; i++)
+	{
+		pos = &cl->antilag_positions[(cl->antilag_position_next - i) & (MAX_ANTILAG_POSITIONS - 1)];
+		if (pos->localtime <= t)
+			break;
+		newer = pos;
+	}
+
+	if (i > MAX_ANTILAG_POSITIONS || i > cl->antilag_position_next)
+		return false;	// older than anything we have
+	if (!newer && pos->localtime < t)
+		return false;	// the client has seen the latest position already
+
+	older = pos;
+	rw->solid = older->solid;
+	VectorCopy (older->origin, rw->origin);
+	VectorCopy (older->mins, rw->mins);
+	VectorCopy (older->maxs, rw->maxs);
+
+	// don't interpolate across teleports or size changes
+	if (newer && newer->solid == older->solid
+		&& VectorCompare (newer->mins, older->mins) && VectorCompare (newer->maxs, older->maxs))
+	{
+		VectorSubtract (newer->origin, older->origin, delta);
+		if (DotProduct (delta, delta) < 128*128 && newer->localtime > older->localtime)
+		{
+			frac = (t - older->localtime) / (newer->localtime - older->localtime);
+			VectorMA (older->origin, frac, delta, rw->origin);
+		}
+	}
+
+	VectorAdd (rw->origin, rw->mins, rw->absmin);
+	VectorAdd (rw->origin, rw->maxs, rw->absmax);
+	for (i = 0; i < 3; i++)
+	{
+		rw->absmin[i] -= 1;
+		rw->absmax[i] += 1;
+	}
+
+	return true;
+}
+
+/*
+================
+SV_AntilagBegin
+
+Called before running the moves of cl, sets up the positions its traces see
+================
+*/
+void SV_AntilagBegin (client_t *cl)
+{
+	client_t *other;
+	antilag_rewind_t *rw;
+	double t;
+	int i, numrewound;
+
+	sv_antilag_shooter = NULL;
+	sv_antilag_requested = false;
+
+	if (!sv_antilag.value || cl->spectator)
+		return;
+
+	// the last frame the client has acknowledged is what it was looking at
+	t = cl->frames[cl->netchan.incoming_acknowledged & UPDATE_MASK].senttime;
+	if (t < realtime - sv_antilag_maxunlag.value)
+		t = realtime - sv_antilag_maxunlag.value;
+
+	numrewound = 0;
+	for (i = 0, other = svs.clients; i < MAX_CLIENTS; i++, other++)
+	{
+		rw = &sv_antilag_rewind[i];
+		rw->rewound = false;
+
+		if (other == cl || other->state != cs_spawned || other->spectator)
+			continue;
+		if (!SV_ANTILAG_SOLID (other->edict))
+			continue;	// dead now, nothing to hit
+		if (!SV_AntilagPosition (other, t, rw))
+			continue;
+
+		rw->rewound = true;
+		numrewound++;
+	}
+
+	if (numrewound)
+		sv_antilag_shooter = cl->edict;
+}
+
+void SV_AntilagEnd (void)
+{
+	sv_antilag_shooter = NULL;
+	sv_antilag_requested = false;
+}
+
+/*
+==================
+SV_ClipToEdict
+==================
+*/
+static void SV_ClipToEdict (moveclip_t *clip, edict_t *touch)
+{
+	trace_t		trace;
+
+	if (touch == clip->passedict)
+		return;
+	if (touch->v.solid == SOLID_TRIGGER)
+		SV_Error ("Trigger in clipping list");
+
+	if (clip->type == MOVE_NOMONSTERS && touch->v.solid != SOLID_BSP)
+		return;
+
+	if (clip->passedict && clip->passedict->v.size[0] && !touch->v.size[0])
+		return;	// points never interact
+
+// might intersect, so do an exact clip
+	if (clip->trace.allsolid)
+		return;
+	if (clip->passedict)
+	{
+		if (PROG_TO_EDICT(touch->v.owner) == clip->passedict)
+			return;	// don't clip against own missiles
+		if (PROG_TO_EDICT(clip->passedict->v.owner) == touch)
+			return;	// don't clip against owner
+	}
+
+	if ((int)touch->v.flags & FL_MONSTER)
+		trace = SV_ClipMoveToEntity (touch, clip->start, clip->mins2, clip->maxs2, clip->end);
+	else
+		trace = SV_ClipMoveToEntity (touch, clip->start, clip->mins, clip->maxs, clip->end);
+	if (trace.allsolid || trace.startsolid ||
+			  trace.fraction < clip->trace.fraction)
+	{
+		trace.e.ent = touch;
+		if (clip->trace.startsolid)
+		{
+			clip->trace = trace;
+			clip->trace.startsolid = true;
+		}
+		else
+			clip->trace = trace;
+	}
+	else if (trace.startsolid)
+		clip->trace.startsolid = true;
+}
+
 /*
 ====================
 SV_ClipToLinks
@@ -508,9 +929,8 @@ Mins and maxs enclose the entire area swept by the move
 */
 void SV_ClipToLinks ( areanode_t *node, moveclip_t *clip )
 {
-	int			i, numtouch;
+	int			i, num, numtouch;
 	edict_t		*touchlist[MAX_EDICTS], *touch;
-	trace_t		trace;
 
 	numtouch = SV_AreaEdicts (clip->boxmins, clip->boxmaxs, touchlist, MAX_EDICTS, AREA_SOLID);
 
@@ -518,46 +938,61 @@ void SV_ClipToLinks ( areanode_t *node, moveclip_t *clip )
 	for (i = 0; i < numtouch; i++)
 	{
 		touch = touchlist[i];
-		if (touch == clip->passedict)
-			continue;
-		if (touch->v.solid == SOLID_TRIGGER)
-			SV_Error ("Trigger in clipping list");
+		if (clip->antilag)
+		{
+			num = NUM_FOR_EDICT(touch) - 1;
+			if (num >= 0 && num < MAX_CLIENTS && sv_antilag_rewind[num].rewound)
+				continue;	// clipped by SV_ClipToRewound
+		}
 
-		if (clip->type == MOVE_NOMONSTERS && touch->v.solid != SOLID_BSP)
-			continue;
+		SV_ClipToEdict (clip, touch);
+		if (clip->trace.allsolid)
+			return;
+	}
+}
+
+/*
+====================
+SV_ClipToRewound
 
-		if (clip->passedict && clip->passedict->v.size[0] && !touch->v.size[0])
-			continue;	// points never interact
+Clips against the players skipped by SV_ClipToLinks, at their old positions.
+The edicts are only borrowed for the duration of the clip, nothing is relinked.
+====================
+*/
+static void SV_ClipToRewound (moveclip_t *clip)
+{
+	antilag_rewind_t *rw;
+	edict_t *ent;
+	vec3_t origin, mins, maxs;
+	int i;
 
-	// might intersect, so do an exact clip
+	for (i = 0, rw = sv_antilag_rewind; i < MAX_CLIENTS; i++, rw++)
+	{
+		if (!rw->rewound || !rw->solid)
+			continue;
 		if (clip->trace.allsolid)
 			return;
-		if (clip->passedict)
-		{
-			if (PROG_TO_EDICT(touch->v.owner) == clip->passedict)
-				continue;	// don't clip against own missiles
-			if (PROG_TO_EDICT(clip->passedict->v.owner) == touch)
-				continue;	// don't clip against owner
-		}
 
-		if ((int)touch->v.flags & FL_MONSTER)
-			trace = SV_ClipMoveToEntity (touch, clip->start, clip->mins2, clip->maxs2, clip->end);
-		else
-			trace = SV_ClipMoveToEntity (touch, clip->start, clip->mins, clip->maxs, clip->end);
-		if (trace.allsolid || trace.startsolid ||
-				  trace.fraction < clip->trace.fraction)
-		{
-			trace.e.ent = touch;
-			if (clip->trace.startsolid)
-			{
-				clip->trace = trace;
-				clip->trace.startsolid = true;
-			}
-			else
-				clip->trace = trace;
-		}
-		else if (trace.startsolid)
-			clip->trace.startsolid = true;
+		if (rw->absmin[0] > clip->boxmaxs[0] || rw->absmin[1] > clip->boxmaxs[1] || rw->absmin[2] > clip->boxmaxs[2]
+			|| rw->absmax[0] < clip->boxmins[0] || rw->absmax[1] < clip->boxmins[1] || rw->absmax[2] < clip->boxmins[2])
+			continue;
+
+		ent = svs.clients[i].edict;
+		if (!SV_ANTILAG_SOLID (ent))
+			continue;	// killed or changed by an earlier trace of this move
+
+		VectorCopy (ent->v.origin, origin);
+		VectorCopy (ent->v.mins, mins);
+		VectorCopy (ent->v.maxs, maxs);
+		VectorCopy (rw->origin, ent->v.origin);
+		VectorCopy (rw->mins, ent->v.mins);
+		VectorCopy (rw->maxs, ent->v.maxs);
+
+		SV_ClipToEdict (clip, ent);
+
+		VectorCopy (origin, ent->v.origin);
+		VectorCopy (mins, ent->v.mins);
+		VectorCopy (maxs, ent->v.maxs);
 	}
 }
 
@@ -613,6 +1048,8 @@ trace_t SV_Trace (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type,
 	clip.maxs = maxs;
 	clip.type = type;
 	clip.passedict = passedict;
+	clip.antilag = sv_antilag_shooter && passedict == sv_antilag_shooter
+		&& ((int)sv_antilag.value == 1 || sv_antilag_requested);
 
 	if (type == MOVE_MISSILE)
 	{
@@ -633,6 +1070,8 @@ trace_t SV_Trace (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type,
 
 	// clip to entities
 	SV_ClipToLinks ( sv_areanodes, &clip );
+	if (clip.antilag)
+		SV_ClipToRewound ( &clip );
 
 	return clip.trace;
 }
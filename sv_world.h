@@ -77,6 +77,20 @@ trace_t SV_Trace (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type,
 
 // passedict is explicitly excluded from clipping checks (normally NULL)
 
+extern	cvar_t	sv_areagrid;
+// 1 = keep edicts in loose grids instead of the area node tree, read by SV_ClearWorld
+
+extern	cvar_t	sv_antilag;
+extern	cvar_t	sv_antilag_maxunlag;
+extern	qbool	sv_antilag_requested;
+
+void SV_AntilagRecord (void);
+// stores the current player positions, called once per server frame
+
+void SV_AntilagBegin (client_t *cl);
+void SV_AntilagEnd (void);
+// while active, traces that ignore cl's edict see the other players where cl saw them
+
 int SV_AreaEdicts (vec3_t mins, vec3_t maxs, edict_t **edicts, int max_edicts, int area);
 
 #endif /* !__WORLD_H__ */
@@ -27,6 +27,25 @@
 extern hashtable_t *filesystemhash;
 extern int fs_hash_dups;		
 extern int fs_hash_files;		
+extern cvar_t fs_dircache;
+
+// file system I/O counters, see fs_stats
+typedef struct {
+	int		locates;		// FS_FLocateFile calls
+	int		locate_misses;
+	double	locate_time;	// seconds spent in FS_FLocateFile
+	int		os_probes;		// lookups in OS search paths
+	int		dircache_hits;	// OS lookups answered from a cached directory listing
+	int		dircache_lists;	// directories listed
+	int		opens;			// OS files opened
+	int		loads;			// whole files loaded or mapped
+	double	bytes_read;		// from OS files
+	int		archives;		// pak/pk3 files attached
+	int		archives_indexed;	// of which the directory came from fs_index.dat
+	double	init_time;		// seconds spent in the last FS_InitFilesystem
+} fs_stats_t;
+
+extern fs_stats_t fs_stats;
 
 typedef struct {
 	struct searchpath_s *search;
@@ -40,6 +59,7 @@ typedef struct {
 	void	(*PrintPath)(void *handle);
 	void	(*ClosePath)(void *handle);
 	void	(*BuildHash)(void *handle);
+		// adds every file with FS_AddFileHash, hashedresult later passed to FindFile
 	qbool   (*FindFile)(void *handle, flocation_t *loc, const char *name, void *hashedresult);	
 		// true if found (hashedresult can be NULL)
 		// note that if rawfile and offset are set, many Com_FileOpens will 
@@ -54,6 +74,9 @@ typedef struct {
 	int		(*GeneratePureCRC) (void *handle, int seed, int usepure);
 
 	vfsfile_t *(*OpenVFS)(void *handle, flocation_t *loc, char *mode);
+
+	qbool	(*MapFile)(void *handle, flocation_t *loc, fs_mapping_t *map);
+		// map file data straight from the OS file, false if not possible (compressed etc)
 } searchpathfuncs_t;
 
 typedef struct searchpath_s
@@ -67,8 +90,13 @@ typedef struct searchpath_s
 	                // for the paks it's actually loaded.
 	struct searchpath_s *nextpure;
 	struct searchpath_s *next;
+
+	int priority;			// in filesystemhash, lower wins
+	struct fshash_s *hash;	// this path's entries in filesystemhash
 } searchpath_t;
 
+void FS_AddFileHash(char *name, void *data);
+
 
 #ifdef WITH_VFS_ARCHIVE_LOADING
 int FS_BreakUpArchivePath(const char *filename, 
@@ -89,6 +117,9 @@ typedef struct {
 
 vfsfile_t *FS_OpenTemp(void);
 vfsfile_t *VFSOS_Open(char *osname, char *mode);
+int VFSOS_FileNo(vfsfile_t *file);	// -1 if not an OS file
+qbool FSOS_MapRegion(int fd, unsigned long offset, int len, fs_mapping_t *map);
+void FSOS_FlushDirCache(void);
 
 extern searchpathfuncs_t osfilefuncs;
 
@@ -104,6 +135,20 @@ typedef struct
 	int		filepos, filelen;
 } packfile_t;
 
+// name lookups within one archive, built when it's opened
+typedef struct {
+	hashtable_t	*table;
+	bucket_t	*buckets;
+	qbool		caseless;
+} packindex_t;
+
+void FS_BuildPackIndex(packindex_t *index, packfile_t *files, int numfiles, qbool caseless);
+packfile_t *FS_PackIndexFind(packindex_t *index, const char *name);
+void FS_FreePackIndex(packindex_t *index);
+
+packfile_t *FS_IndexedArchive(const char *path, int *numfiles);
+void FS_IndexArchive(const char *path, packfile_t *files, int numfiles);
+
 extern searchpathfuncs_t packfilefuncs;
 
 //===========================
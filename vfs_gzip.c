@@ -208,14 +208,7 @@ static void FSGZIP_BuildHash(void *handle)
 {
 	gzipfile_t *gzip = (gzipfile_t *)handle;
 
-	if (!Hash_GetInsensitive(filesystemhash, gzip->file.name))
-	{
-		Hash_AddInsensitive(filesystemhash, gzip->file.name, &gzip->file);
-		fs_hash_files++;
-	}
-	else {
-		fs_hash_dups++;
-	}
+	FS_AddFileHash(gzip->file.name, &gzip->file);
 }
 
 static qbool FSGZIP_FLocate(void *handle, flocation_t *loc, const char *filename, void *hashedresult)
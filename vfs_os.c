@@ -23,6 +23,18 @@
 #include "common.h"
 #include "fs.h"
 #include "vfs.h"
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <errno.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#define FSOS_INOTIFY
+#endif
+#endif
 
 //==================================
 // STDIO files (OS) - VFS Functions
@@ -36,6 +48,7 @@ static int VFSOS_ReadBytes (struct vfsfile_s *file, void *buffer, int bytestorea
 		Sys_Error("VFSOS_ReadBytes: bytestoread < 0"); // ffs
 
 	r = fread(buffer, 1, bytestoread, intfile->handle);
+	fs_stats.bytes_read += r;
 
 	if (err) // if bytestoread <= 0 it will be treated as non error even we read zero bytes
 		*err = ((r || bytestoread <= 0) ? VFSERR_NONE : VFSERR_EOF);
@@ -84,6 +97,51 @@ static void VFSOS_Close(vfsfile_t *file)
 	Q_free(file);
 }
 
+int VFSOS_FileNo(vfsfile_t *file)
+{
+	if (!file || file->ReadBytes != VFSOS_ReadBytes)
+		return -1;
+
+	return fileno(((vfsosfile_t*)file)->handle);
+}
+
+// map len bytes at offset of the file, pages which are not written to are shared with page cache.
+// Fails if the file is shorter than that, touching a page past the end would be SIGBUS
+// while reading it just comes up short, so callers fall back to reading.
+qbool FSOS_MapRegion(int fd, unsigned long offset, int len, fs_mapping_t *map)
+{
+#ifdef _WIN32
+	return false;
+#else
+	static long pagesize;
+	unsigned long start;
+	struct stat st;
+	void *base;
+
+	if (fd < 0 || len <= 0)
+		return false;
+
+	if (fstat(fd, &st) || st.st_size < 0 || (unsigned long) st.st_size < offset || (unsigned long) st.st_size - offset < (unsigned long) len)
+		return false;
+
+	if (!pagesize)
+		pagesize = sysconf(_SC_PAGESIZE);
+
+	start = offset - offset % pagesize;
+
+	base = mmap(NULL, len + (offset - start), PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, start);
+	if (base == MAP_FAILED)
+		return false;
+
+	map->base = base;
+	map->baselen = len + (offset - start);
+	map->data = (byte *) base + (offset - start);
+	map->len = len;
+
+	return true;
+#endif
+}
+
 vfsfile_t *FS_OpenTemp(void)
 {
 	FILE *f;
@@ -135,6 +193,8 @@ vfsfile_t *VFSOS_Open(char *osname, char *mode)
 	if (!f)
 		return NULL;
 
+	fs_stats.opens++;
+
 	file = Q_calloc(1, sizeof(vfsosfile_t));
 
 	file->funcs.ReadBytes  = ( strchr(mode, 'r')                      ? VFSOS_ReadBytes  : NULL);
@@ -181,13 +241,7 @@ static int FSOS_RebuildFSHash(char *filename, int filesize, void *data)
 		Sys_EnumerateFiles((char*)data, childpath, FSOS_RebuildFSHash, data);
 		return true;
 	}
-	if (!Hash_GetInsensitive(filesystemhash, filename))
-	{
-		Hash_AddInsensitive(filesystemhash, filename, data);
-		fs_hash_files++;
-	}
-	else
-		fs_hash_dups++;
+	FS_AddFileHash(filename, data);
 	return true;
 }
 
@@ -196,6 +250,299 @@ static void FSOS_BuildHash(void *handle)
 	Sys_EnumerateFiles(handle, "*", FSOS_RebuildFSHash, handle);
 }
 
+//==================================
+// Directory listing cache for OS paths
+//==================================
+// Texture and model loading probe a lot of names which are not there, so instead of
+// asking the OS every time we keep the listing of each directory we looked in.
+// On Linux inotify tells us when a listing is out of date, and a directory which
+// is not there is remembered as missing until something gets created in its
+// closest existing parent. Elsewhere the mtime of the directory is checked on
+// every lookup, which is still one stat instead of an open per probed name.
+#ifndef _WIN32
+
+#ifndef FSOS_INOTIFY
+#ifdef __APPLE__
+#define FSOS_MTIME_NSEC(st)	((st).st_mtimespec.tv_nsec)
+#elif defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__) || defined(__DragonFly__)
+#define FSOS_MTIME_NSEC(st)	((st).st_mtim.tv_nsec)
+#else
+#define FSOS_MTIME_NSEC(st)	0
+#endif
+#endif
+
+#ifdef __APPLE__ // HFS+/APFS are case insensitive
+#define FSOS_HashGet	Hash_GetInsensitive
+#define FSOS_HashAdd	Hash_AddInsensitive
+#else
+#define FSOS_HashGet	Hash_Get
+#define FSOS_HashAdd	Hash_Add
+#endif
+
+typedef struct {
+	int			size;		// -1 until we stat it
+} fsos_dirent_t;
+
+typedef struct fsos_dir_s {
+	char		*path;
+	qbool		exists;
+	qbool		stale;		// list again on next lookup
+	hashtable_t	*files;		// name -> fsos_dirent_t
+	fsos_dirent_t *entries;
+#ifdef FSOS_INOTIFY
+	int			wd;
+	int			parentwd;	// closest existing parent while we are missing
+#else
+	time_t		mtime;
+	long		mtime_nsec;
+	qbool		racy;		// listed in the second it was changed in, the file system may not tell a later change then
+#endif
+	struct fsos_dir_s *next;
+} fsos_dir_t;
+
+static hashtable_t *fsos_dirhash;
+static fsos_dir_t *fsos_dirs;
+#ifdef FSOS_INOTIFY
+static int fsos_inotify = -1;
+
+#define FSOS_WATCH_DIR		(IN_CREATE | IN_DELETE | IN_MOVE | IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+// added to whatever the parent is already watched for, it may be listed itself
+#define FSOS_WATCH_PARENT	(IN_CREATE | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR | IN_MASK_ADD)
+
+static qbool FSOS_WatchParent(fsos_dir_t *dir)
+{
+	char path[MAX_OSPATH];
+	char *slash;
+
+	if (strlcpy(path, dir->path, sizeof(path)) >= sizeof(path))
+		return false;
+
+	while ((slash = strrchr(path, '/')) && slash != path) {
+		*slash = 0;
+		if ((dir->parentwd = inotify_add_watch(fsos_inotify, path, FSOS_WATCH_PARENT)) >= 0)
+			return true;
+		if (errno != ENOENT && errno != ENOTDIR)
+			break;
+	}
+
+	return false;
+}
+#endif
+
+static void FSOS_ListDir(fsos_dir_t *dir)
+{
+	struct dirent *de;
+#ifndef FSOS_INOTIFY
+	struct stat st;
+#endif
+	DIR *d;
+	int num = 0, max = 64;
+
+	fs_stats.dircache_lists++;
+
+	if (dir->files)
+		Hash_Flush(dir->files);
+	Q_free(dir->entries);
+	dir->entries = NULL;
+	dir->stale = false;
+	dir->exists = false;
+
+#ifdef FSOS_INOTIFY
+	// watch before listing so nothing changes unnoticed in between, this also
+	// tells us if the directory is there at all
+	if (dir->wd < 0 && fsos_inotify >= 0) {
+		dir->wd = inotify_add_watch(fsos_inotify, dir->path, FSOS_WATCH_DIR);
+		if (dir->wd < 0 && (errno == ENOENT || errno == ENOTDIR)) {
+			// look again once the parent watch is in place, it may have been created meanwhile
+			if (!FSOS_WatchParent(dir) || (dir->wd = inotify_add_watch(fsos_inotify, dir->path, FSOS_WATCH_DIR)) < 0)
+				return;
+		}
+	}
+	dir->parentwd = -1;
+#else
+	if (stat(dir->path, &st) || !S_ISDIR(st.st_mode))
+		return;
+	dir->mtime = st.st_mtime;
+	dir->mtime_nsec = FSOS_MTIME_NSEC(st);
+	dir->racy = (time(NULL) <= st.st_mtime);
+#endif
+
+	if (!(d = opendir(dir->path)))
+		return;
+
+	if (!dir->files)
+		dir->files = Hash_InitTable(64);
+
+	dir->exists = true;
+	dir->entries = Q_malloc(max * sizeof(fsos_dirent_t));
+
+	while ((de = readdir(d))) {
+		if (de->d_name[0] == '.' && (!de->d_name[1] || (de->d_name[1] == '.' && !de->d_name[2])))
+			continue;
+#ifdef DT_DIR
+		if (de->d_type == DT_DIR)
+			continue;
+#endif
+		if (num == max) {
+			// entries only get pointed to once the listing is complete
+			max *= 2;
+			dir->entries = Q_realloc(dir->entries, max * sizeof(fsos_dirent_t));
+		}
+		dir->entries[num].size = -1;
+		FSOS_HashAdd(dir->files, de->d_name, (void *) (intptr_t) (num + 1));
+		num++;
+	}
+	closedir(d);
+}
+
+// mark listings changed since we last looked as stale
+static void FSOS_CheckDirs(void)
+{
+#ifdef FSOS_INOTIFY
+	char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	struct inotify_event *ev;
+	fsos_dir_t *dir;
+	int len, i;
+
+	if (fsos_inotify < 0)
+		return;
+
+	while ((len = read(fsos_inotify, buf, sizeof(buf))) > 0) {
+		for (i = 0; i < len; i += sizeof(*ev) + ev->len) {
+			ev = (struct inotify_event *) (buf + i);
+			for (dir = fsos_dirs; dir; dir = dir->next) {
+				if (dir->wd == ev->wd || (ev->mask & IN_Q_OVERFLOW))
+					dir->stale = true;
+				if (dir->wd == ev->wd && (ev->mask & IN_IGNORED))
+					dir->wd = -1;
+				if (dir->parentwd >= 0 && dir->parentwd == ev->wd
+					&& (ev->mask & (IN_CREATE | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED))) {
+					dir->stale = true;
+					dir->parentwd = -1; // found again when listing
+				}
+			}
+		}
+	}
+#endif
+}
+
+static fsos_dir_t *FSOS_GetDir(char *path)
+{
+	fsos_dir_t *dir;
+#ifndef FSOS_INOTIFY
+	struct stat st;
+#endif
+
+	if (!fsos_dirhash) {
+		fsos_dirhash = Hash_InitTable(256);
+#ifdef FSOS_INOTIFY
+		fsos_inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+	}
+
+	if (!(dir = Hash_Get(fsos_dirhash, path))) {
+		dir = Q_calloc(1, sizeof(*dir));
+		dir->path = Q_strdup(path);
+#ifdef FSOS_INOTIFY
+		dir->wd = dir->parentwd = -1;
+#endif
+		dir->next = fsos_dirs;
+		fsos_dirs = dir;
+		Hash_Add(fsos_dirhash, dir->path, dir);
+		FSOS_ListDir(dir);
+		return dir;
+	}
+
+#ifdef FSOS_INOTIFY
+	// without a watch on it or its parent nothing tells us when it changes
+	if (dir->wd < 0 && dir->parentwd < 0)
+		dir->stale = true;
+#else
+	if (stat(path, &st) ? dir->exists : (!dir->exists || dir->racy || st.st_mtime != dir->mtime || FSOS_MTIME_NSEC(st) != dir->mtime_nsec))
+		dir->stale = true;
+#endif
+
+	if (dir->stale)
+		FSOS_ListDir(dir);
+	else
+		fs_stats.dircache_hits++;
+
+	return dir;
+}
+
+// -1 if there is no such file
+static int FSOS_CachedFileSize(char *ospath, const char *filename)
+{
+	char path[MAX_OSPATH], dirpath[MAX_OSPATH];
+	char *name;
+	fsos_dir_t *dir;
+	fsos_dirent_t *ent;
+	struct stat st;
+	void *data;
+	int len;
+
+	len = snprintf(path, sizeof(path), "%s/%s", ospath, filename);
+	if (len < 0 || len >= sizeof(path))
+		return -1; // couldn't be opened either
+
+	// split at the last slash into the directory and the name in it
+	strlcpy(dirpath, path, sizeof(dirpath));
+	name = strrchr(dirpath, '/');
+	*name++ = 0;
+
+	FSOS_CheckDirs();
+
+	dir = FSOS_GetDir(dirpath);
+	if (!dir->exists || !(data = FSOS_HashGet(dir->files, name)))
+		return -1;
+
+	ent = &dir->entries[(intptr_t) data - 1];
+#ifdef FSOS_INOTIFY
+	if (ent->size >= 0)
+		return ent->size; // any change to the file makes the listing stale
+#endif
+
+	if (stat(path, &st) || S_ISDIR(st.st_mode))
+		return -1;
+
+	return (ent->size = st.st_size);
+}
+
+void FSOS_FlushDirCache(void)
+{
+	fsos_dir_t *dir, *next;
+
+	if (!fsos_dirhash)
+		return;
+
+	for (dir = fsos_dirs; dir; dir = next) {
+		next = dir->next;
+		if (dir->files) {
+			Hash_Flush(dir->files);
+			Hash_FreeTable(dir->files);
+		}
+		Q_free(dir->entries);
+		Q_free(dir->path);
+		Q_free(dir);
+	}
+	fsos_dirs = NULL;
+	Hash_Flush(fsos_dirhash);
+
+#ifdef FSOS_INOTIFY
+	if (fsos_inotify >= 0)
+		close(fsos_inotify);
+	fsos_inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+}
+
+#else // _WIN32
+
+void FSOS_FlushDirCache(void)
+{
+}
+
+#endif // _WIN32
+
 static qbool FSOS_FLocate(void *handle, flocation_t *loc, const char *filename, void *hashedresult)
 {
 	FILE *f;
@@ -206,6 +553,26 @@ static qbool FSOS_FLocate(void *handle, flocation_t *loc, const char *filename,
 	if (hashedresult && (void *)hashedresult != handle)
 		return false;
 
+	fs_stats.os_probes++;
+
+#ifndef _WIN32
+	if (fs_dircache.integer)
+	{
+		if ((len = FSOS_CachedFileSize((char *) handle, filename)) < 0)
+			return false;
+
+		if (loc)
+		{
+			loc->len = len;
+			loc->offset = 0;
+			loc->index = 0;
+			strlcpy (loc->rawname, filename, sizeof (loc->rawname));
+		}
+
+		return true;
+	}
+#endif
+
 /*
 	if (!static_registered)
 	{	// if not a registered version, don't ever go beyond base
@@ -252,6 +619,28 @@ static int FSOS_EnumerateFiles (void *handle, char *match, int (*func)(char *, i
 	return Sys_EnumerateFiles(handle, match, func, parm);
 }
 
+static qbool FSOS_MapFile(void *handle, flocation_t *loc, fs_mapping_t *map)
+{
+#ifdef _WIN32
+	return false;
+#else
+	char netpath[MAX_OSPATH];
+	qbool ret;
+	int fd;
+
+	if (snprintf (netpath, sizeof(netpath), "%s/%s", (char*)handle, loc->rawname) >= sizeof(netpath))
+		return false;
+
+	if ((fd = open(netpath, O_RDONLY)) < 0)
+		return false;
+
+	ret = FSOS_MapRegion(fd, loc->offset, loc->len, map);
+	close(fd); // mapping keeps its own reference
+
+	return ret;
+#endif
+}
+
 searchpathfuncs_t osfilefuncs = {
 	FSOS_PrintPath,
 	FSOS_ClosePath,
@@ -261,5 +650,6 @@ searchpathfuncs_t osfilefuncs = {
 	FSOS_EnumerateFiles,
 	NULL,
 	NULL,
-	FSOS_OpenVFS
+	FSOS_OpenVFS,
+	FSOS_MapFile
 };
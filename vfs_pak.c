@@ -37,6 +37,7 @@ typedef struct pack_s
 
 	int     numfiles;
 	packfile_t  *files;
+	packindex_t index;
 } pack_t;
 
 typedef struct
@@ -193,6 +194,7 @@ static void FSPAK_ClosePath(void *handle)
 		return;	//not free yet
 
 	VFS_CLOSE (pak->handle);
+	FS_FreePackIndex(&pak->index);
 	if (pak->files)
 		Q_free(pak->files);
 	Q_free(pak);
@@ -205,20 +207,13 @@ static void FSPAK_BuildHash(void *handle)
 
 	for (i = 0; i < pak->numfiles; i++)
 	{
-		if (!Hash_GetInsensitive(filesystemhash, pak->files[i].name))
-		{
-			Hash_AddInsensitive(filesystemhash, pak->files[i].name, &pak->files[i]);
-			fs_hash_files++;
-		}
-		else
-			fs_hash_dups++;
+		FS_AddFileHash(pak->files[i].name, &pak->files[i]);
 	}
 }
 
 static qbool FSPAK_FLocate(void *handle, flocation_t *loc, const char *filename, void *hashedresult)
 {
 	packfile_t *pf = hashedresult;
-	int i;
 	pack_t		*pak = handle;
 
 // look through all the pak file elements
@@ -230,14 +225,7 @@ static qbool FSPAK_FLocate(void *handle, flocation_t *loc, const char *filename,
 	}
 	else
 	{
-		for (i=0 ; i<pak->numfiles ; i++)	//look for the file
-		{
-			if (!strcmp (pak->files[i].name, filename))
-			{
-				pf = &pak->files[i];
-				break;
-			}
-		}
+		pf = FS_PackIndexFind(&pak->index, filename);
 	}
 
 	if (pf)
@@ -279,6 +267,7 @@ Takes an explicit (not game tree related) path to a pak file.
 
 Loads the header and directory, adding the files at the beginning
 of the list so they override previous pack files.
+The directory is taken from the file system index if the pak didn't change.
 =================
 */
 static void *FSPAK_LoadPackFile (vfsfile_t *file, const char *desc)
@@ -296,6 +285,12 @@ static void *FSPAK_LoadPackFile (vfsfile_t *file, const char *desc)
 	if (packhandle == NULL)
 		return NULL;
 
+	if ((newfiles = FS_IndexedArchive(desc, &numpackfiles)))
+	{
+		pack = (pack_t *)Q_calloc(1, sizeof (pack_t));
+		goto loaded;
+	}
+
 	VFS_READ(packhandle, &header, sizeof(header), &err);
 	if (header.id[0] != 'P' || header.id[1] != 'A'
 	|| header.id[2] != 'C' || header.id[3] != 'K')
@@ -340,10 +335,14 @@ static void *FSPAK_LoadPackFile (vfsfile_t *file, const char *desc)
 	if (crc != PAK0_CRC)
 		com_modified = true;
 */
+	FS_IndexArchive(desc, newfiles, numpackfiles);
+
+loaded:
 	strlcpy (pack->filename, desc, sizeof (pack->filename));
 	pack->handle = packhandle;
 	pack->numfiles = numpackfiles;
 	pack->files = newfiles;
+	FS_BuildPackIndex(&pack->index, newfiles, numpackfiles, false);
 	pack->filepos = 0;
 	VFS_SEEK(packhandle, pack->filepos, SEEK_SET);
 
@@ -352,6 +351,14 @@ static void *FSPAK_LoadPackFile (vfsfile_t *file, const char *desc)
 	return pack;
 }
 
+// pak files are stored uncompressed, so this is just a view into the pak
+static qbool FSPAK_MapFile(void *handle, flocation_t *loc, fs_mapping_t *map)
+{
+	pack_t *pak = handle;
+
+	return FSOS_MapRegion(VFSOS_FileNo(pak->handle), loc->offset, loc->len, map);
+}
+
 extern void FSOS_ReadFile(void *handle, flocation_t *loc, char *buffer);
 
 searchpathfuncs_t packfilefuncs = {
@@ -363,5 +370,6 @@ searchpathfuncs_t packfilefuncs = {
 	FSPAK_EnumerateFiles,
 	FSPAK_LoadPackFile,
 	NULL,
-	FSPAK_OpenVFS
+	FSPAK_OpenVFS,
+	FSPAK_MapFile
 };
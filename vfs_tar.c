@@ -34,7 +34,7 @@
 typedef struct tarfile_s
 {
 	char filename[MAX_QPATH];
-	hashtable_t hash;
+	packindex_t index;
 	vfsfile_t *raw;
 
 	int numfiles;
@@ -337,6 +337,7 @@ static void FSTAR_ClosePath(void *handle)
 		return; //not yet time
 
 	VFS_CLOSE(tar->raw);
+	FS_FreePackIndex(&tar->index);
 	if (tar->files)
 		Q_free(tar->files);
 	Q_free(tar);
@@ -349,13 +350,7 @@ static void FSTAR_BuildHash(void *handle)
 
 	for (i = 0; i < tar->numfiles; i++)
 	{
-		if (!Hash_GetInsensitive(filesystemhash, tar->files[i].name))
-		{
-			Hash_AddInsensitive(filesystemhash, tar->files[i].name, &tar->files[i]);
-			fs_hash_files++;
-		}
-		else
-			fs_hash_dups++;
+		FS_AddFileHash(tar->files[i].name, &tar->files[i]);
 	}
 }
 
@@ -363,7 +358,6 @@ static qbool FSTAR_FLocate(void *handle, flocation_t *loc, const char *filename,
 {
 	packfile_t *pf = (packfile_t *) hashedresult;
 	tarfile_t *tar = (tarfile_t  *) handle;
-	int i;
 
 	// look through all the pak file elements
 
@@ -374,14 +368,7 @@ static qbool FSTAR_FLocate(void *handle, flocation_t *loc, const char *filename,
 	}
 	else
 	{
-		for (i=0 ; i<tar->numfiles ; i++)   //look for the file
-		{
-			if (!strcmp (tar->files[i].name, filename))
-			{
-				pf = &tar->files[i];
-				break;
-			}
-		}
+		pf = FS_PackIndexFind(&tar->index, filename);
 	}
 
 	if (pf)
@@ -450,6 +437,10 @@ static void *FSTAR_LoadTarFile(vfsfile_t *tarhandle, const char *desc)
 	tar->raw = tarhandle;
 	if (!tar->raw) goto fail;
 
+	// The file system index saves walking the headers of an unchanged tar
+	if ((tar->files = FS_IndexedArchive(desc, &tar->numfiles)))
+		goto loaded;
+
 	// Get the number of files inside the tar
 	tar->numfiles = tarOperationIndexFiles(tar->raw, NULL);
 	if (tar->numfiles < 0) goto fail;
@@ -457,6 +448,10 @@ static void *FSTAR_LoadTarFile(vfsfile_t *tarhandle, const char *desc)
 	// Create a list of the number of files
 	tar->files = (packfile_t *)Q_malloc(tar->numfiles * sizeof(packfile_t));
 	tarOperationIndexFiles(tar->raw, tar->files);
+	FS_IndexArchive(desc, tar->files, tar->numfiles);
+
+loaded:
+	FS_BuildPackIndex(&tar->index, tar->files, tar->numfiles, false);
 
 	tar->references = 1;
 
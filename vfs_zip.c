@@ -113,91 +113,224 @@ static void FSZIP_CreteFileFuncs(zlib_filefunc_def *funcs) {
 //==========================================
 typedef struct zipfile_s
 {
-	char filename[MAX_QPATH];
-	unzFile handle;
+	char filename[MAX_OSPATH];
+	unzFile handle;		// opened on first use if the directory came from the file system index
 	int		numfiles;
 	packfile_t	*files;
-
-#ifdef HASH_FILESYSTEM
-	hashtable_t hash;
-#endif
+	packindex_t	index;
 
 	zlib_filefunc_def zlib_funcs;
 
 	vfsfile_t *raw;
-	vfsfile_t *currentfile;	//our unzip.c can only handle one active file at any one time
-							//so we have to keep closing and switching.
-							//slow, but it works. most of the time we'll only have a single file open anyway.
 	int references;	//and a reference count
 } zipfile_t;
 
+#define ZIP_WINDOW			32768		// deflate history, also what we keep of the decompressed output
+#define ZIP_INBUF			16384
+#define ZIP_CHECKPOINT_SPACING	(1024 * 1024)	// entries bigger than this get inflate checkpoints
+
+// state to restart inflate in the middle of an entry, see zran.c from zlib
+typedef struct {
+	unsigned long out;		// decompressed position
+	unsigned long in;		// compressed position of the first unused byte
+	int bits;				// bits of the byte before in not yet used
+	byte window[ZIP_WINDOW];	// the ZIP_WINDOW decompressed bytes before out
+} zipcheckpoint_t;
+
+// Every open entry reads the archive through the raw handle on its own, so several
+// entries can be read interleaved. Stored entries are read in place, deflated
+// entries keep their own inflate stream and the last ZIP_WINDOW bytes they produced.
 typedef struct {
 	vfsfile_t funcs;
 
-	vfsfile_t *defer;
-
-	//in case we're forced away.
 	zipfile_t *parent;
 	qbool iscompressed;
 	int pos;
 	int length;	//try and optimise some things
 	int index;
-	int startpos;
+	unsigned long rawstart;	// offset of entry data in the archive
+	unsigned long rawlen;	// compressed size
+
+	// deflated entries only
+	z_stream strm;
+	unsigned long rawpos;	// next compressed byte to read into inbuf
+	unsigned long outpos;	// decompressed bytes produced so far
+	byte inbuf[ZIP_INBUF];
+	byte window[ZIP_WINDOW];	// circular, holds [outpos - ZIP_WINDOW, outpos)
+
+	zipcheckpoint_t *checkpoints;
+	int numcheckpoints;
 } vfszip_t;
 
-// VFS-FIXME Need to figure what this function is trying to do
-static void VFSZIP_MakeActive(vfszip_t *vfsz)
+// the late open reads through the handle we were given, the file is already open
+static unzFile FSZIP_Handle(zipfile_t *zip)
 {
-	int i;
-	char buffer[8192];	//must be power of two
+	if (!zip->handle)
+	{
+		zip->zlib_funcs.opaque = zip->raw;
+		if (!(zip->handle = unzOpen2(zip->filename, &zip->zlib_funcs)))
+			Com_Printf("Can't open \"%s\"\n", zip->filename);
+	}
+
+	return zip->handle;
+}
 
-	if ((vfszip_t*)vfsz->parent->currentfile == vfsz)
-		return;	//already us
-	if (vfsz->parent->currentfile)
-		unzCloseCurrentFile(vfsz->parent->handle);
+// find where the data of an entry starts, unzip.c reads the local header for us
+static qbool FSZIP_EntryInfo(zipfile_t *zip, int index, int *method, unsigned long *rawstart, unsigned long *rawlen)
+{
+	unz_file_info file_info;
+	unzFile handle;
+	int level;
 
-	//unzLocateFileMy(vfsz->parent->handle, vfsz->index, vfsz->startpos);
-	unzSetOffset(vfsz->parent->handle, vfsz->startpos);
-	unzOpenCurrentFile(vfsz->parent->handle);
+	if (!(handle = FSZIP_Handle(zip)))
+		return false;
 
-	if (vfsz->pos > 0)
-	{
-		Com_DPrintf("VFSZIP_MakeActive: Shockingly inefficient\n");
+	unzSetOffset(handle, zip->files[index].filepos);
+	if (unzGetCurrentFileInfo(handle, &file_info, NULL, 0, NULL, 0, NULL, 0) != UNZ_OK)
+		return false;
+	if (file_info.flag & 1) // encrypted
+		return false;
 
-		//now we need to seek up to where we had previously gotten to.
-		for (i = 0; i < vfsz->pos-sizeof(buffer); i++)
-			unzReadCurrentFile(vfsz->parent->handle, buffer, sizeof(buffer));
-		unzReadCurrentFile(vfsz->parent->handle, buffer, vfsz->pos - i);
+	if (unzOpenCurrentFile2(handle, method, &level, 1) != UNZ_OK)
+		return false;
+	*rawstart = (unsigned long) unzGetCurrentFileZStreamPos64(handle);
+	*rawlen = file_info.compressed_size;
+	unzCloseCurrentFile(handle);
+
+	return true;
+}
+
+static void VFSZIP_AddCheckpoint(vfszip_t *vfsz)
+{
+	zipcheckpoint_t *cp;
+	int off = vfsz->outpos % ZIP_WINDOW;
+
+	if (vfsz->numcheckpoints % 8 == 0)
+		vfsz->checkpoints = Q_realloc(vfsz->checkpoints, (vfsz->numcheckpoints + 8) * sizeof(*cp));
+
+	cp = &vfsz->checkpoints[vfsz->numcheckpoints++];
+	cp->out = vfsz->outpos;
+	cp->in = vfsz->rawpos - vfsz->strm.avail_in;
+	cp->bits = vfsz->strm.data_type & 7;
+	memcpy(cp->window, vfsz->window + off, ZIP_WINDOW - off);
+	memcpy(cp->window + ZIP_WINDOW - off, vfsz->window, off);
+}
+
+// restart inflate from the last checkpoint before pos, or from the start of the entry
+static qbool VFSZIP_Rewind(vfszip_t *vfsz, unsigned long pos)
+{
+	zipcheckpoint_t *cp = NULL;
+	int i, off;
+	byte c;
+
+	for (i = vfsz->numcheckpoints - 1; i >= 0; i--) {
+		if (vfsz->checkpoints[i].out <= pos) {
+			cp = &vfsz->checkpoints[i];
+			break;
+		}
 	}
 
-	vfsz->parent->currentfile = (vfsfile_t*)vfsz;
+	inflateReset(&vfsz->strm);
+	vfsz->strm.avail_in = 0;
+
+	if (!cp) {
+		vfsz->rawpos = vfsz->outpos = 0;
+		return true;
+	}
+
+	vfsz->rawpos = cp->in;
+	if (cp->bits) {
+		VFS_SEEK(vfsz->parent->raw, vfsz->rawstart + cp->in - 1, SEEK_SET);
+		if (VFS_READ(vfsz->parent->raw, &c, 1, NULL) != 1)
+			return false;
+		inflatePrime(&vfsz->strm, cp->bits, c >> (8 - cp->bits));
+	}
+	inflateSetDictionary(&vfsz->strm, cp->window, ZIP_WINDOW);
+
+	vfsz->outpos = cp->out;
+	off = vfsz->outpos % ZIP_WINDOW;
+	memcpy(vfsz->window + off, cp->window, ZIP_WINDOW - off);
+	memcpy(vfsz->window, cp->window + ZIP_WINDOW - off, off);
+
+	return true;
+}
+
+// decompress the next piece of the entry into the window, returns bytes produced or -1
+static int VFSZIP_Inflate(vfszip_t *vfsz)
+{
+	int off = vfsz->outpos % ZIP_WINDOW;
+	unsigned long want;
+	int ret, got;
+
+	// with all the input read inflate can still hold output, a match cut short
+	// by the end of the window for example, so it is called until it is stuck
+	want = vfsz->strm.avail_in ? 0 : min(ZIP_INBUF, vfsz->rawlen - vfsz->rawpos);
+	if (want) {
+		VFS_SEEK(vfsz->parent->raw, vfsz->rawstart + vfsz->rawpos, SEEK_SET);
+		if ((got = VFS_READ(vfsz->parent->raw, vfsz->inbuf, want, NULL)) <= 0)
+			return -1;
+		vfsz->rawpos += got;
+		vfsz->strm.next_in = vfsz->inbuf;
+		vfsz->strm.avail_in = got;
+	}
+
+	vfsz->strm.next_out = vfsz->window + off;
+	vfsz->strm.avail_out = ZIP_WINDOW - off;
+
+	ret = inflate(&vfsz->strm, Z_BLOCK);
+	if (ret != Z_OK && ret != Z_STREAM_END)
+		return -1;	// Z_BUF_ERROR when there's nothing left to give
+
+	got = (ZIP_WINDOW - off) - vfsz->strm.avail_out;
+	vfsz->outpos += got;
+
+	// at a block boundary which is not the end of the stream
+	if ((vfsz->strm.data_type & 128) && !(vfsz->strm.data_type & 64) &&
+		vfsz->outpos >= (vfsz->numcheckpoints + 1) * ZIP_CHECKPOINT_SPACING)
+		VFSZIP_AddCheckpoint(vfsz);
+
+	if (ret == Z_STREAM_END && vfsz->outpos < vfsz->length)
+		return -1;
+
+	return got;
 }
 
 static int VFSZIP_ReadBytes (struct vfsfile_s *file, void *buffer, int bytestoread, vfserrno_t *err)
 {
-	int read;
 	vfszip_t *vfsz = (vfszip_t*)file;
+	byte *out = buffer;
+	int read = 0, chunk;
+
+	if (bytestoread > vfsz->length - vfsz->pos)
+		bytestoread = vfsz->length - vfsz->pos;
+
+	if (!vfsz->iscompressed)
+	{
+		VFS_SEEK(vfsz->parent->raw, vfsz->rawstart + vfsz->pos, SEEK_SET);
+		read = bytestoread > 0 ? VFS_READ(vfsz->parent->raw, buffer, bytestoread, NULL) : 0;
+		if (read < 0)
+			read = 0;
+	}
+	else while (read < bytestoread)
+	{
+		unsigned long pos = vfsz->pos + read;
+
+		if (pos < vfsz->outpos && vfsz->outpos - pos <= min(vfsz->outpos, ZIP_WINDOW))
+		{	// still in the window
+			chunk = min(vfsz->outpos - pos, ZIP_WINDOW - pos % ZIP_WINDOW);
+			chunk = min(chunk, bytestoread - read);
+			memcpy(out + read, vfsz->window + pos % ZIP_WINDOW, chunk);
+			read += chunk;
+			continue;
+		}
+
+		if (pos < vfsz->outpos && !VFSZIP_Rewind(vfsz, pos))
+			break;
+
+		if (VFSZIP_Inflate(vfsz) < 0)
+			break;
+	}
 
-	if (vfsz->defer)
-		return VFS_READ(vfsz->defer, buffer, bytestoread, err);
-
-//	if (vfsz->iscompressed)
-//	{
-		VFSZIP_MakeActive(vfsz);
-		read = unzReadCurrentFile(vfsz->parent->handle, buffer, bytestoread);
-//	}
-//	else
-//	{
-		// VFS-FIXME This stuff seems to be only for optimisation, 
-		// hence we can probably just go with unzReadCurrentFile
-//		if (vfsz->parent->currentfile != file)
-//		{
-//			unzCloseCurrentFile(vfsz->parent->handle);
-//			VFS_SEEK(vfsz->parent->raw, vfsz->pos+vfsz->startpos, SEEK_SET);
-//			vfsz->parent->currentfile = file;
-//		}
-//		read = VFS_READ(vfsz->parent->raw, buffer, bytestoread, err);
-//	}
 	if (err)
 		*err = ((read || bytestoread <= 0) ? VFSERR_NONE : VFSERR_EOF);
 
@@ -211,58 +344,17 @@ static int VFSZIP_WriteBytes (struct vfsfile_s *file, const void *buffer, int by
 	return 0;
 }
 
-// VFS-FIXME: What is going on here... why not just unzSetOffset
+// reads decompress forward from wherever the stream is, or restart at a checkpoint
 static int VFSZIP_Seek (struct vfsfile_s *file, unsigned long pos, int whence)
 {
 	vfszip_t *vfsz = (vfszip_t*)file;
 
-	if (vfsz->defer)
-		return VFS_SEEK(vfsz->defer, pos, whence);
-
-	//This is *really* inefficient
-	if (vfsz->parent->currentfile == file)
+	switch (whence)
 	{
-		if (vfsz->iscompressed)
-		{	//if they're going to seek on a file in a zip, let's just copy it out
-			char buffer[8192];
-			unsigned int chunk;
-			unsigned int i;
-			unsigned int length;
-
-			vfsz->defer = FS_OpenTemp();
-			if (vfsz->defer)
-			{
-				unzCloseCurrentFile(vfsz->parent->handle);
-				vfsz->parent->currentfile = NULL;	//make it not us
-
-				length = vfsz->length;
-				i = 0;
-				vfsz->pos = 0;
-				VFSZIP_MakeActive(vfsz);
-				while (1)
-				{
-					chunk = length - i;
-					if (chunk > sizeof(buffer))
-						chunk = sizeof(buffer);
-					if (chunk == 0)
-						break;
-					unzReadCurrentFile(vfsz->parent->handle, buffer, chunk);
-					VFS_WRITE(vfsz->defer, buffer, chunk);
-
-					i += chunk;
-				}
-			}
-		}
-
-		unzCloseCurrentFile(vfsz->parent->handle);
-		vfsz->parent->currentfile = NULL;	//make it not us
-
-		if (vfsz->defer)
-			return VFS_SEEK(vfsz->defer, pos, SEEK_SET);
+	case SEEK_CUR: pos += vfsz->pos; break;
+	case SEEK_END: pos += vfsz->length; break;
 	}
 
-
-
 	if (pos > vfsz->length)
 		return -1;
 	vfsz->pos = pos;
@@ -273,10 +365,6 @@ static int VFSZIP_Seek (struct vfsfile_s *file, unsigned long pos, int whence)
 static unsigned long VFSZIP_Tell (struct vfsfile_s *file)
 {
 	vfszip_t *vfsz = (vfszip_t*)file;
-
-	if (vfsz->defer)
-		return VFS_TELL(vfsz->defer);
-
 	return vfsz->pos;
 }
 
@@ -291,11 +379,9 @@ static void VFSZIP_Close (struct vfsfile_s *file)
 {
 	vfszip_t *vfsz = (vfszip_t*)file;
 
-	if (vfsz->parent->currentfile == file)
-		vfsz->parent->currentfile = NULL;	//make it not us
-
-	if (vfsz->defer)
-		VFS_CLOSE(vfsz->defer);
+	if (vfsz->iscompressed)
+		inflateEnd(&vfsz->strm);
+	Q_free(vfsz->checkpoints);
 
 	FSZIP_ClosePath(vfsz->parent);
 	Q_free(vfsz);
@@ -303,43 +389,44 @@ static void VFSZIP_Close (struct vfsfile_s *file)
 
 static vfsfile_t *FSZIP_OpenVFS(void *handle, flocation_t *loc, char *mode)
 {
-	//int rawofs;
 	zipfile_t *zip = handle;
 	vfszip_t *vfsz;
+	unsigned long rawstart, rawlen;
+	int method;
 
 	if (strcmp(mode, "rb"))
 		return NULL; //urm, unable to write/append
 
+	if (!FSZIP_EntryInfo(zip, loc->index, &method, &rawstart, &rawlen))
+		return NULL;
+	if (method != 0 && method != Z_DEFLATED)
+		return NULL;
+
 	vfsz = Q_calloc(1, sizeof(vfszip_t));
 
 	vfsz->parent = zip;
 	vfsz->index = loc->index;
-	vfsz->startpos = zip->files[loc->index].filepos;
 	vfsz->length = loc->len;
+	vfsz->rawstart = rawstart;
+	vfsz->rawlen = rawlen;
+	vfsz->iscompressed = (method == Z_DEFLATED);
+
+	if (vfsz->iscompressed && inflateInit2(&vfsz->strm, -MAX_WBITS) != Z_OK)
+	{
+		Q_free(vfsz);
+		return NULL;
+	}
 
 	vfsz->funcs.ReadBytes  = strcmp(mode, "rb") ? NULL : VFSZIP_ReadBytes;
 	vfsz->funcs.WriteBytes = strcmp(mode, "wb") ? NULL : VFSZIP_WriteBytes;
 	vfsz->funcs.Seek       = VFSZIP_Seek;
-	vfsz->funcs.seekingisabadplan = true;
+	vfsz->funcs.seekingisabadplan = vfsz->iscompressed;
 	vfsz->funcs.Tell       = VFSZIP_Tell;
 	vfsz->funcs.GetLen     = VFSZIP_GetLen;
 	vfsz->funcs.Close      = VFSZIP_Close;
 	if (loc->search)
 		vfsz->funcs.copyprotected = loc->search->copyprotected;
 
-	// VFS-FIXME: 
-	// What is the point of is compressed etc
-	
-	//unzLocateFileMy(vfsz->parent->handle, vfsz->index, vfsz->startpos);
-	//rawofs = unzGetCurrentFileUncompressedPos(zip->handle);
-	/*vfsz->iscompressed = 1; // rawofs<0;
-	if (!vfsz->iscompressed)
-	{
-		vfsz->startpos = rawofs;
-		VFS_SEEK(zip->raw, vfsz->startpos, SEEK_SET);
-		vfsz->parent->currentfile = (vfsfile_t*)vfsz;
-	}*/
-
 	zip->references++;
 
 	return (vfsfile_t*)vfsz;
@@ -365,8 +452,10 @@ static void FSZIP_ClosePath(void *handle)
 	if (--zip->references > 0)
 		return;	//not yet time
 
-	unzClose(zip->handle);
+	if (zip->handle)
+		unzClose(zip->handle);
 	VFS_CLOSE(zip->raw);
+	FS_FreePackIndex(&zip->index);
 	if (zip->files)
 		Q_free(zip->files);
 	Q_free(zip);
@@ -378,13 +467,7 @@ static void FSZIP_BuildHash(void *handle)
 
 	for (i = 0; i < zip->numfiles; i++)
 	{
-		if (!Hash_GetInsensitive(filesystemhash, zip->files[i].name))
-		{
-			Hash_AddInsensitive(filesystemhash, zip->files[i].name, &zip->files[i]);
-			fs_hash_files++;
-		}
-		else
-			fs_hash_dups++;
+		FS_AddFileHash(zip->files[i].name, &zip->files[i]);
 	}
 }
 
@@ -392,7 +475,6 @@ static qbool FSZIP_FLocate(void *handle, flocation_t *loc, const char *filename,
 {
 	packfile_t *pf  = (packfile_t *) hashedresult;
 	zipfile_t  *zip = (zipfile_t  *) handle;
-	int i;
 
 // look through all the pak file elements
 
@@ -403,14 +485,7 @@ static qbool FSZIP_FLocate(void *handle, flocation_t *loc, const char *filename,
 	}
 	else
 	{
-		for (i=0 ; i<zip->numfiles ; i++)	//look for the file
-		{
-			if (!strcasecmp (zip->files[i].name, filename))
-			{
-				pf = &zip->files[i];
-				break;
-			}
-		}
+		pf = FS_PackIndexFind(&zip->index, filename);
 	}
 
 	if (pf)
@@ -441,13 +516,17 @@ static qbool FSZIP_FLocate(void *handle, flocation_t *loc, const char *filename,
 static void FSZIP_ReadFile(void *handle, flocation_t *loc, char *buffer)
 {
 	zipfile_t *zip = handle;
-	int err;
+	unzFile h;
+	int err = -1;
 
-	unzSetOffset(zip->handle, zip->files[loc->index].filepos);
+	if ((h = FSZIP_Handle(zip)))
+	{
+		unzSetOffset(h, zip->files[loc->index].filepos);
 
-	unzOpenCurrentFile (zip->handle);
-	err = unzReadCurrentFile (zip->handle, buffer, zip->files[loc->index].filelen);
-	unzCloseCurrentFile (zip->handle);
+		unzOpenCurrentFile (h);
+		err = unzReadCurrentFile (h, buffer, zip->files[loc->index].filelen);
+		unzCloseCurrentFile (h);
+	}
 
 	if (err!=zip->files[loc->index].filelen)
 	{
@@ -483,6 +562,8 @@ Takes an explicit (not game tree related) path to a pak file.
 
 Loads the header and directory, adding the files at the beginning
 of the list so they override previous pack files.
+The directory is taken from the file system index if the pk3 didn't change,
+the archive itself is then opened when the first file is read.
 =================
 */
 static void *FSZIP_LoadZipFile(vfsfile_t *packhandle, const char *desc)
@@ -495,9 +576,13 @@ static void *FSZIP_LoadZipFile(vfsfile_t *packhandle, const char *desc)
 	unz_global_info info;
 	
 	zip   = (zipfile_t *) Q_calloc(1, sizeof(*zip));
-	strlcpy (zip->filename, desc, sizeof (zip->filename));
+	if (strlcpy (zip->filename, desc, sizeof (zip->filename)) >= sizeof (zip->filename)) goto fail;
 	FSZIP_CreteFileFuncs(&(zip->zlib_funcs));
 	zip->raw = packhandle;
+
+	if ((zip->files = FS_IndexedArchive(desc, &zip->numfiles)))
+		goto loaded;
+
 	zip->handle = unzOpen2(desc, funcs);
 	if (!zip->handle) goto fail;
 
@@ -524,13 +609,18 @@ static void *FSZIP_LoadZipFile(vfsfile_t *packhandle, const char *desc)
 		}
 
 	}
-	
+
+	FS_IndexArchive(desc, zip->files, zip->numfiles);
+
+loaded:
+	FS_BuildPackIndex(&zip->index, zip->files, zip->numfiles, true);
 	zip->references = 1;
-	zip->currentfile = NULL;
 
 	return zip;
 
 fail:
+	if (zip->handle)
+		unzClose(zip->handle);
 	// Q_free is safe to call on NULL pointers
 	Q_free(funcs);
 	Q_free(zip->files);
@@ -538,6 +628,22 @@ fail:
 	return NULL;
 }
 
+// only entries which are stored (not deflated) can be mapped, from the pk3 file itself
+static qbool FSZIP_MapFile(void *handle, flocation_t *loc, fs_mapping_t *map)
+{
+	zipfile_t *zip = handle;
+	unsigned long rawstart, rawlen;
+	int method, fd;
+
+	if ((fd = VFSOS_FileNo(zip->raw)) < 0)
+		return false;
+
+	if (!FSZIP_EntryInfo(zip, loc->index, &method, &rawstart, &rawlen) || method != 0)
+		return false;
+
+	return FSOS_MapRegion(fd, rawstart, loc->len, map);
+}
+
 // VFS-FIXME: Don't really seem to know what this does
 static int FSZIP_GeneratePureCRC(void *handle, int seed, int crctype)
 {
@@ -551,15 +657,18 @@ static int FSZIP_GeneratePureCRC(void *handle, int seed, int crctype)
 	filecrcs = Q_malloc((zip->numfiles+1)*sizeof(int));
 	filecrcs[numcrcs++] = seed;
 
-	unzGoToFirstFile(zip->handle);
-	for (i = 0; i < zip->numfiles; i++)
+	if (FSZIP_Handle(zip))
 	{
-		if (zip->files[i].filelen>0)
+		unzGoToFirstFile(zip->handle);
+		for (i = 0; i < zip->numfiles; i++)
 		{
-			unzGetCurrentFileInfo (zip->handle, &file_info, NULL, 0, NULL, 0, NULL, 0);
-			filecrcs[numcrcs++] = file_info.crc;
+			if (zip->files[i].filelen>0)
+			{
+				unzGetCurrentFileInfo (zip->handle, &file_info, NULL, 0, NULL, 0, NULL, 0);
+				filecrcs[numcrcs++] = file_info.crc;
+			}
+			unzGoToNextFile (zip->handle);
 		}
-		unzGoToNextFile (zip->handle);
 	}
 
 	if (crctype)
@@ -577,7 +686,8 @@ searchpathfuncs_t zipfilefuncs = {
 	FSZIP_EnumerateFiles,
 	FSZIP_LoadZipFile,
 	FSZIP_GeneratePureCRC,
-	FSZIP_OpenVFS
+	FSZIP_OpenVFS,
+	FSZIP_MapFile
 };
 
 #endif // WITH_ZIP
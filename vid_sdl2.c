@@ -1380,6 +1380,16 @@ void VID_Init(unsigned char *palette) {
 		VID_ParseCmdLine();
 	}
 
+	// -benchmark runs without a window or GL context, the 2D code only needs a console size.
+	if (cls.headless) {
+		glConfig.vidWidth = 640;
+		glConfig.vidHeight = 480;
+		gl_vendor = gl_renderer = "";
+		VID_UpdateConRes();
+		vid_initialized = true;
+		return;
+	}
+
 	VID_SDL_Init();
 
 	// print info
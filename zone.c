@@ -21,6 +21,11 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 // zone.c - memory management
 
 #include "common.h"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
 
 void Cache_FreeLow (int new_low_hunk);
 void Cache_FreeHigh (int new_high_hunk);
@@ -29,6 +34,12 @@ void Cache_FreeHigh (int new_high_hunk);
 
 #define HUNK_SENTINEL 0x1df001ed
 
+// The hunk is one range of address space, reserved up front so that it stays
+// contiguous (alias models are copied out of it as one block), and committed in
+// chunks from either end as the low and high hunk and the cache reach into it.
+#define HUNK_RESERVE	((int) (sizeof(void *) > 4 ? 0x40000000 : 0x10000000))
+#define HUNK_CHUNK		0x400000
+
 typedef struct {
 	int		sentinal;
 	int		size; // including sizeof(hunk_t), -1 = not allocated
@@ -44,6 +55,86 @@ int		hunk_high_used;
 qbool	hunk_tempactive;
 int		hunk_tempmark;
 
+static int	hunk_low_committed, hunk_high_committed;
+// Nothing in between these was written since it was committed, so it's still zero.
+// Everything written is below hunk_low_clean or in the top hunk_high_clean bytes.
+static int	hunk_low_clean, hunk_high_clean;
+static int	hunk_low_peak, hunk_high_peak;
+
+static int	cache_size;		// cache is flushed LRU first to stay below this
+static int	cache_used, cache_peak;
+
+static byte *Hunk_Reserve (int size) {
+#ifdef _WIN32
+	return (byte *) VirtualAlloc (NULL, size, MEM_RESERVE, PAGE_NOACCESS);
+#else
+	void *base;
+	int flags = MAP_PRIVATE | MAP_ANON;
+
+#ifdef MAP_NORESERVE
+	flags |= MAP_NORESERVE;
+#endif
+	base = mmap (NULL, size, PROT_NONE, flags, -1, 0);
+	return base == MAP_FAILED ? NULL : (byte *) base;
+#endif
+}
+
+static qbool Hunk_CommitRange (int start, int end) {
+	if (start >= end)
+		return true;
+#ifdef _WIN32
+	return VirtualAlloc (hunk_base + start, end - start, MEM_COMMIT, PAGE_READWRITE) != NULL;
+#else
+	return !mprotect (hunk_base + start, end - start, PROT_READ | PROT_WRITE);
+#endif
+}
+
+// make the bottom end bytes usable
+static qbool Hunk_CommitLow (int end) {
+	int newend;
+
+	if (end <= hunk_low_committed)
+		return true;
+
+	newend = min (hunk_size, (end + HUNK_CHUNK - 1) & ~(HUNK_CHUNK - 1));
+	if (!Hunk_CommitRange (hunk_low_committed, min (newend, hunk_size - hunk_high_committed)))
+		return false;
+
+	hunk_low_committed = newend;
+	return true;
+}
+
+// make the top used bytes usable
+static qbool Hunk_CommitHigh (int used) {
+	int newused;
+
+	if (used <= hunk_high_committed)
+		return true;
+
+	newused = min (hunk_size, (used + HUNK_CHUNK - 1) & ~(HUNK_CHUNK - 1));
+	if (!Hunk_CommitRange (max (hunk_size - newused, hunk_low_committed), hunk_size - hunk_high_committed))
+		return false;
+
+	hunk_high_committed = newused;
+	return true;
+}
+
+// zeroes what in [start, start + size) may have been written to
+static void Hunk_Clear (byte *start, int size) {
+	int from = start - hunk_base, to = from + size;
+	int clean_from = hunk_low_clean, clean_to = hunk_size - hunk_high_clean;
+
+	if (clean_from >= clean_to || to <= clean_from || from >= clean_to) {
+		memset (start, 0, size);
+		return;
+	}
+
+	if (from < clean_from)
+		memset (start, 0, clean_from - from);
+	if (to > clean_to)
+		memset (hunk_base + clean_to, 0, to - clean_to);
+}
+
 //Run consistancy and sentinal trahing checks
 
 void Hunk_Check (void) {
@@ -58,34 +149,30 @@ void Hunk_Check (void) {
 	}
 }
 
+#define HUNK_PRINT_NAMES 64
+
 //If "all" is specified, every single allocation is printed.
-//Otherwise, allocations with the same name will be totaled up before printing.
+//Otherwise, allocations with the same name are totaled up before printing.
 void Hunk_Print (qbool all) {
-	hunk_t *h, *next, *endlow, *starthigh, *endhigh;
-	int count, sum, totalblocks;
+	hunk_t *h, *endlow, *starthigh, *endhigh;
+	struct {
+		char	name[9];
+		int		sum, blocks;
+	} names[HUNK_PRINT_NAMES];
+	int i, numnames = 0, totalblocks = 0;
 	char name[9];
 
 	name[8] = 0;
-	count = 0;
-	sum = 0;
-	totalblocks = 0;
 
 	h = (hunk_t *)hunk_base;
 	endlow = (hunk_t *)(hunk_base + hunk_low_used);
 	starthigh = (hunk_t *)(hunk_base + hunk_size - hunk_high_used);
 	endhigh = (hunk_t *)(hunk_base + hunk_size);
 
-	Com_Printf ("          :%8i total hunk size\n", hunk_size);
-	Com_Printf ("-------------------------\n");
-
 	while (1) {
 		// skip to the high hunk if done with low hunk
-		if ( h == endlow ) {
-			Com_Printf ("-------------------------\n");
-			Com_Printf ("          :%8i REMAINING\n", hunk_size - hunk_low_used - hunk_high_used);
-			Com_Printf ("-------------------------\n");
+		if ( h == endlow )
 			h = starthigh;
-		}
 
 		// if totally done, break
 		if ( h == endhigh )
@@ -97,33 +184,45 @@ void Hunk_Print (qbool all) {
 		if (h->size < 16 || h->size + (byte *)h - hunk_base > hunk_size)
 			Sys_Error ("Hunk_Print: bad size");
 
-		next = (hunk_t *)((byte *)h+h->size);
-		count++;
 		totalblocks++;
-		sum += h->size;
 
 		// print the single block
 		memcpy (name, h->name, 8);
 		if (all)
 			Com_Printf ("%8p :%8i %8s\n",h, h->size, name);
 
-		// print the total
-		if (next == endlow || next == endhigh || strncmp (h->name, next->name, 8)) {
-			if (!all)
-				Com_Printf ("          :%8i %8s (TOTAL)\n",sum, name);
-			count = 0;
-			sum = 0;
+		// add it to the total of its name, the last one collects the rest
+		for (i = 0; i < numnames && strcmp (names[i].name, name); i++)
+			;
+		if (i == HUNK_PRINT_NAMES) {
+			i--;
+		} else if (i == numnames) {
+			strlcpy (names[i].name, i == HUNK_PRINT_NAMES - 1 ? "(other)" : name, sizeof (names[i].name));
+			names[i].sum = names[i].blocks = 0;
+			numnames++;
 		}
+		names[i].sum += h->size;
+		names[i].blocks++;
 
-		h = next;
+		h = (hunk_t *)((byte *)h+h->size);
 	}
 
+	for (i = 0; i < numnames && !all; i++)
+		Com_Printf ("          :%8i %8s (%i)\n", names[i].sum, names[i].name, names[i].blocks);
+
 	Com_Printf ("-------------------------\n");
 	Com_Printf ("%8i total blocks\n", totalblocks);
+	Com_Printf ("          :%8i low hunk (peak %i)\n", hunk_low_used, hunk_low_peak);
+	Com_Printf ("          :%8i high hunk (peak %i)\n", hunk_high_used, hunk_high_peak);
+	Com_Printf ("          :%8i cache (peak %i, limit %i)\n", cache_used, cache_peak, cache_size);
+	Com_Printf ("          :%8i committed of %i reserved\n", min (hunk_size, hunk_low_committed + hunk_high_committed), hunk_size);
+}
 
+static void Hunk_Print_f (void) {
+	Hunk_Print (Cmd_Argc() > 1 && !strcmp (Cmd_Argv(1), "all"));
 }
 
-void *Hunk_AllocName (int size, char *name) {
+static void *Hunk_AllocNameEx (int size, char *name, qbool clear) {
 	hunk_t *h;
 
 #ifdef PARANOID
@@ -136,14 +235,19 @@ void *Hunk_AllocName (int size, char *name) {
 	size = sizeof(hunk_t) + ((size + 15) & ~15);
 
 	if (hunk_size - hunk_low_used - hunk_high_used < size)
-	  	Sys_Error ("Hunk_AllocName: Not enough RAM allocated.  Try using \"-mem 128\" on the ezQuake command line.");
+		Sys_Error ("Hunk_AllocName: all of the %i MB hunk is used", hunk_size / (1024 * 1024));
+	if (!Hunk_CommitLow (hunk_low_used + size))
+		Sys_Error ("Hunk_AllocName: out of memory allocating %i bytes for %s", size, name);
 
 	h = (hunk_t *)(hunk_base + hunk_low_used);
 	hunk_low_used += size;
+	hunk_low_peak = max (hunk_low_peak, hunk_low_used);
 
 	Cache_FreeLow (hunk_low_used);
 
-	memset (h, 0, size);
+	if (clear)
+		Hunk_Clear ((byte *) h, size);
+	hunk_low_clean = max (hunk_low_clean, hunk_low_used);
 
 	h->size = size;
 	h->sentinal = HUNK_SENTINEL;
@@ -152,6 +256,15 @@ void *Hunk_AllocName (int size, char *name) {
 	return (void *) (h + 1);
 }
 
+void *Hunk_AllocName (int size, char *name) {
+	return Hunk_AllocNameEx (size, name, true);
+}
+
+// For callers that fill all of the memory themselves, the contents are undefined.
+void *Hunk_AllocNameNoZero (int size, char *name) {
+	return Hunk_AllocNameEx (size, name, false);
+}
+
 void *Hunk_Alloc (int size) {
 	return Hunk_AllocName (size, "unknown");
 }
@@ -160,10 +273,10 @@ int	Hunk_LowMark (void) {
 	return hunk_low_used;
 }
 
+// The memory is cleared when it's allocated again.
 void Hunk_FreeToLowMark (int mark) {
 	if (mark < 0 || mark > hunk_low_used)
 		Sys_Error ("Hunk_FreeToLowMark: bad mark %i", mark);
-	memset (hunk_base + mark, 0, hunk_low_used - mark);
 	hunk_low_used = mark;
 }
 
@@ -182,11 +295,10 @@ void Hunk_FreeToHighMark (int mark) {
 	}
 	if (mark < 0 || mark > hunk_high_used)
 		Sys_Error ("Hunk_FreeToHighMark: bad mark %i", mark);
-	memset (hunk_base + hunk_size - hunk_high_used, 0, hunk_high_used - mark);
 	hunk_high_used = mark;
 }
 
-void *Hunk_HighAllocName (int size, char *name) {
+static void *Hunk_HighAllocNameEx (int size, char *name, qbool clear) {
 	hunk_t *h;
 
 	if (size < 0)
@@ -204,14 +316,20 @@ void *Hunk_HighAllocName (int size, char *name) {
 	size = sizeof(hunk_t) + ((size+15)&~15);
 
 	if (hunk_size - hunk_low_used - hunk_high_used < size)
-	  	Sys_Error ("Hunk_HighAllocName: Not enough RAM allocated.  Try using \"-mem 128\" on the ezQuake command line.");
+		Sys_Error ("Hunk_HighAllocName: all of the %i MB hunk is used", hunk_size / (1024 * 1024));
+	if (!Hunk_CommitHigh (hunk_high_used + size))
+		Sys_Error ("Hunk_HighAllocName: out of memory allocating %i bytes for %s", size, name);
 
 	hunk_high_used += size;
+	hunk_high_peak = max (hunk_high_peak, hunk_high_used);
 	Cache_FreeHigh (hunk_high_used);
 
 	h = (hunk_t *) (hunk_base + hunk_size - hunk_high_used);
 
-	memset (h, 0, size);
+	if (clear)
+		Hunk_Clear ((byte *) h, size);
+	hunk_high_clean = max (hunk_high_clean, hunk_high_used);
+
 	h->size = size;
 	h->sentinal = HUNK_SENTINEL;
 	strlcpy (h->name, name, sizeof (h->name));
@@ -219,7 +337,11 @@ void *Hunk_HighAllocName (int size, char *name) {
 	return (void *) (h + 1);
 }
 
-//Return space from the top of the hunk
+void *Hunk_HighAllocName (int size, char *name) {
+	return Hunk_HighAllocNameEx (size, name, true);
+}
+
+//Return space from the top of the hunk, not cleared, the callers overwrite it anyway
 void *Hunk_TempAlloc (int size) {
 	void *buf;
 
@@ -232,7 +354,7 @@ void *Hunk_TempAlloc (int size) {
 
 	hunk_tempmark = Hunk_HighMark ();
 
-	buf = Hunk_HighAllocName (size, "temp");
+	buf = Hunk_HighAllocNameEx (size, "temp", false);
 
 	hunk_tempactive = true;
 
@@ -329,6 +451,22 @@ void Cache_MakeLRU (cache_system_t *cs) {
 	cache_head.lru_next = cs;
 }
 
+//Commits the space for a new block at new and sets it up
+static qbool Cache_Place (cache_system_t *new, int size) {
+	int end = (byte *) new - hunk_base + size;
+
+	if (!Hunk_CommitLow (end))
+		return false;
+	hunk_low_clean = max (hunk_low_clean, end);
+
+	cache_used += size;
+	cache_peak = max (cache_peak, cache_used);
+
+	memset (new, 0, sizeof(*new));
+	new->size = size;
+	return true;
+}
+
 //Looks for a free block of memory between the high and low hunk marks
 //Size should already include the header and padding
 cache_system_t *Cache_TryAlloc (int size, qbool nobottom) {
@@ -340,8 +478,8 @@ cache_system_t *Cache_TryAlloc (int size, qbool nobottom) {
 			Sys_Error ("Cache_TryAlloc: %i is greater than free hunk", size);
 
 		new = (cache_system_t *) (hunk_base + hunk_low_used);
-		memset (new, 0, sizeof(*new));
-		new->size = size;
+		if (!Cache_Place (new, size))
+			return NULL;
 
 		cache_head.prev = cache_head.next = new;
 		new->prev = new->next = &cache_head;
@@ -358,8 +496,8 @@ cache_system_t *Cache_TryAlloc (int size, qbool nobottom) {
 		if (!nobottom || cs != cache_head.next) {
 			if ( (byte *)cs - (byte *)new >= size) {
 				// found space
-				memset (new, 0, sizeof(*new));
-				new->size = size;
+				if (!Cache_Place (new, size))
+					return NULL;
 
 				new->next = cs;
 				new->prev = cs->prev;
@@ -380,8 +518,8 @@ cache_system_t *Cache_TryAlloc (int size, qbool nobottom) {
 
 	// try to allocate one at the very end
 	if (hunk_base + hunk_size - hunk_high_used - (byte *) new >= size) {
-		memset (new, 0, sizeof(*new));
-		new->size = size;
+		if (!Cache_Place (new, size))
+			return NULL;
 
 		new->next = &cache_head;
 		new->prev = cache_head.prev;
@@ -412,8 +550,8 @@ void Cache_Print (void) {
 
 void Cache_Report (void) {
 	Com_Printf ("%4.1f of %4.1f megabyte data cache free\n",
-		((hunk_size - hunk_high_used - hunk_low_used) / (float)(1024*1024)),
-		(hunk_size / (float)(1024*1024)));
+		(max (0, cache_size - cache_used) / (float)(1024*1024)),
+		(cache_size / (float)(1024*1024)));
 }
 
 void Cache_Init (void) {
@@ -425,6 +563,7 @@ void Cache_Init_Commands (void) {
 	Cmd_AddCommand ("flush", Cache_Flush);
 	Cmd_AddCommand ("cache_print", Cache_Print);
 	Cmd_AddCommand ("cache_report", Cache_Report);
+	Cmd_AddCommand ("hunk_print", Hunk_Print_f);
 }
 
 //Frees the memory and removes it from the LRU list
@@ -435,6 +574,7 @@ void Cache_Free (cache_user_t *c) {
 		Sys_Error ("Cache_Free: not allocated");
 
 	cs = ((cache_system_t *)c->data) - 1;
+	cache_used -= cs->size;
 
 	cs->prev->next = cs->next;
 	cs->next->prev = cs->prev;
@@ -471,9 +611,10 @@ void *Cache_Alloc (cache_user_t *c, int size, char *name) {
 
 	size = (size + sizeof(cache_system_t) + 15) & ~15;
 
-	// find memory for it
+	// find memory for it, the hunk is big enough to take the whole cache so the
+	// limit is what keeps it from growing further
 	while (1) {
-		if ((cs = Cache_TryAlloc (size, false))) {
+		if ((cache_used + size <= cache_size || cache_head.next == &cache_head) && (cs = Cache_TryAlloc (size, false))) {
 			strlcpy (cs->name, name, sizeof (cs->name));
 			c->data = (void *)(cs+1);
 			cs->user = c;
@@ -492,11 +633,20 @@ void *Cache_Alloc (cache_user_t *c, int size, char *name) {
 
 //============================================================================
 
-void Memory_Init (void *buf, int size) {
-	hunk_base = buf;
-	hunk_size = size;
+//size is what the cache may use, the hunk itself grows as needed
+void Memory_Init (int size) {
+	hunk_size = max (size, HUNK_RESERVE);
+
+	// there may not be that much address space in one piece on 32 bit systems
+	while (!(hunk_base = Hunk_Reserve (hunk_size))) {
+		if (hunk_size / 2 < size)
+			Sys_Error ("Memory_Init: couldn't reserve %4.1f megs of address space", hunk_size / (float)0x100000);
+		hunk_size /= 2;
+	}
+
 	hunk_low_used = 0;
 	hunk_high_used = 0;
+	cache_size = size;
 
 	Cache_Init ();
 }
@@ -28,10 +28,11 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 H_??? The hunk manages the entire memory block given to quake.  It must be
 contiguous.  Memory can be allocated from either the low or high end in a
 stack fashion.  The only way memory is released is by resetting one of the
-pointers.
+pointers.  The block is reserved as address space, memory is committed as
+the hunk grows into it.
 
 Hunk allocations should be given a name, so the Hunk_Print () function
-can display usage.
+(hunk_print command) can display usage.
 
 Hunk allocations are guaranteed to be 16 byte aligned.
 
@@ -41,7 +42,7 @@ server allocations when changing to a higher video mode.
 
 Cache_??? Cache memory is for objects that can be dynamically loaded and
 can usefully stay persistent between levels.  The size of the cache
-fluctuates from level to level.
+is limited by -mem, least recently used data is thrown out past that.
 
 To allocate a cachable object
 
@@ -81,10 +82,11 @@ startup hunk allocations
 
 */
 
-void Memory_Init (void *buf, int size);
+void Memory_Init (int size);
 
 void *Hunk_Alloc (int size); // returns 0 filled memory
 void *Hunk_AllocName (int size, char *name);
+void *Hunk_AllocNameNoZero (int size, char *name); // for callers that overwrite all of it
 
 void *Hunk_HighAllocName (int size, char *name);
 
@@ -94,7 +96,7 @@ void Hunk_FreeToLowMark (int mark);
 int	Hunk_HighMark (void);
 void Hunk_FreeToHighMark (int mark);
 
-void *Hunk_TempAlloc (int size);
+void *Hunk_TempAlloc (int size); // not 0 filled
 
 void Hunk_Check (void);
 